@@ -25,12 +25,62 @@ const unsigned long enc_bin_len = 50; // 50 ms bins
 //BAUD
 const int BAUD = 9600;
 
+//RECORDING
+//Uncomment to send a binary frame per loop for hostTools/replay.cpp.
+//A frame is 51 bytes, so recording switches the port to RECORD_BAUD.
+//#define RECORD
+//Uncomment as well to delta compress the frames (serialtools/pack.h),
+//about a third of the bytes on a simulated run.
+//#define RECORD_PACKED
+const long RECORD_BAUD = 115200;
+//Uncomment to queue recording and telemetry frames in a ring that drains
+//by DMA (serialtools/uarttx.h) at TX_BAUD, instead of Serial.write()
+//blocking the loop once the core's buffer is full. A full ring drops the
+//oldest queued frames, or with TX_DROP_OLDEST false the new one.
+//#define UART_TX
+const long TX_BAUD = 460800;
+const uint16_t TX_RING = 1024; //bytes
+const bool TX_DROP_OLDEST = true;
+
 //SENSOR VARIABLES
 const int sensor_width = 8;
+//Uncomment to acquire frame N+1 while frame N is computed (see
+//control/sensors.h), a higher frame rate for a frame more latency from
+//reading the lines to the motor write.
+//#define PIPELINE
+//Uncomment to adapt the emitter dimming and the read timeout to the floor
+//(see control/emitters.h) instead of full brightness and a 2.5 ms timeout.
+//#define EMITTER_DIMMING
+const double EMITTER_CONTRAST = 3; //slowest line channel over slowest background channel
+
+//SPEED PROFILE
+//Uncomment to take the forward PWM from control/profile.h, the minimum
+//time profile hostTools/speedprof generates for the known track, instead
+//of the fixed vmax with the curve windows' cap.
+//#define SPEED_PROFILE
 
 //IO VARIABLES
 const int startBufferLength = 10;
 const int endBufferLength = 10;
+//Uncomment to send a framed json frame (serialtools/telemetry.h) every
+//TELEMETRY_EVERY loops for serialPlotter/getData.py, at RECORD_BAUD.
+//#define TELEMETRY
+const int TELEMETRY_EVERY = 10;
+
+//TRACE
+//Uncomment to record loop, IR read, turnaround, encoder and serial events
+//with cycle timestamps (see diag/trace.h) and send them after the run for
+//hostTools/tracejson. TRACE_WRAP keeps the newest TRACE_EVENTS, 8 bytes
+//each, otherwise the first ones.
+//#define TRACE
+const uint16_t TRACE_EVENTS = 2048;
+const bool TRACE_WRAP = true;
+
+//HEAP FREE BUILD
+//Uncomment to audit the heap after setup() (see diag/heap.h). Telemetry
+//is written heap free by TelemetryWriter (serialtools/telemetry.h).
+//#define STATIC_ALLOC
+//#define HEAP_TRAP //halt on any heap use after setup() instead of counting
 
 //DRIVE VARIABLES
 const double pDiff = 0.6; //pDiff = 1 - kp
@@ -43,4 +93,26 @@ const long DMAX = 3.5;
 const uint16_t FORWARD = 0;
 const uint16_t REVERSE = 1;
 
+//MOTOR OUTPUT VARIABLES
+const unsigned long SMCLK_HZ = 12000000; //timer clock feeding the PWM timer
+const unsigned long PWM_FREQ = 10000; //10 kHz PWM, 1200 timer counts per period
+const uint16_t PWM_FULLSCALE = 4095; //12 bit duty used by the motor driver
+
+//CASCADED CONTROL
+//Uncomment to have the line loop set wheel speed targets and per wheel
+//speed loops set the PWM from encoder feedback (see control/speed.h).
+//#define CASCADE
+const double WHEEL_CPS_MAX = 1640; //encoder counts/s of a wheel at full PWM
+
+//COOPERATIVE TASKS
+//Uncomment to run sensing, control, the turnaround, the wheel loops,
+//commands and telemetry as tasks with priorities and deadlines (see
+//control/tasks.h) instead of one blocking pass per frame. Not with RECORD,
+//hostTools/replay.cpp steps one frame per loop().
+//#define TASKS
+const uint32_t SENSE_DEADLINE_US = 3000; //between completed frames, 2.5 ms RC timeout and the read
+const uint32_t CONTROL_DEADLINE_US = 1000; //completed frame to motor write
+const uint32_t COMMAND_PERIOD_US = 5000;
+const uint32_t TELEMETRY_PERIOD_US = 15000; //about TELEMETRY_EVERY frames
+
 //DONUT VARIABLE
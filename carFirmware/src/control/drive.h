@@ -8,6 +8,16 @@
 #include "const.h"
 #endif
 
+#ifndef MOTOR_H
+#define MOTOR_H
+#include "motor.h"
+#endif
+
+#ifndef PARAMS_H
+#define PARAMS_H
+#include "params.h"
+#endif
+
 //drive object
 class Drive{
 private:
@@ -23,10 +33,16 @@ private:
     //double prevDer;
     double d(double pos);
 
+    //Unrounded wheel duty from the last update
+    double dutyL;
+    double dutyR;
+
     //double vel;
 public:
     Drive();
     void update(uint16_t vForward, double pos, bool turn);
+    //Outputs of the last update as one batched motor command
+    MotorCommand command();
     uint16_t DIR_L;
     uint16_t DIR_R;
     uint16_t PWML;
@@ -45,6 +61,8 @@ Drive::Drive(){
   this->prevPos = C;
   //this->prevDer = 0;
   this->sum = 0;
+  this->dutyL = 0;
+  this->dutyR = 0;
   //this->vel = 0;
 }
 
@@ -75,15 +93,16 @@ void Drive::update(uint16_t vForward, double pos, bool turn){
     double intg = i(pos);
     double der = d(pos);
 
-    double kp = 0.7*PWMAX/DMAX;
-    double ki = 0*PWMAX/DMAX;
-    double kd = 14*PWMAX/DMAX;
+    double kp = params.v[P_KP]*PWMAX/DMAX;
+    double ki = params.v[P_KI]*PWMAX/DMAX;
+    double kd = params.v[P_KD]*PWMAX/DMAX;
 
     double vDiff = kp*prop + ki*intg + kd*der;
 
     if (turn){
-        vForward = VTURN;
-        vDiff = 32*kp*prop + ki*intg + 32*kd*der;
+        //cap, a speed profile may already be slower here
+        if (vForward > params.v[P_VTURN]) vForward = params.v[P_VTURN];
+        vDiff = params.v[P_TURN_KP]*kp*prop + ki*intg + params.v[P_TURN_KD]*kd*der;
     }
 
     //detect curve
@@ -106,6 +125,13 @@ void Drive::update(uint16_t vForward, double pos, bool turn){
     */
 
     double V = vForward - 0.5*abs(vDiff);
-    PWML = V + 0.5*vDiff;
-    PWMR = V - 0.5*vDiff;
+    dutyL = constrain(V + 0.5*vDiff, 0, PWMAX);
+    dutyR = constrain(V - 0.5*vDiff, 0, PWMAX);
+    PWML = dutyL;
+    PWMR = dutyR;
+}
+
+MotorCommand Drive::command(){
+    MotorCommand cmd = {nSLPL, nSLPR, DIR_L, DIR_R, fullscale(dutyL), fullscale(dutyR)};
+    return cmd;
 }
\ No newline at end of file
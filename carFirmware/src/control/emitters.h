@@ -0,0 +1,225 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "const.h"
+#endif
+
+#ifndef TIMING_H
+#define TIMING_H
+#include "../diag/timing.h"
+#endif
+
+#include "../ece3/ECE3.h"
+
+//Adaptive emitter dimming and read timeout (EMITTER_DIMMING in const.h)
+//
+//A frame lasts as long as its slowest channel and the channels over the
+//line run into the read timeout, so the timeout is the frame's worst case
+//discharge time. Every EMITTER_WINDOW frames the loop takes the slowest
+//background channel seen (the largest reading outside a frame's three
+//largest, the 2 pitch wide line can touch three) and the fastest line
+//(the smallest frame maximum), and sets the timeout to EMITTER_CONTRAST
+//times that background, with EMITTER_HEADROOM to spare: the line still
+//reads as the timeout, at least EMITTER_CONTRAST times any background
+//channel, and the frame ends as soon as that is certain.
+//
+//The dimming level moves both. Brighter emitters speed the background up
+//and so shorten the timeout, until the phototransistors saturate on the
+//floor and the line catches up with it. Every EMITTER_PROBE windows, and
+//every window while the line reads faster than the contrast needs, the
+//level steps EMITTER_STEP one way for a window. The step stays if it holds
+//the contrast with a timeout at least EMITTER_GAIN shorter; otherwise the
+//level steps back and the next probe goes the other way. While the
+//contrast fails the steps stay, sweeping the levels end to end until it
+//holds again. Frames without a line (cross lines, gaps) do not count.
+//After EMITTER_LOST windows without one the loop falls back to full
+//brightness and the longest timeout.
+//
+//update() must run between reads: changing the level turns the emitters
+//off and on again, 1.5 ms. report() prints the frame period at each level
+//used and the timeouts the loop settled on.
+
+const uint8_t EMITTER_WINDOW = 16; //frames per adjustment
+const uint8_t EMITTER_PROBE = 32; //windows between dimming probes
+const uint8_t EMITTER_LOST = 8; //windows without a line before falling back
+const uint8_t EMITTER_LEVELS = 32; //0 brightest
+const uint8_t EMITTER_STEP = 4; //levels per probe, a single one is lost in the noise
+const uint16_t EMITTER_TIMEOUT_MIN = 300;
+const uint16_t EMITTER_TIMEOUT_MAX = 2500; //QTRRCDefaultTimeout
+const double EMITTER_HEADROOM = 1.2;
+const double EMITTER_GAIN = 0.95; //a step has to cut the timeout to this
+const double EMITTER_SEEN = 1.5; //a frame with its maximum under this times the background has no line
+
+class EmitterControl{
+private:
+    uint8_t level;
+    int8_t dir; //next probe, +1 dimmer, -1 brighter
+    uint16_t timeout;
+    bool probing;
+    uint8_t fromLevel; //level before the probe
+    uint16_t fromTimeout; //timeout wanted before the probe, 0 if the contrast failed
+    uint8_t windows; //since the last probe
+    uint8_t lost; //windows in a row without a line
+    //window being collected
+    uint8_t seen;
+    uint8_t lines;
+    uint16_t lineLo;
+    uint16_t backHi;
+    //log
+    uint32_t last; //micros() of the last update
+    uint32_t frames[EMITTER_LEVELS];
+    uint32_t busy[EMITTER_LEVELS]; //us of frame periods at each level
+    uint32_t changes;
+    Timing timeouts;
+    float worst; //lowest window contrast
+    void set(uint8_t l);
+    void endWindow();
+public:
+    EmitterControl();
+    //Feed the frame that just completed, nothing may be in flight
+    void update(const uint16_t *sensorValues);
+    uint8_t dimming() const { return level; }
+    uint16_t readTimeout() const { return timeout; }
+    //Print frames, period and fps per dimming level and the timeouts used
+    void report();
+};
+
+EmitterControl::EmitterControl(){
+    level = 0;
+    dir = 1;
+    timeout = EMITTER_TIMEOUT_MAX;
+    probing = false;
+    fromLevel = 0;
+    fromTimeout = 0;
+    windows = 0;
+    lost = 0;
+    seen = lines = 0;
+    lineLo = 0xFFFF;
+    backHi = 0;
+    last = 0;
+    for (uint8_t l=0; l<EMITTER_LEVELS; l++) frames[l] = busy[l] = 0;
+    changes = 0;
+    worst = 0;
+}
+
+void EmitterControl::set(uint8_t l){
+    if (l == level) return;
+    level = l;
+    ECE3_set_emitters(level);
+    changes++;
+}
+
+void EmitterControl::update(const uint16_t *sensorValues){
+    uint32_t now = micros();
+    if (last){
+        frames[level]++;
+        busy[level] += now - last;
+    }
+    last = now;
+
+    //line is the largest reading, background the fourth largest
+    uint16_t top[4] = {0, 0, 0, 0};
+    for (uint8_t i=0; i<sensor_width; i++){
+        uint16_t v = sensorValues[i];
+        for (uint8_t k=0; k<4; k++){
+            if (v <= top[k]) continue;
+            uint16_t t = top[k];
+            top[k] = v;
+            v = t;
+        }
+    }
+    uint16_t line = top[0], back = top[3];
+
+    seen++;
+    if (line >= EMITTER_SEEN*back){
+        lines++;
+        if (line < lineLo) lineLo = line;
+        if (back > backHi) backHi = back;
+    }
+    if (seen >= EMITTER_WINDOW) endWindow();
+}
+
+void EmitterControl::endWindow(){
+    bool any = lines > 0;
+    uint16_t lo = lineLo, hi = backHi;
+    seen = lines = 0;
+    lineLo = 0xFFFF;
+    backHi = 0;
+
+    if (!any){
+        if (++lost >= EMITTER_LOST){
+            probing = false;
+            set(0);
+            timeout = EMITTER_TIMEOUT_MAX;
+            ECE3_set_timeout(timeout);
+        }
+        return;
+    }
+    lost = 0;
+
+    double want = EMITTER_CONTRAST*hi; //the line has to read at least this
+    uint16_t need = constrain(want*EMITTER_HEADROOM, EMITTER_TIMEOUT_MIN, EMITTER_TIMEOUT_MAX);
+    //a line that reads as the timeout may well be slower still
+    bool holds = lo >= want || lo >= timeout;
+    float contrast = hi ? (float)lo/hi : 0;
+    if (worst == 0 || contrast < worst) worst = contrast;
+
+    if (probing){
+        probing = false;
+        windows = 0;
+        bool better = holds ? !fromTimeout || need < fromTimeout*EMITTER_GAIN : !fromTimeout;
+        if (!better){
+            //no better, go back and try the other way next time
+            set(fromLevel);
+            dir = -dir;
+            if (fromTimeout) need = fromTimeout;
+        }
+    }
+    else if (!holds || ++windows >= EMITTER_PROBE){
+        int8_t next = level + dir*EMITTER_STEP;
+        if (next < 0 || next >= EMITTER_LEVELS){
+            dir = -dir;
+            next = level + dir*EMITTER_STEP;
+        }
+        fromLevel = level;
+        fromTimeout = holds ? need : 0;
+        probing = true;
+        windows = 0;
+        set(next);
+    }
+
+    timeout = need;
+    timeouts.add(timeout);
+    ECE3_set_timeout(timeout);
+}
+
+void EmitterControl::report(){
+    for (uint8_t l=0; l<EMITTER_LEVELS; l++){
+        if (!frames[l]) continue;
+        uint32_t period = busy[l]/frames[l];
+        Serial.print("dimming ");
+        Serial.print(l);
+        Serial.print(" frames ");
+        Serial.print(frames[l]);
+        Serial.print(" period us ");
+        Serial.print(period);
+        Serial.print(" fps ");
+        Serial.println(period ? 1000000/period : 0);
+    }
+    Serial.print("read timeout us ");
+    Serial.print(timeouts.mean());
+    Serial.print(" (");
+    Serial.print(timeouts.n ? timeouts.lo : timeout);
+    Serial.print("-");
+    Serial.print(timeouts.hi);
+    Serial.print("), dimming ");
+    Serial.print(level);
+    Serial.print(", ");
+    Serial.print(changes);
+    Serial.print(" level changes, worst contrast ");
+    Serial.println(worst, 2);
+}
@@ -0,0 +1,169 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "const.h"
+#endif
+
+//Lap and segment split timing
+//
+//A lap is leg 0 (start to the first cross line), the turnaround spin and
+//leg 1 (back to the second cross line), following donuts. Each leg is cut
+//into segments of LAP_SEGMENT_COUNTS summed encoder counts; a segment's
+//split is the time from entering it to entering the next one (or to the
+//cross line) and its peak error the largest |C - pos| seen in it. Counts
+//past the last segment fall in the last one.
+//
+//report() prints every split with its delta to LAP_BEST_US, the lap and
+//its delta, and when the lap beats the stored one the lines to paste over
+//LAP_BEST_US and LAP_BEST_SPIN_US.
+
+const uint8_t LAP_LEGS = 2;
+const uint8_t LAP_SEGMENTS = 16;
+const uint32_t LAP_SEGMENT_COUNTS = 720; //2 revs of each wheel, about 22 cm
+
+//Best lap so far, all 0 for none
+const uint32_t LAP_BEST_US[LAP_LEGS][LAP_SEGMENTS] = {{0}};
+const uint32_t LAP_BEST_SPIN_US = 0;
+
+class LapTimer{
+private:
+    uint32_t split[LAP_LEGS][LAP_SEGMENTS]; //us
+    float peak[LAP_LEGS][LAP_SEGMENTS]; //line error
+    uint8_t used[LAP_LEGS]; //segments reached
+    uint32_t legTime[LAP_LEGS];
+    uint32_t spin; //us between the end of leg 0 and the start of leg 1
+    int8_t leg; //leg being timed, -1 before the first update
+    bool driving; //leg started and not yet ended
+    uint8_t seg;
+    uint32_t legStart;
+    uint32_t segStart;
+    uint32_t legEnd;
+    void close(uint32_t now);
+    void printDelta(int32_t us);
+public:
+    LapTimer();
+    //Every loop, donuts as counted by loop(), summed encoder counts since
+    //the leg started, line error C - pos and micros()
+    void update(int donuts, uint32_t counts, double error, uint32_t now);
+    //Both legs done
+    bool complete() const { return !driving && leg == LAP_LEGS - 1 && used[leg]; }
+    //Lap time in us, 0 until complete()
+    uint32_t lap() const;
+    //Print splits, peak errors and deltas to the best lap
+    void report();
+};
+
+LapTimer::LapTimer(){
+    for (uint8_t l=0; l<LAP_LEGS; l++){
+        for (uint8_t s=0; s<LAP_SEGMENTS; s++){
+            split[l][s] = 0;
+            peak[l][s] = 0;
+        }
+        used[l] = 0;
+        legTime[l] = 0;
+    }
+    spin = 0;
+    leg = -1;
+    driving = false;
+    seg = 0;
+    legStart = segStart = legEnd = 0;
+}
+
+void LapTimer::close(uint32_t now){
+    split[leg][seg] = now - segStart;
+    if (used[leg] < seg + 1) used[leg] = seg + 1;
+    segStart = now;
+}
+
+void LapTimer::update(int donuts, uint32_t counts, double error, uint32_t now){
+    if (driving && donuts != leg){
+        //crossed the line that ends the leg
+        close(now);
+        legTime[leg] = now - legStart;
+        legEnd = now;
+        driving = false;
+        return;
+    }
+    if (!driving){
+        if (donuts >= LAP_LEGS || donuts == leg) return;
+        if (leg >= 0) spin = now - legEnd;
+        leg = donuts;
+        driving = true;
+        seg = 0;
+        legStart = segStart = now;
+    }
+
+    uint32_t s = counts/LAP_SEGMENT_COUNTS;
+    if (s >= LAP_SEGMENTS) s = LAP_SEGMENTS - 1;
+    while (seg < s){
+        close(now);
+        seg++;
+    }
+    float e = error < 0 ? -error : error;
+    if (e > peak[leg][seg]) peak[leg][seg] = e;
+}
+
+uint32_t LapTimer::lap() const {
+    if (!complete()) return 0;
+    return legTime[0] + spin + legTime[1];
+}
+
+void LapTimer::printDelta(int32_t us){
+    Serial.print(us < 0 ? " -" : " +");
+    Serial.print((us < 0 ? -us : us)/1000.0, 1);
+}
+
+void LapTimer::report(){
+    bool best = LAP_BEST_SPIN_US > 0;
+    uint32_t bestLap = LAP_BEST_SPIN_US;
+    for (uint8_t l=0; l<LAP_LEGS; l++){
+        for (uint8_t s=0; s<LAP_SEGMENTS; s++) bestLap += LAP_BEST_US[l][s];
+    }
+
+    for (uint8_t l=0; l<LAP_LEGS; l++){
+        Serial.print("leg ");
+        Serial.print(l);
+        Serial.print(" ms ");
+        Serial.println(legTime[l]/1000.0, 1);
+        for (uint8_t s=0; s<used[l]; s++){
+            Serial.print("  seg ");
+            Serial.print(s);
+            Serial.print(" ms ");
+            Serial.print(split[l][s]/1000.0, 1);
+            if (best) printDelta(split[l][s] - LAP_BEST_US[l][s]);
+            Serial.print(" err ");
+            Serial.println(peak[l][s], 2);
+        }
+    }
+    Serial.print("spin ms ");
+    Serial.println(spin/1000.0, 1);
+
+    uint32_t t = lap();
+    if (!t){
+        Serial.println("lap incomplete");
+        return;
+    }
+    Serial.print("lap ms ");
+    Serial.print(t/1000.0, 1);
+    if (best) printDelta(t - bestLap);
+    Serial.println();
+
+    if (best && t >= bestLap) return;
+    //paste over LAP_BEST_US and LAP_BEST_SPIN_US
+    Serial.print("new best: LAP_BEST_US = {");
+    for (uint8_t l=0; l<LAP_LEGS; l++){
+        Serial.print(l ? ", {" : "{");
+        for (uint8_t s=0; s<LAP_SEGMENTS; s++){
+            if (s) Serial.print(", ");
+            Serial.print(split[l][s]);
+        }
+        Serial.print("}");
+    }
+    Serial.print("}; LAP_BEST_SPIN_US = ");
+    Serial.print(spin);
+    Serial.println(";");
+}
@@ -0,0 +1,140 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "const.h"
+#endif
+
+#ifdef __MSP432P401R__
+#include "msp.h"
+#endif
+
+//One batched set of motor outputs, PWM is in PWM_FULLSCALE units
+struct MotorCommand{
+    uint16_t nSLPL;
+    uint16_t nSLPR;
+    uint16_t DIR_L;
+    uint16_t DIR_R;
+    uint16_t PWML;
+    uint16_t PWMR;
+};
+
+//Convert a duty in PWMAX units to PWM_FULLSCALE units
+uint16_t fullscale(double pwm){
+    if (pwm < 0) pwm = 0;
+    if (pwm > PWMAX) pwm = PWMAX;
+    return (uint16_t)(pwm*PWM_FULLSCALE/PWMAX + 0.5);
+}
+
+//Both motors stopped
+MotorCommand motorStop(){
+    MotorCommand cmd = {HIGH, HIGH, FORWARD, FORWARD, 0, 0};
+    return cmd;
+}
+
+//Spin in place at full power
+MotorCommand motorSpin(){
+    MotorCommand cmd = {HIGH, HIGH, FORWARD, REVERSE, PWM_FULLSCALE, PWM_FULLSCALE};
+    return cmd;
+}
+
+//Both motors forward at full power
+MotorCommand motorForward(){
+    MotorCommand cmd = {HIGH, HIGH, FORWARD, FORWARD, PWM_FULLSCALE, PWM_FULLSCALE};
+    return cmd;
+}
+
+//Motor output stage
+//Only writes outputs that changed since the last command. On the MSP432 the
+//PWM pins are driven straight from the TIMER_A0 compare registers
+//(P2.7 = TA0.4 = PWML, P2.6 = TA0.3 = PWMR) instead of analogWrite, which
+//gives period/PWM_FULLSCALE resolution at any frequency.
+class MotorDriver{
+private:
+    MotorCommand last;
+    bool primed; //false until the first command has been written out
+    uint16_t period; //timer counts per PWM period
+    void writePWM(int pin, uint16_t duty);
+public:
+    MotorDriver();
+    //Set pin modes and start the PWM timer
+    void begin(unsigned long freq = PWM_FREQ);
+    //Write a command, skipping outputs that did not change
+    void write(const MotorCommand &cmd);
+    //Last command written
+    const MotorCommand &current();
+    //Number of distinct duty steps the timer can produce
+    uint16_t resolution();
+};
+
+MotorDriver::MotorDriver(){
+    this->last = motorStop();
+    this->primed = false;
+    this->period = 0;
+}
+
+void MotorDriver::begin(unsigned long freq){
+    pinMode(nSLPL, OUTPUT);
+    pinMode(DIR_L, OUTPUT);
+    pinMode(PWML, OUTPUT);
+
+    pinMode(nSLPR, OUTPUT);
+    pinMode(DIR_R, OUTPUT);
+    pinMode(PWMR, OUTPUT);
+
+    unsigned long counts = SMCLK_HZ/freq;
+    if (counts > 0xFFFF) counts = 0xFFFF;
+    if (counts < 2) counts = 2;
+    period = counts;
+
+#ifdef __MSP432P401R__
+    //hand P2.6/P2.7 to their default port mapped TA0.3/TA0.4 outputs
+    P2->DIR |= BIT6 | BIT7;
+    P2->SEL0 |= BIT6 | BIT7;
+    P2->SEL1 &= ~(BIT6 | BIT7);
+
+    TIMER_A0->CTL = TIMER_A_CTL_SSEL__SMCLK | TIMER_A_CTL_CLR;
+    TIMER_A0->CCR[0] = period - 1;
+    TIMER_A0->CCTL[3] = TIMER_A_CCTLN_OUTMOD_7; //reset/set
+    TIMER_A0->CCTL[4] = TIMER_A_CCTLN_OUTMOD_7;
+    TIMER_A0->CCR[3] = 0;
+    TIMER_A0->CCR[4] = 0;
+    TIMER_A0->CTL |= TIMER_A_CTL_MC__UP;
+#endif
+
+    primed = false;
+    write(motorStop());
+}
+
+void MotorDriver::writePWM(int pin, uint16_t duty){
+    if (duty > PWM_FULLSCALE) duty = PWM_FULLSCALE;
+#ifdef __MSP432P401R__
+    uint16_t counts = (uint32_t)duty*period/PWM_FULLSCALE;
+    if (pin == PWML) TIMER_A0->CCR[4] = counts;
+    else TIMER_A0->CCR[3] = counts;
+#else
+    analogWrite(pin, (uint32_t)duty*PWMAX/PWM_FULLSCALE);
+#endif
+}
+
+void MotorDriver::write(const MotorCommand &cmd){
+    if (!primed || cmd.nSLPL != last.nSLPL) digitalWrite(nSLPL, cmd.nSLPL);
+    if (!primed || cmd.nSLPR != last.nSLPR) digitalWrite(nSLPR, cmd.nSLPR);
+    if (!primed || cmd.DIR_L != last.DIR_L) digitalWrite(DIR_L, cmd.DIR_L);
+    if (!primed || cmd.DIR_R != last.DIR_R) digitalWrite(DIR_R, cmd.DIR_R);
+    if (!primed || cmd.PWML != last.PWML) writePWM(PWML, cmd.PWML);
+    if (!primed || cmd.PWMR != last.PWMR) writePWM(PWMR, cmd.PWMR);
+    last = cmd;
+    primed = true;
+}
+
+const MotorCommand &MotorDriver::current(){
+    return last;
+}
+
+uint16_t MotorDriver::resolution(){
+    return period < PWM_FULLSCALE ? period : PWM_FULLSCALE;
+}
@@ -0,0 +1,108 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "../const.h"
+#endif
+
+//Controller parameters that can be changed while the car runs
+//(see serialtools/command.h). Defaults match the values that used to be
+//hard coded in drive.h, const.h and main.cpp.
+
+//Bumped whenever the layout of Params changes
+const uint16_t PARAMS_VERSION = 3;
+
+enum ParamId{
+    P_KP,       //proportional gain, multiple of PWMAX/DMAX
+    P_KI,       //integral gain, multiple of PWMAX/DMAX
+    P_KD,       //derivative gain, multiple of PWMAX/DMAX
+    P_TURN_KP,  //kp multiplier inside curve windows
+    P_TURN_KD,  //kd multiplier inside curve windows
+    P_VMAX,     //forward PWM on straights
+    P_VTURN,    //forward PWM inside curve windows
+    P_WINDOW,   //curve windows: leg (there, back) x 3 x (lo, hi) in revs,
+                //a window is active while lo < loc < hi
+    P_CROSS_ON = P_WINDOW + 12, //flatness under which a frame is a cross line hit
+    P_CROSS_OFF,     //flatness over which the line is seen again
+    P_CROSS_CONFIRM, //frames the cross line confidence is taken over (control/turn.h)
+    P_WHEEL_KP, //wheel speed loop gains with CASCADE (control/speed.h), in
+    P_WHEEL_KI, //feed forward PWM per count/s of error and per count of its integral
+    P_COUNT
+};
+
+const int CURVE_WINDOWS = 3;
+
+struct Params{
+    uint16_t version;
+    uint16_t revision; //incremented every time an update is applied
+    double v[P_COUNT];
+};
+
+const double PARAM_DEFAULTS[P_COUNT] = {
+    0.7, 0, 14, 32, 32, 255, 200,
+    //way there
+    -1, 2, 13, 20, 24, 1000000,
+    //way back
+    -1, 3, 7, 14, 24, 1000000,
+    //cross line detector
+    0.15, 0.3, 2,
+    //wheel speed loops
+    1, 10
+};
+
+//Values a parameter may be set to, serialtools/command.h rejects the rest.
+//The PWMs end up as uint16_t and the confirm count is at most control/
+//turn.h's CROSS_WINDOW.
+const double PARAM_MIN[P_COUNT] = {
+    0, 0, 0, 0, 0, 0, 0,
+    -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1,
+    0, 0, 1,
+    0, 0
+};
+const double PARAM_MAX[P_COUNT] = {
+    1000, 1000, 1000, 1000, 1000, PWMAX, PWMAX,
+    1000000, 1000000, 1000000, 1000000, 1000000, 1000000,
+    1000000, 1000000, 1000000, 1000000, 1000000, 1000000,
+    8, 8, 8,
+    1000, 1000
+};
+
+void paramsDefault(Params &p){
+    p.version = PARAMS_VERSION;
+    p.revision = 0;
+    for (int i=0; i<P_COUNT; i++) p.v[i] = PARAM_DEFAULTS[i];
+}
+
+Params paramsInit(){
+    Params p;
+    paramsDefault(p);
+    return p;
+}
+
+//True if every value is in range (NaN is not), every curve window has lo
+//at most hi and the cross line detector turns on below where it turns off
+bool paramsValid(const Params &p){
+    for (int i=0; i<P_COUNT; i++){
+        if (!(p.v[i] >= PARAM_MIN[i] && p.v[i] <= PARAM_MAX[i])) return false;
+    }
+    for (int i=0; i<2*CURVE_WINDOWS; i++){
+        if (p.v[P_WINDOW + 2*i] > p.v[P_WINDOW + 2*i + 1]) return false;
+    }
+    return p.v[P_CROSS_ON] < p.v[P_CROSS_OFF];
+}
+
+//Live parameters used by the control loop
+Params params = paramsInit();
+
+//True if loc (encoder revs) is inside a curve window of leg 0 (there) or 1 (back)
+bool inCurve(const Params &p, int leg, int loc){
+    const double *w = &p.v[P_WINDOW + leg*2*CURVE_WINDOWS];
+    for (int i=0; i<CURVE_WINDOWS; i++){
+        if (loc > w[2*i] && loc < w[2*i + 1]) return true;
+    }
+    return false;
+}
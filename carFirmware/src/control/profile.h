@@ -0,0 +1,55 @@
+//Generated by hostTools/speedprof from simulation/track.csv, do not edit.
+//accel 150 brake 200 grip 300 vmax 90, 4.443 s for the slower leg.
+
+const int PROFILE_BINS = 287;
+const uint32_t PROFILE_BIN_COUNTS = 32; //summed left + right counts per bin
+
+//Forward PWM per bin, leg 0 there and leg 1 back
+constexpr uint8_t PROFILE_PWM[2][287] = {
+    {
+        55, 55, 67, 82, 95, 105, 112, 120, 128, 135, 140, 145, 150, 154, 157, 160,
+        162, 163, 165, 169, 176, 182, 188, 191, 197, 202, 208, 213, 219, 224, 229, 233,
+        238, 243, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 245, 239, 233, 226, 220, 213, 205, 198, 190, 182, 174, 165, 155, 145,
+        135, 123, 110, 96, 87, 68, 60, 60, 65, 80, 86, 86, 95, 101, 104, 104,
+        102, 94, 89, 89, 79, 60, 60, 60, 72, 86, 98, 104, 114, 124, 132, 141,
+        148, 156, 163, 170, 176, 183, 189, 194, 200, 206, 211, 216, 222, 227, 232, 236,
+        241, 243, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        245, 238, 232, 225, 219, 212, 204, 197, 189, 185, 177, 169, 165, 164, 164, 161,
+        161, 162, 159, 156, 150, 145, 138, 129, 121, 115, 103, 87, 67, 55, 55
+    },
+    {
+        55, 55, 67, 82, 95, 104, 112, 121, 128, 135, 140, 145, 150, 154, 157, 160,
+        162, 164, 166, 170, 177, 183, 189, 192, 198, 203, 209, 214, 219, 224, 229, 234,
+        239, 244, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 244, 238, 232, 225, 218, 211, 204, 197, 189, 181, 172, 163, 154,
+        144, 133, 121, 108, 101, 84, 65, 60, 60, 67, 82, 89, 89, 97, 102, 105,
+        105, 100, 91, 86, 86, 76, 60, 60, 60, 74, 88, 94, 106, 116, 125, 134,
+        142, 150, 157, 164, 171, 177, 184, 190, 195, 201, 207, 212, 217, 222, 227, 232,
+        237, 240, 244, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247, 247,
+        244, 237, 231, 224, 217, 210, 203, 196, 188, 184, 175, 168, 165, 164, 164, 164,
+        161, 158, 158, 155, 150, 144, 138, 129, 121, 116, 103, 87, 67, 55, 55
+    }
+};
+
+//Forward PWM for a leg and the summed encoder counts since it started
+inline uint8_t PROFILE_pwm(int leg, uint32_t counts){
+    uint32_t b = counts/PROFILE_BIN_COUNTS;
+    return PROFILE_PWM[leg ? 1 : 0][b < PROFILE_BINS ? b : PROFILE_BINS - 1];
+}
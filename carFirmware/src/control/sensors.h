@@ -0,0 +1,163 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "const.h"
+#endif
+
+#ifndef TIMING_H
+#define TIMING_H
+#include "../diag/timing.h"
+#endif
+
+#ifndef TRACE_H
+#define TRACE_H
+#include "../diag/trace.h"
+#endif
+
+#include "../ece3/ECE3.h"
+
+//Double buffered IR acquisition
+//
+//acquire() starts the RC discharge of the next frame into the back buffer
+//and returns; complete() waits for it and swaps it to the front. With
+//PIPELINE the loop computes on the front frame between the two, so frame
+//N+1 discharges while frame N turns into motor commands, calling service()
+//between compute stages so each line is timestamped close to when it falls.
+//Without PIPELINE the loop calls complete() right after acquire().
+//
+//An idle function set with onIdle() runs from service() and while
+//complete() waits for the discharge, e.g. a faster inner control loop.
+//
+//Latency is measured from the start of a frame's acquisition to the motor
+//write that used it (actuated()), the period between completed frames.
+
+class SensorPipeline{
+private:
+    uint16_t frames[2][sensor_width];
+    uint32_t started[2]; //micros() when acquisition of each buffer began
+    uint8_t front; //buffer being computed on
+    bool inFlight; //back buffer is discharging
+    uint32_t lastDone; //micros() of the last complete()
+    bool done; //lastDone is valid
+    void (*idle)(); //run while waiting, 0 for none
+public:
+    Timing latency; //acquisition start to motor write
+    Timing period; //between completed frames
+
+    SensorPipeline();
+    //Start acquiring the next frame
+    void acquire();
+    //Sample the lines of the frame being acquired, cheap enough to call
+    //between compute stages
+    void service();
+    //Nothing in flight or the frame in flight has fully discharged, so
+    //complete() will not wait
+    bool ready();
+    //Wait for the frame being acquired and make it the current frame
+    void complete();
+    //Throw away the frame being acquired (e.g. taken before a turnaround)
+    //and start over
+    void restart();
+    //Run fn from service() and while complete() waits
+    void onIdle(void (*fn)());
+    //Current frame
+    uint16_t *frame();
+    //The current frame has reached the motors
+    void actuated();
+    //Print latency, period and frame rate
+    void report();
+};
+
+SensorPipeline::SensorPipeline(){
+    for (uint8_t b=0; b<2; b++){
+        for (uint8_t i=0; i<sensor_width; i++) frames[b][i] = 0;
+        started[b] = 0;
+    }
+    front = 0;
+    inFlight = false;
+    lastDone = 0;
+    done = false;
+    idle = 0;
+}
+
+void SensorPipeline::acquire(){
+    if (inFlight) return;
+    uint8_t back = front ^ 1;
+    started[back] = micros();
+    TRACE_BEGIN(TR_READ_IR, 0);
+    ECE3_start_IR(frames[back]);
+    inFlight = true;
+}
+
+void SensorPipeline::service(){
+    if (inFlight) ECE3_poll_IR();
+    if (idle) idle();
+}
+
+bool SensorPipeline::ready(){
+    return !inFlight || ECE3_poll_IR();
+}
+
+void SensorPipeline::complete(){
+    if (!inFlight) return;
+    TRACE_BEGIN(TR_READ_WAIT, 0);
+    if (idle){
+        while (!ECE3_poll_IR()) idle();
+    }
+    ECE3_finish_IR();
+    TRACE_END(TR_READ_WAIT);
+    TRACE_END(TR_READ_IR);
+    inFlight = false;
+    front ^= 1;
+
+    uint32_t now = micros();
+    if (done) period.add(now - lastDone);
+    lastDone = now;
+    done = true;
+}
+
+void SensorPipeline::restart(){
+    if (!inFlight) return;
+    ECE3_finish_IR();
+    TRACE_END(TR_READ_IR);
+    inFlight = false;
+    acquire();
+}
+
+void SensorPipeline::onIdle(void (*fn)()){
+    idle = fn;
+}
+
+uint16_t *SensorPipeline::frame(){
+    return frames[front];
+}
+
+void SensorPipeline::actuated(){
+    latency.add(micros() - started[front]);
+}
+
+void SensorPipeline::report(){
+#ifdef PIPELINE
+    Serial.print("pipelined");
+#else
+    Serial.print("sequential");
+#endif
+    Serial.print(" latency us ");
+    Serial.print(latency.mean());
+    Serial.print(" (");
+    Serial.print(latency.lo);
+    Serial.print("-");
+    Serial.print(latency.hi);
+    Serial.print("), period us ");
+    Serial.print(period.mean());
+    Serial.print(" (");
+    Serial.print(period.lo);
+    Serial.print("-");
+    Serial.print(period.hi);
+    Serial.print("), fps ");
+    Serial.println(period.mean() ? 1000000/period.mean() : 0);
+}
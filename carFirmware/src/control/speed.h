@@ -0,0 +1,185 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "const.h"
+#endif
+
+#ifndef MOTOR_H
+#define MOTOR_H
+#include "motor.h"
+#endif
+
+#ifndef PARAMS_H
+#define PARAMS_H
+#include "params.h"
+#endif
+
+#include "../ece3/ECE3.h"
+
+//Cascaded wheel speed control (CASCADE in const.h)
+//
+//The line loop (Drive::update, once per sensor frame) no longer drives the
+//motors. Its command is read as target wheel speeds, full PWM being
+//WHEEL_CPS_MAX encoder counts/s, and a PI loop per wheel with a feed
+//forward turns the measured speed into PWM every CASCADE_PERIOD_US, so
+//battery sag and wheel load stop changing how fast the car goes and turns.
+//
+//service() is the scheduler. It is called whenever the line loop waits or
+//between its compute stages and runs the inner tick once its time mark has
+//come; marks are CASCADE_PERIOD_US apart whatever the line loop does.
+//Marks missed because no call came in time are skipped and counted rather
+//than run in a burst, and the tick after a gap integrates over the whole
+//gap. Speed is measured over the last CASCADE_SPEED_TICKS ticks against
+//their timestamps, so a skipped mark does not bend it.
+
+const uint32_t CASCADE_PERIOD_US = 1000;
+const uint8_t CASCADE_SPEED_TICKS = 8;
+
+//One wheel's speed loop, speeds in encoder counts/s
+class WheelLoop{
+private:
+    uint32_t counts[CASCADE_SPEED_TICKS];
+    uint32_t times[CASCADE_SPEED_TICKS];
+    uint8_t next; //oldest entry, overwritten by the next tick
+    double integral;
+    double sumSq; //tracking error
+public:
+    double target;
+    double speed; //last measurement
+    uint32_t n; //ticks with a target
+    double peak; //largest |target - speed|
+
+    WheelLoop();
+    //Start measuring from this count and time, clearing the integral
+    void reset(uint32_t count, uint32_t now);
+    //One tick, dt seconds since the last one, returns duty in PWMAX units
+    double step(uint32_t count, uint32_t now, double dt, const Params &p);
+    //RMS tracking error
+    double rms() const { return n ? sqrt(sumSq/n) : 0; }
+};
+
+WheelLoop::WheelLoop(){
+    reset(0, 0);
+    target = 0;
+    n = 0;
+    peak = 0;
+    sumSq = 0;
+}
+
+void WheelLoop::reset(uint32_t count, uint32_t now){
+    for (uint8_t i=0; i<CASCADE_SPEED_TICKS; i++){
+        counts[i] = count;
+        times[i] = now;
+    }
+    next = 0;
+    integral = 0;
+    speed = 0;
+}
+
+double WheelLoop::step(uint32_t count, uint32_t now, double dt, const Params &p){
+    uint32_t span = now - times[next];
+    speed = span ? (count - counts[next])*1e6/span : 0;
+    counts[next] = count;
+    times[next] = now;
+    next = (next + 1) % CASCADE_SPEED_TICKS;
+
+    if (target <= 0){
+        integral = 0;
+        return 0;
+    }
+    double err = target - speed;
+    n++;
+    sumSq += err*err;
+    if (fabs(err) > peak) peak = fabs(err);
+
+    double scale = PWMAX/WHEEL_CPS_MAX;
+    double duty = scale*(target + p.v[P_WHEEL_KP]*err + p.v[P_WHEEL_KI]*integral);
+    //integrate only while the output can still move
+    if ((duty < PWMAX || err < 0) && (duty > 0 || err > 0)) integral += err*dt;
+    return constrain(duty, 0, PWMAX);
+}
+
+class Cascade{
+private:
+    WheelLoop left;
+    WheelLoop right;
+    MotorCommand outer; //sleep and direction pins from the line loop
+    bool active;
+    uint32_t due; //micros() of the next tick mark
+public:
+    uint32_t ticks;
+    uint32_t skipped; //marks that passed without a tick
+
+    Cascade();
+    //New wheel speed targets from the line loop's command, starts ticking
+    //if the loop was held
+    void target(const MotorCommand &cmd);
+    //Stop ticking and leave the motors to the caller (turnaround, stop)
+    void hold();
+    //Run the inner tick if its mark has come
+    void service(MotorDriver &motors, const Params &p);
+    //Print tracking error and scheduling counts
+    void report();
+};
+
+Cascade::Cascade(){
+    outer = motorStop();
+    active = false;
+    due = 0;
+    ticks = 0;
+    skipped = 0;
+}
+
+void Cascade::target(const MotorCommand &cmd){
+    outer = cmd;
+    left.target = cmd.PWML*WHEEL_CPS_MAX/PWM_FULLSCALE;
+    right.target = cmd.PWMR*WHEEL_CPS_MAX/PWM_FULLSCALE;
+    if (active) return;
+    EncoderCounts c = getEncoderCounts();
+    uint32_t now = micros();
+    left.reset(c.left, now);
+    right.reset(c.right, now);
+    due = now + CASCADE_PERIOD_US;
+    active = true;
+}
+
+void Cascade::hold(){
+    active = false;
+}
+
+void Cascade::service(MotorDriver &motors, const Params &p){
+    if (!active) return;
+    uint32_t now = micros();
+    if ((int32_t)(now - due) < 0) return;
+    uint32_t missed = (now - due)/CASCADE_PERIOD_US;
+    skipped += missed;
+    due += (missed + 1)*CASCADE_PERIOD_US;
+
+    EncoderCounts c = getEncoderCounts();
+    double dt = (missed + 1)*CASCADE_PERIOD_US*1e-6;
+    MotorCommand cmd = outer;
+    cmd.PWML = fullscale(left.step(c.left, now, dt, p));
+    cmd.PWMR = fullscale(right.step(c.right, now, dt, p));
+    motors.write(cmd);
+    ticks++;
+}
+
+void Cascade::report(){
+    Serial.print("wheel speed error cps rms ");
+    Serial.print(left.rms(), 1);
+    Serial.print(" ");
+    Serial.print(right.rms(), 1);
+    Serial.print(" peak ");
+    Serial.print(left.peak, 1);
+    Serial.print(" ");
+    Serial.print(right.peak, 1);
+    Serial.print(", ");
+    Serial.print(ticks);
+    Serial.print(" ticks, ");
+    Serial.print(skipped);
+    Serial.println(" skipped");
+}
@@ -0,0 +1,247 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef TIMING_H
+#define TIMING_H
+#include "../diag/timing.h"
+#endif
+
+#ifndef CYCLES_H
+#define CYCLES_H
+#include "../diag/cycles.h"
+#endif
+
+//Cooperative stackless tasks (TASKS in const.h)
+//
+//A task is a function that runs in steps and keeps its place between them
+//in Task::line, protothread style: TASK_BEGIN jumps back to the line it
+//left from, so a task reads top to bottom while waiting on the hardware
+//without blocking the others. There is no stack per task, so locals do not
+//survive a yield; state that must lives in globals.
+//
+//  TASK_YIELD(t)           step done, come back on a later pass
+//  TASK_WAIT_UNTIL(t, c)   poll c every pass, go on once it holds
+//
+//A task is released periodically (period_us), by signal() (TASK_EVENT) or
+//again as soon as it finishes (period 0). Each run() makes one pass over
+//the released tasks in priority order (0 first): a task that is waiting
+//lets the pass go on to the next one, a task that did work ends the pass,
+//so the most urgent task is looked at again before anything below it.
+//
+//Every job (release to finish) is checked against the task's deadline.
+//Per task the scheduler counts jobs, deadline misses and overruns (a
+//periodic release while the last job still runs) and times each step in
+//cycles; report() prints them with each task's share of the CPU, polls
+//while waiting included.
+
+const uint32_t TASK_EVENT = 0xFFFFFFFF; //period of a task released by signal()
+
+enum TaskStatus{
+    TASK_WAITING, //blocked on a condition, the pass goes on
+    TASK_YIELDED, //did work and gave up the CPU
+    TASK_DONE     //job finished, wait for the next release
+};
+
+struct Task;
+typedef TaskStatus (*TaskFn)(Task &t);
+
+//TASK_WAIT_UNTIL falls into its own resume point on purpose
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define TASK_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define TASK_FALLTHROUGH do{} while (0)
+#endif
+
+#define TASK_BEGIN(t) switch ((t).line){ case 0:
+#define TASK_YIELD(t) do{ (t).line = __LINE__; return TASK_YIELDED; case __LINE__:; } while (0)
+#define TASK_WAIT_UNTIL(t, c) do{ (t).line = __LINE__; TASK_FALLTHROUGH; case __LINE__: if (!(c)) return TASK_WAITING; } while (0)
+#define TASK_END(t) } (t).line = 0; return TASK_DONE
+
+struct Task{
+    const char *name;
+    TaskFn fn;
+    uint8_t priority; //0 most urgent
+    uint32_t period_us; //0 continuous, TASK_EVENT on signal()
+    uint32_t deadline_us; //release to finish, 0 for none
+    uint16_t line; //resume point
+    bool ready; //released and not finished
+    bool pending; //signalled again while ready
+    uint32_t release; //micros() the current job was released
+    uint32_t next; //micros() of the next periodic release
+
+    uint32_t jobs; //finished jobs
+    uint32_t misses; //jobs finished past their deadline
+    uint32_t overruns; //periodic releases dropped, the last job still ran
+    uint64_t busy; //cycles spent in steps, waiting ones too
+    Timing step; //cycles per step that did work
+    Timing response; //us from release to finish
+};
+
+template<int N>
+class Scheduler{
+private:
+    Task tasks[N];
+    uint8_t count;
+    uint8_t order[N]; //task ids by priority
+    uint32_t lastPass; //cycles() at the last run()
+    uint64_t elapsed; //cycles from the first run() to lastPass
+    bool running;
+    uint32_t passes;
+    uint32_t idle; //passes in which no task did work
+    void release(uint32_t now);
+    void finish(Task &t);
+public:
+    Scheduler();
+    //Register a task, returns its id or -1 when all N slots are taken
+    int add(const char *name, TaskFn fn, uint8_t priority, uint32_t period_us, uint32_t deadline_us);
+    //Release an event task, or mark it to run again if it already runs
+    void signal(int id);
+    //One pass, false if no task did work
+    bool run();
+    //Print per task jobs, misses, step cycles and CPU share
+    void report();
+};
+
+template<int N>
+Scheduler<N>::Scheduler(){
+    count = 0;
+    lastPass = 0;
+    elapsed = 0;
+    running = false;
+    passes = 0;
+    idle = 0;
+}
+
+template<int N>
+int Scheduler<N>::add(const char *name, TaskFn fn, uint8_t priority, uint32_t period_us, uint32_t deadline_us){
+    if (count >= N) return -1;
+    Task &t = tasks[count];
+    t.name = name;
+    t.fn = fn;
+    t.priority = priority;
+    t.period_us = period_us;
+    t.deadline_us = deadline_us;
+    t.line = 0;
+    t.ready = false;
+    t.pending = false;
+    t.release = 0;
+    t.next = micros();
+    t.jobs = 0;
+    t.misses = 0;
+    t.overruns = 0;
+    t.busy = 0;
+
+    //insertion keeps equal priorities in the order they were added
+    uint8_t i = count;
+    while (i > 0 && tasks[order[i - 1]].priority > priority){
+        order[i] = order[i - 1];
+        i--;
+    }
+    order[i] = count;
+    return count++;
+}
+
+template<int N>
+void Scheduler<N>::signal(int id){
+    if (id < 0 || id >= count) return;
+    Task &t = tasks[id];
+    if (t.ready){
+        t.pending = true;
+        return;
+    }
+    t.ready = true;
+    t.release = micros();
+}
+
+template<int N>
+void Scheduler<N>::release(uint32_t now){
+    for (uint8_t i=0; i<count; i++){
+        Task &t = tasks[i];
+        if (t.period_us == TASK_EVENT) continue;
+        if (t.period_us == 0){
+            if (!t.ready){
+                t.ready = true;
+                t.release = now;
+            }
+            continue;
+        }
+        if ((int32_t)(now - t.next) < 0) continue;
+        if (t.ready) t.overruns++;
+        else{
+            t.ready = true;
+            t.release = t.next;
+        }
+        //releases that passed are dropped, not run in a burst
+        t.next += ((now - t.next)/t.period_us + 1)*t.period_us;
+    }
+}
+
+template<int N>
+void Scheduler<N>::finish(Task &t){
+    uint32_t now = micros();
+    uint32_t took = now - t.release;
+    t.jobs++;
+    t.response.add(took);
+    if (t.deadline_us && took > t.deadline_us) t.misses++;
+    t.ready = t.pending;
+    t.pending = false;
+    t.release = now;
+}
+
+template<int N>
+bool Scheduler<N>::run(){
+    //elapsed grows by each pass's cycles, which are far short of the 32 bit
+    //counter's wrap (about 89 s at 48 MHz) even though the run is not
+    uint32_t now = cycles();
+    if (running) elapsed += now - lastPass;
+    lastPass = now;
+    running = true;
+    passes++;
+    release(micros());
+    for (uint8_t i=0; i<count; i++){
+        Task &t = tasks[order[i]];
+        if (!t.ready) continue;
+        uint32_t c0 = cycles();
+        TaskStatus s = t.fn(t);
+        uint32_t c = cycles() - c0;
+        t.busy += c;
+        if (s == TASK_WAITING) continue;
+        t.step.add(c);
+        if (s == TASK_DONE) finish(t);
+        return true;
+    }
+    idle++;
+    return false;
+}
+
+template<int N>
+void Scheduler<N>::report(){
+    uint64_t total = running ? elapsed + (uint32_t)(cycles() - lastPass) : 0;
+    for (uint8_t i=0; i<count; i++){
+        const Task &t = tasks[order[i]];
+        Serial.print("task ");
+        Serial.print(t.name);
+        Serial.print(" jobs ");
+        Serial.print(t.jobs);
+        Serial.print(" missed ");
+        Serial.print(t.misses);
+        Serial.print(" overran ");
+        Serial.print(t.overruns);
+        Serial.print(" response us ");
+        Serial.print(t.response.mean());
+        Serial.print(" (max ");
+        Serial.print(t.response.hi);
+        Serial.print(") step cycles ");
+        Serial.print(t.step.mean());
+        Serial.print(" (max ");
+        Serial.print(t.step.hi);
+        Serial.print(") cpu % ");
+        Serial.println(total ? 100.0*t.busy/total : 0, 1);
+    }
+    Serial.print("scheduler passes ");
+    Serial.print(passes);
+    Serial.print(", idle ");
+    Serial.println(idle);
+}
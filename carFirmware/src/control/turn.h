@@ -8,8 +8,14 @@
 #include "const.h"
 #endif
 
-bool turn(uint16_t sensorValues[]){
-    double MINDEV = 0.15;
+#ifndef PARAMS_H
+#define PARAMS_H
+#include "params.h"
+#endif
+
+//How far the darkest sensor stands out from the average, relative to the
+//average. Near 0 when every sensor sees the same (a cross line or no floor).
+double flatness(uint16_t sensorValues[]){
     double avg = 0;
     for (uint16_t i=0; i<8; i++){
         avg += abs(sensorValues[i])*0.125;
@@ -18,9 +24,81 @@ bool turn(uint16_t sensorValues[]){
     for (uint16_t i=0; i<8; i++){
        if (outlier < sensorValues[i]) outlier = sensorValues[i];
     }
-    if (outlier < 10) return true;
-    double delta = abs(avg - outlier)/avg;
-    if (delta < MINDEV) return true;
-    else return false;
+    if (outlier < 10) return 0;
+    return abs(avg - outlier)/avg;
+}
+
+//Cross line detector over the last frames
+//
+//Every frame gets a score, 1 at flatness P_CROSS_ON and below, 0 at
+//P_CROSS_OFF and above, linear in between. The scores of the last
+//P_CROSS_CONFIRM frames (at most CROSS_WINDOW) are kept in a ring with a
+//running sum, and their mean is confidence(). The scores are fixed point in
+//CROSS_ONE steps so the sum stays exact, back to 0 on a clean line however
+//long the run. The detector fires when the
+//confidence reaches CROSS_FIRE, then stays disarmed until it falls to
+//CROSS_REARM, the line seen again, so one noisy read cannot trigger a
+//turnaround and a cross line cannot trigger two.
+const uint8_t CROSS_WINDOW = 8;
+const float CROSS_FIRE = 0.75;
+const float CROSS_REARM = 0.25;
+const uint16_t CROSS_ONE = 256; //score 1
+
+class CrossDetector{
+private:
+    uint16_t scores[CROSS_WINDOW];
+    uint8_t next;
+    uint8_t count; //scores in the ring, up to CROSS_WINDOW
+    uint8_t window; //frames the sum covers
+    uint16_t sum; //of the last window scores
+    bool armed;
+public:
+    CrossDetector();
+    //Feed a frame, true when a cross line is confirmed
+    bool update(uint16_t sensorValues[], const Params &p);
+    //Mean score of the last P_CROSS_CONFIRM frames, 0 to 1
+    float confidence();
+};
+
+CrossDetector::CrossDetector(){
+    for (uint8_t i=0; i<CROSS_WINDOW; i++) scores[i] = 0;
+    next = 0;
+    count = 0;
+    window = 1;
+    sum = 0;
+    armed = true;
+}
+
+bool CrossDetector::update(uint16_t sensorValues[], const Params &p){
+    double on = p.v[P_CROSS_ON];
+    double off = p.v[P_CROSS_OFF];
+    uint8_t confirm = constrain(p.v[P_CROSS_CONFIRM], 1, CROSS_WINDOW);
+    double f = flatness(sensorValues);
+    double score = off > on ? constrain((off - f)/(off - on), 0, 1) : (f < on);
+
+    //a new window length from tuning, sum the ring again once
+    if (confirm != window){
+        window = confirm;
+        sum = 0;
+        for (uint8_t i=1; i<window && i<=count; i++) sum += scores[(next + CROSS_WINDOW - i) % CROSS_WINDOW];
+    }
+    else if (count >= window) sum -= scores[(next + CROSS_WINDOW - window) % CROSS_WINDOW];
+    scores[next] = score*CROSS_ONE + 0.5;
+    sum += scores[next];
+    next = (next + 1) % CROSS_WINDOW;
+    if (count < CROSS_WINDOW) count++;
+
+    float c = confidence();
+    if (!armed){
+        if (c <= CROSS_REARM) armed = true;
+        return false;
+    }
+    if (count < window || c < CROSS_FIRE) return false;
+    armed = false;
+    return true;
+}
 
-}
\ No newline at end of file
+float CrossDetector::confidence(){
+    uint8_t n = count < window ? count : window;
+    return n ? (float)sum/(n*CROSS_ONE) : 0;
+}
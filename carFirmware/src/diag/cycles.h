@@ -0,0 +1,35 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifdef __MSP432P401R__
+#include "msp.h"
+#endif
+
+//CPU cycle counter for timing short stretches of code
+//
+//On the MSP432 this is the Cortex-M4 DWT cycle counter, which runs at the
+//48 MHz core clock and wraps every 89 s, so differences of two cycles()
+//readings are exact for anything shorter. On a host it is micros() scaled
+//to the same clock.
+
+const uint32_t CPU_HZ = 48000000;
+
+#ifdef __MSP432P401R__
+void cyclesInit(){
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+inline uint32_t cycles(){
+    return DWT->CYCCNT;
+}
+#else
+void cyclesInit(){}
+
+inline uint32_t cycles(){
+    return micros()*(CPU_HZ/1000000);
+}
+#endif
@@ -0,0 +1,116 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "../const.h"
+#endif
+
+//Heap and RAM audit for the STATIC_ALLOC build
+//
+//newlib calls __malloc_lock/__malloc_unlock around every malloc, realloc and
+//free, so defining them here sees every heap operation, including the ones
+//String makes internally. After heapAuditArm() (end of setup()) each one is
+//counted, or with HEAP_TRAP defined the car stops and the red LED stays on.
+//
+//heapAuditArm() also paints the free RAM between the heap and the stack so
+//heapReport() can find how deep the stack has ever reached. Heap grown
+//since then has painted over the bottom of it, so the search starts at the
+//heap's end as it is now; with no room between heap and stack at arm time
+//(loop() not on the main stack above the heap) the depth is unknown.
+
+const uint32_t STACK_PAINT = 0xA5A5A5A5;
+const uint16_t STACK_MARGIN = 64; //bytes below the current stack left unpainted
+
+volatile bool heapArmed = false;
+volatile uint32_t heapOps = 0; //heap operations since heapAuditArm()
+
+#ifdef __MSP432P401R__
+#include <reent.h>
+#include <unistd.h>
+
+//Linker script symbols
+extern "C" char __data_start__;
+extern "C" char __bss_end__;
+extern "C" char __StackTop;
+
+uint32_t *paintLow = 0;
+uint32_t *paintHigh = 0;
+
+void heapTrap(){
+    noInterrupts();
+    digitalWrite(nSLPL, LOW);
+    digitalWrite(nSLPR, LOW);
+    digitalWrite(LED_RF, HIGH);
+    while (true);
+}
+
+extern "C" void __malloc_lock(struct _reent *r){
+    (void)r;
+    if (!heapArmed) return;
+    heapOps++;
+#ifdef HEAP_TRAP
+    heapTrap();
+#endif
+}
+
+extern "C" void __malloc_unlock(struct _reent *r){
+    (void)r;
+}
+
+void heapAuditArm(){
+    uint32_t here;
+    paintLow = (uint32_t *)(((uintptr_t)sbrk(0) + 3) & ~3);
+    paintHigh = (uint32_t *)(((uintptr_t)&here - STACK_MARGIN) & ~3);
+    for (uint32_t *p = paintLow; p < paintHigh; p++) *p = STACK_PAINT;
+    heapOps = 0;
+    heapArmed = true;
+}
+
+//Bytes of .data and .bss
+uint32_t staticRam(){
+    return &__bss_end__ - &__data_start__;
+}
+
+//Deepest the stack has reached since heapAuditArm(), 0 if unknown
+uint32_t peakStack(){
+    uint32_t *heapEnd = (uint32_t *)(((uintptr_t)sbrk(0) + 3) & ~3);
+    uint32_t *p = heapEnd > paintLow ? heapEnd : paintLow;
+    if (paintHigh <= paintLow || p >= paintHigh) return 0;
+    while (p < paintHigh && *p == STACK_PAINT) p++;
+    return &__StackTop - (char *)p;
+}
+
+//Bytes handed to the heap so far
+uint32_t heapSize(){
+    return (char *)sbrk(0) - &__bss_end__;
+}
+#else
+void heapAuditArm(){
+    heapOps = 0;
+    heapArmed = true;
+}
+
+uint32_t staticRam(){ return 0; }
+uint32_t peakStack(){ return 0; }
+uint32_t heapSize(){ return 0; }
+#endif
+
+//Print static RAM, heap, peak stack and heap operations since setup()
+void heapReport(){
+    Serial.print("static ");
+    Serial.print(staticRam());
+    Serial.print(" B, heap ");
+    Serial.print(heapSize());
+    Serial.print(" B, peak stack ");
+    uint32_t stack = peakStack();
+    if (stack){
+        Serial.print(stack);
+        Serial.print(" B");
+    }
+    else Serial.print("unknown");
+    Serial.print(", heap ops after setup ");
+    Serial.println(heapOps);
+}
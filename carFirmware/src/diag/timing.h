@@ -0,0 +1,21 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+//min/mean/max of a stream of samples (microseconds, cycles)
+struct Timing{
+    uint32_t n;
+    uint64_t sum;
+    uint32_t lo;
+    uint32_t hi;
+
+    Timing(){ n = 0; sum = 0; lo = 0xFFFFFFFF; hi = 0; }
+    void add(uint32_t us){
+        n++;
+        sum += us;
+        if (us < lo) lo = us;
+        if (us > hi) hi = us;
+    }
+    uint32_t mean() const { return n ? sum/n : 0; }
+};
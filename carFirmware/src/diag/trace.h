@@ -0,0 +1,200 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "../const.h"
+#endif
+
+#ifndef CYCLES_H
+#define CYCLES_H
+#include "cycles.h"
+#endif
+
+//Timeline trace of the loop (TRACE in const.h)
+//
+//TRACE_BEGIN/TRACE_END mark a stretch of code, TRACE_MARK a single point
+//(an encoder edge), each an 8 byte event in a RAM ring: the cycles()
+//timestamp, what happened, begin/end/instant and a 16 bit argument.
+//Recording one is a few stores with interrupts held off, so the encoder
+//ISRs trace as well. With TRACE_WRAP the ring keeps the newest
+//TRACE_EVENTS events, otherwise the first ones. Without TRACE the macros
+//are empty.
+//
+//Every event belongs to a track, a row of the timeline: the loop, the IR
+//read (which with PIPELINE overlaps the loop), the encoders and serial
+//output. traceDump() sends the ring after the run, oldest event first:
+//  'T','H' version(u8) tracks(u8) track names (NUL ended)
+//  names(u8) per name: track(u8) name (NUL ended)
+//  cpu_hz(u32) lost(u32) events(u16) per event: t(u32) id(u8) kind(u8) arg(u16)
+//  xor(u8) of everything from 'T'
+//Numbers are little endian and lost counts the events the ring overwrote
+//or turned away. hostTools/tracejson.cpp turns the dump into Chrome trace
+//JSON for chrome://tracing or ui.perfetto.dev.
+
+const uint8_t TRACE_SYNC0 = 'T';
+const uint8_t TRACE_SYNC1 = 'H';
+const uint8_t TRACE_VERSION = 1;
+
+const uint8_t TRACE_BEGIN_KIND = 'B';
+const uint8_t TRACE_END_KIND = 'E';
+const uint8_t TRACE_MARK_KIND = 'i';
+
+//Rows of the timeline
+enum TraceTrack{
+    TRACK_LOOP,
+    TRACK_IR,
+    TRACK_ENCODERS,
+    TRACK_SERIAL,
+    TRACK_COUNT
+};
+const char *const TRACE_TRACKS[TRACK_COUNT] = {"loop", "IR read", "encoders", "serial"};
+
+enum TraceId{
+    TR_LOOP,        //one loop()
+    TR_READ_IR,     //acquire() to complete() of a frame
+    TR_READ_WAIT,   //complete() waiting for the discharge
+    TR_CROSS,       //turn detection on a frame
+    TR_CROSS_CONF,  //cross line confidence after a frame, arg x1000, when not 0
+    TR_DRIVE,       //Drive::update
+    TR_DONUT,       //turnaround, arg the donut count
+    TR_ENC_LEFT,    //encoder edges
+    TR_ENC_RIGHT,
+    TR_SERIAL,      //a telemetry or recording frame written, arg bytes
+    TR_COUNT
+};
+
+struct TraceName{
+    uint8_t track;
+    const char *name;
+};
+const TraceName TRACE_NAMES[TR_COUNT] = {
+    {TRACK_LOOP, "loop"},
+    {TRACK_IR, "read IR"},
+    {TRACK_LOOP, "wait IR"},
+    {TRACK_LOOP, "turn detect"},
+    {TRACK_LOOP, "cross confidence"},
+    {TRACK_LOOP, "Drive::update"},
+    {TRACK_LOOP, "donut"},
+    {TRACK_ENCODERS, "encoder L"},
+    {TRACK_ENCODERS, "encoder R"},
+    {TRACK_SERIAL, "serial write"},
+};
+
+struct TraceEvent{
+    uint32_t t; //cycles()
+    uint8_t id;
+    uint8_t kind;
+    uint16_t arg;
+};
+
+template<int N>
+class TraceBuffer{
+private:
+    TraceEvent ring[N];
+    volatile uint16_t head; //next slot
+    volatile uint16_t count;
+    volatile uint32_t lost;
+    uint8_t sum; //running xor of the dump
+    void put(const void *p, uint16_t n);
+public:
+    TraceBuffer();
+    //Add an event, safe from interrupts
+    void record(uint8_t id, uint8_t kind, uint16_t arg);
+    //Send the events, see the top of the file
+    void dump();
+};
+
+template<int N>
+TraceBuffer<N>::TraceBuffer(){
+    head = 0;
+    count = 0;
+    lost = 0;
+    sum = 0;
+}
+
+template<int N>
+void TraceBuffer<N>::record(uint8_t id, uint8_t kind, uint16_t arg){
+    uint32_t t = cycles();
+#ifdef __MSP432P401R__
+    //an ISR may trace too, and interrupts stay off if they already were
+    uint32_t mask = __get_PRIMASK();
+    __disable_irq();
+#endif
+    if (count < N || TRACE_WRAP){
+        TraceEvent &e = ring[head];
+        e.t = t;
+        e.id = id;
+        e.kind = kind;
+        e.arg = arg;
+        head = head + 1 == N ? 0 : head + 1;
+        if (count < N) count++;
+        else lost++;
+    }
+    else lost++;
+#ifdef __MSP432P401R__
+    __set_PRIMASK(mask);
+#endif
+}
+
+template<int N>
+void TraceBuffer<N>::put(const void *p, uint16_t n){
+    const uint8_t *b = (const uint8_t *)p;
+    for (uint16_t i=0; i<n; i++) sum ^= b[i];
+    Serial.write(b, n);
+}
+
+template<int N>
+void TraceBuffer<N>::dump(){
+    noInterrupts();
+    uint16_t n = count;
+    uint16_t first = n < N ? 0 : head;
+    uint32_t gone = lost;
+    interrupts();
+
+    sum = 0;
+    uint8_t head4[4] = {TRACE_SYNC0, TRACE_SYNC1, TRACE_VERSION, TRACK_COUNT};
+    put(head4, 4);
+    for (uint8_t k=0; k<TRACK_COUNT; k++) put(TRACE_TRACKS[k], strlen(TRACE_TRACKS[k]) + 1);
+    uint8_t names = TR_COUNT;
+    put(&names, 1);
+    for (uint8_t k=0; k<TR_COUNT; k++){
+        put(&TRACE_NAMES[k].track, 1);
+        put(TRACE_NAMES[k].name, strlen(TRACE_NAMES[k].name) + 1);
+    }
+    uint8_t b[8];
+    uint32_t hz = CPU_HZ;
+    for (uint8_t i=0; i<4; i++){
+        b[i] = hz >> (8*i);
+        b[4 + i] = gone >> (8*i);
+    }
+    put(b, 8);
+    b[0] = n & 0xFF;
+    b[1] = n >> 8;
+    put(b, 2);
+    for (uint16_t k=0; k<n; k++){
+        const TraceEvent &e = ring[(first + k) % N];
+        for (uint8_t i=0; i<4; i++) b[i] = e.t >> (8*i);
+        b[4] = e.id;
+        b[5] = e.kind;
+        b[6] = e.arg & 0xFF;
+        b[7] = e.arg >> 8;
+        put(b, 8);
+    }
+    uint8_t x = sum;
+    Serial.write(&x, 1);
+}
+
+#ifdef TRACE
+TraceBuffer<TRACE_EVENTS> traceBuffer; //events of the run
+
+#define TRACE_BEGIN(id, arg) traceBuffer.record((id), TRACE_BEGIN_KIND, (arg))
+#define TRACE_END(id) traceBuffer.record((id), TRACE_END_KIND, 0)
+#define TRACE_MARK(id, arg) traceBuffer.record((id), TRACE_MARK_KIND, (arg))
+#else
+#define TRACE_BEGIN(id, arg) do{} while (0)
+#define TRACE_END(id) do{} while (0)
+#define TRACE_MARK(id, arg) do{} while (0)
+#endif
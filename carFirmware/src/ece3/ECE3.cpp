@@ -9,6 +9,11 @@ void ECE3_Init(){
 /* Pinmodes */
  
 
+#ifdef ENCODER_TIMER
+/* Encoder pulses clock TIMER_A2/TIMER_A3, no interrupts */
+
+  encoderTimerInit();
+#else
   pinMode(P5_2, INPUT);
   pinMode(P5_0, INPUT);
 
@@ -17,6 +22,7 @@ void ECE3_Init(){
 
   attachInterrupt(P5_2, ISR_LEFT, FALLING);
   attachInterrupt(P5_0, ISR_RIGHT, FALLING);
+#endif
 
   IR.setSensorPins((const uint8_t[]) {65, 48, 64, 47, 52, 68, 53, 69}, 8);
   IR.setEmitterPins(45, 61);
@@ -27,3 +33,28 @@ void ECE3_Init(){
 void ECE3_read_IR(uint16_t * sensorValues){
 	return IR.read(sensorValues);
 }
+
+//Split read for overlapping the RC discharge with other work: start,
+//poll between other work, finish before using the values
+void ECE3_start_IR(uint16_t * sensorValues){
+	IR.readStart(sensorValues);
+}
+
+bool ECE3_poll_IR(){
+	return IR.readPoll();
+}
+
+void ECE3_finish_IR(){
+	IR.readFinish();
+}
+
+//Emitter dimming level (0 brightest to 31) and RC read timeout, only
+//between reads: turning dimmable emitters back on takes 1.5 ms
+void ECE3_set_emitters(uint8_t level){
+	IR.setDimmingLevel(level);
+	IR.emittersOn();
+}
+
+void ECE3_set_timeout(uint16_t us){
+	IR.setTimeout(us);
+}
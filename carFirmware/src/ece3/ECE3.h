@@ -10,5 +10,10 @@
 
 void ECE3_Init();
 void ECE3_read_IR(uint16_t *);
+void ECE3_start_IR(uint16_t *);
+bool ECE3_poll_IR();
+void ECE3_finish_IR();
+void ECE3_set_emitters(uint8_t);
+void ECE3_set_timeout(uint16_t);
 
 #endif
@@ -2,6 +2,94 @@
 
 #include "Encoder.h"
 
+#ifdef ENCODER_TIMER
+#include "msp.h"
+
+//The timers count rising edges in TAxR with no CPU involvement. TAxR is 16
+//bits, so it is extended to 32 in software on every read; any encoder
+//call at least once per 65535 edges of a wheel (about 40 s flat out)
+//keeps the counts exact.
+static uint16_t left_last = 0;
+static uint16_t right_last = 0;
+static uint32_t left_count = 0;
+static uint32_t right_count = 0;
+
+//TAxR is clocked from the encoder, asynchronous to MCLK, so read until
+//two reads agree
+static uint16_t readTimer(Timer_A_Type *timer){
+	uint16_t a = timer->R;
+	uint16_t b = timer->R;
+	while (a != b){
+		a = b;
+		b = timer->R;
+	}
+	return a;
+}
+
+static void update(){
+	uint16_t l = readTimer(TIMER_A2);
+	uint16_t r = readTimer(TIMER_A3);
+	left_count += (uint16_t)(l - left_last);
+	right_count += (uint16_t)(r - right_last);
+	left_last = l;
+	right_last = r;
+}
+
+void encoderTimerInit(){
+	//TA2CLK and TA3CLK are the primary input functions of P4.2 and P8.3
+	P4->DIR &= ~BIT2;
+	P4->SEL0 |= BIT2;
+	P4->SEL1 &= ~BIT2;
+	P8->DIR &= ~BIT3;
+	P8->SEL0 |= BIT3;
+	P8->SEL1 &= ~BIT3;
+
+	TIMER_A2->CTL = TIMER_A_CTL_SSEL__TACLK | TIMER_A_CTL_CLR;
+	TIMER_A3->CTL = TIMER_A_CTL_SSEL__TACLK | TIMER_A_CTL_CLR;
+	TIMER_A2->CTL |= TIMER_A_CTL_MC__CONTINUOUS;
+	TIMER_A3->CTL |= TIMER_A_CTL_MC__CONTINUOUS;
+
+	left_last = readTimer(TIMER_A2);
+	right_last = readTimer(TIMER_A3);
+	left_count = 0;
+	right_count = 0;
+}
+
+uint32_t getEncoderCount_left(){
+	update();
+	return left_count;
+}
+
+uint32_t getEncoderCount_right(){
+	update();
+	return right_count;
+}
+
+EncoderCounts getEncoderCounts(){
+	update();
+	EncoderCounts c = {left_count, right_count};
+	return c;
+}
+
+void resetEncoderCount_left(){
+	update();
+	left_count = 0;
+}
+
+void resetEncoderCount_right(){
+	update();
+	right_count = 0;
+}
+
+//Not attached with ENCODER_TIMER
+void ISR_LEFT(){}
+void ISR_RIGHT(){}
+
+//No edge interrupts to call it from
+void setEncoderHook(void (*hook)(uint8_t side)){
+	(void)hook;
+}
+#else
 volatile uint32_t left_count = 0;
 volatile uint32_t right_count = 0;
 
@@ -13,6 +101,14 @@ uint32_t getEncoderCount_right(){
 	return right_count;
 }
 
+//Both counts with the edge interrupts held off between the two reads
+EncoderCounts getEncoderCounts(){
+	noInterrupts();
+	EncoderCounts c = {left_count, right_count};
+	interrupts();
+	return c;
+}
+
 void resetEncoderCount_left(){
 	left_count = 0;
 }
@@ -21,9 +117,18 @@ void resetEncoderCount_right(){
 	right_count = 0;
 }
 
+static void (*edgeHook)(uint8_t side) = 0;
+
+void setEncoderHook(void (*hook)(uint8_t side)){
+	edgeHook = hook;
+}
+
 void ISR_LEFT() {
   left_count++;
+  if (edgeHook) edgeHook(0);
 }
 void ISR_RIGHT() {
   right_count++;
-}
\ No newline at end of file
+  if (edgeHook) edgeHook(1);
+}
+#endif
@@ -3,12 +3,34 @@
 #ifndef Encoder_h
 #define Encoder_h
 
+//Uncomment to count encoder pulses in hardware: the encoder outputs clock
+//TIMER_A2 (TA2CLK, P4.2, left) and TIMER_A3 (TA3CLK, P8.3, right) instead
+//of taking an interrupt per edge on P5.2/P5.0. P5.2 and P5.0 cannot clock
+//a timer, so the two encoder lines have to be jumpered to P4.2 and P8.3.
+//#define ENCODER_TIMER
+
+//Both wheels' counts taken at the same instant
+struct EncoderCounts{
+	uint32_t left;
+	uint32_t right;
+};
+
 uint32_t getEncoderCount_left();
 uint32_t getEncoderCount_right();
+EncoderCounts getEncoderCounts();
 
 void resetEncoderCount_left();
 void resetEncoderCount_right();
 
 void ISR_LEFT();
 void ISR_RIGHT();
+
+//Called from the edge interrupts after counting, side 0 left 1 right, e.g.
+//to trace the edges; 0 for none. Never called with ENCODER_TIMER.
+void setEncoderHook(void (*hook)(uint8_t side));
+
+#ifdef ENCODER_TIMER
+//Put the encoder inputs on the timer clock pins and start counting
+void encoderTimerInit();
+#endif
 #endif
@@ -6,16 +6,7 @@ void QTRSensors::setSensorPins(const uint8_t * pins, uint8_t sensorCount)
 {
   if (sensorCount > QTRMaxSensors) { sensorCount = QTRMaxSensors; }
 
-  // (Re)allocate and initialize the array if necessary.
-  uint8_t * oldSensorPins = _sensorPins;
-  _sensorPins = (uint8_t *)realloc(_sensorPins, sizeof(uint8_t) * sensorCount);
-  if (_sensorPins == nullptr)
-  {
-    // Memory allocation failed; don't continue.
-    free(oldSensorPins); // deallocate any memory used by old array
-    return;
-  }
-
+  // Pins are kept in a fixed array so the firmware never touches the heap.
   for (uint8_t i = 0; i < sensorCount; i++)
   {
     _sensorPins[i] = pins[i];
@@ -321,13 +312,48 @@ void QTRSensors::read(uint16_t * sensorValues, QTRReadMode mode)
 }
 
 
+void QTRSensors::readStart(uint16_t * sensorValues)
+{
+  // emittersOn() turns dimmable emitters that are already on off and back on
+  // (1.5 ms of delays), so only call it when they are off
+  bool lit = (_oddEmitterPin == QTRNoEmitterPin || digitalRead(_oddEmitterPin) == HIGH) &&
+             (_emitterPinCount < 2 || _evenEmitterPin == QTRNoEmitterPin ||
+              digitalRead(_evenEmitterPin) == HIGH);
+  if (!lit) { emittersOn(); }
+  startPrivate(sensorValues, 0, 1);
+}
+
+bool QTRSensors::readPoll()
+{
+  return pollPrivate();
+}
+
+void QTRSensors::readFinish()
+{
+  while (!pollPrivate()) {}
+}
+
 // Reads the first of every [step] sensors, starting with [start] (0-indexed, so
 // start = 0 means start with the first sensor).
 // For example, step = 2, start = 1 means read the *even-numbered* sensors.
 // start defaults to 0, step defaults to 1
 void QTRSensors::readPrivate(uint16_t * sensorValues, uint8_t start, uint8_t step)
 {
-  if (_sensorPins == nullptr) { return; }
+  if (_sensorCount == 0) { return; }
+
+  startPrivate(sensorValues, start, step);
+  while (!pollPrivate()) {}
+}
+
+// Charges the selected lines and switches them to inputs, the reading is then
+// completed by calling pollPrivate() until it returns true
+void QTRSensors::startPrivate(uint16_t * sensorValues, uint8_t start, uint8_t step)
+{
+  _readValues = sensorValues;
+  _readStart = start;
+  _readStep = step;
+  _readPending = 0;
+  if (_sensorCount == 0) { return; }
 
       for (uint8_t i = start; i < _sensorCount; i += step)
       {
@@ -336,57 +362,59 @@ void QTRSensors::readPrivate(uint16_t * sensorValues, uint8_t start, uint8_t ste
         pinMode(_sensorPins[i], OUTPUT);
         // drive sensor line high
         digitalWrite(_sensorPins[i], HIGH);
+        _readPending++;
       }
 
       delayMicroseconds(10); // charge lines for 10 us
 
+      // disable interrupts so we can switch all the pins as close to the same
+      // time as possible
+      noInterrupts();
+
+      // record start time before the first sensor is switched to input
+      // (similarly, time is checked before the first sensor is read in
+      // pollPrivate())
+      _readStartTime = micros();
+
+      for (uint8_t i = start; i < _sensorCount; i += step)
       {
-        // disable interrupts so we can switch all the pins as close to the same
-        // time as possible
-        noInterrupts();
-
-        // record start time before the first sensor is switched to input
-        // (similarly, time is checked before the first sensor is read in the
-        // loop below)
-        uint32_t startTime = micros();
-        uint16_t time = 0;
-
-        for (uint8_t i = start; i < _sensorCount; i += step)
-        {
-          // make sensor line an input (should also ensure pull-up is disabled)
-          pinMode(_sensorPins[i], INPUT);
-        }
-
-        interrupts(); // re-enable
-
-        while (time < _maxValue)
-        {
-          // disable interrupts so we can read all the pins as close to the same
-          // time as possible
-          noInterrupts();
-
-          time = micros() - startTime;
-          for (uint8_t i = start; i < _sensorCount; i += step)
-          {
-            if ((digitalRead(_sensorPins[i]) == LOW) && (time < sensorValues[i]))
-            {
-              // record the first time the line reads low
-              sensorValues[i] = time;
-            }
-          }
-
-          interrupts(); // re-enable
-        }
+        // make sensor line an input (should also ensure pull-up is disabled)
+        pinMode(_sensorPins[i], INPUT);
       }
- 
+
+      interrupts(); // re-enable
+}
+
+// One pass over the lines of the reading in progress, returns true once it is
+// complete
+bool QTRSensors::pollPrivate()
+{
+  if (_readPending == 0) { return true; }
+
+  // disable interrupts so we can read all the pins as close to the same
+  // time as possible
+  noInterrupts();
+
+  uint16_t time = micros() - _readStartTime;
+  for (uint8_t i = _readStart; i < _sensorCount; i += _readStep)
+  {
+    if ((digitalRead(_sensorPins[i]) == LOW) && (time < _readValues[i]))
+    {
+      // record the first time the line reads low
+      _readValues[i] = time;
+      _readPending--;
+    }
+  }
+
+  interrupts(); // re-enable
+
+  if (time >= _maxValue) { _readPending = 0; }
+  return _readPending == 0;
 }
 
 
-// the destructor frees up allocated memory
+// the destructor releases the emitter pins
 QTRSensors::~QTRSensors()
 {
   releaseEmitterPins();
-
-  if (_sensorPins)            { free(_sensorPins); }
-
 }
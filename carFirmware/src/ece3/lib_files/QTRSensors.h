@@ -359,19 +359,53 @@ class QTRSensors
     /// See \ref md_usage for more information and example code.
     void read(uint16_t * sensorValues, QTRReadMode mode = QTRReadMode::On);
 
+    /// \brief Starts a reading with the emitters on and returns as soon as
+    /// the sensor lines are discharging.
+    ///
+    /// \param[out] sensorValues Array that receives the readings. It must
+    /// stay valid until readFinish() returns.
+    ///
+    /// The caller is free to do other work while the lines discharge, calling
+    /// readPoll() now and then so each line is timestamped close to the moment
+    /// it goes low, and readFinish() to complete the reading. A line that goes
+    /// low between two polls is timestamped at the later poll.
+    ///
+    /// The emitters are left on after readFinish() so back to back readings
+    /// do not pay the emitter turn on and off delays; call emittersOff() when
+    /// done.
+    void readStart(uint16_t * sensorValues);
+
+    /// \brief Samples the lines of a reading started with readStart().
+    ///
+    /// \return True once the reading is complete (every line went low or the
+    /// timeout passed).
+    bool readPoll();
+
+    /// \brief Waits for the reading started with readStart() to complete.
+    void readFinish();
+
 
   private:
 
     uint16_t emittersOnWithPin(uint8_t pin);
 
     void readPrivate(uint16_t * sensorValues, uint8_t start = 0, uint8_t step = 1);
+    void startPrivate(uint16_t * sensorValues, uint8_t start, uint8_t step);
+    bool pollPrivate();
 
-    uint8_t * _sensorPins = nullptr;
+    uint8_t _sensorPins[QTRMaxSensors] = {};
     uint8_t _sensorCount = 0;
 
     uint16_t _timeout = QTRRCDefaultTimeout; // only used for RC sensors
     uint16_t _maxValue = QTRRCDefaultTimeout; // the maximum value returned by readPrivate()
 
+    // state of the reading in progress (see startPrivate())
+    uint16_t * _readValues = nullptr;
+    uint32_t _readStartTime = 0;
+    uint8_t _readStart = 0;
+    uint8_t _readStep = 1;
+    uint8_t _readPending = 0; // lines that have not gone low yet
+
     uint8_t _oddEmitterPin = QTRNoEmitterPin; // also used for single emitter pin
     uint8_t _evenEmitterPin = QTRNoEmitterPin;
     uint8_t _emitterPinCount = 0;
@@ -3,126 +3,443 @@
 #define CONST_H
 #include "const.h"
 #endif
+#ifndef STATIC_ALLOC
+//String based, the heap free build has TelemetryWriter instead
 #include "serialtools/atos.h"
 #include "serialtools/json.h"
 #include "serialtools/buffer.h"
+#endif
+#include "serialtools/record.h"
+#include "serialtools/command.h"
+#include "serialtools/telemetry.h"
+#ifdef UART_TX
+#ifndef UARTTX_H
+#define UARTTX_H
+#include "serialtools/uarttx.h"
+#endif
+#endif
+#ifndef MOTOR_H
+#define MOTOR_H
+#include "control/motor.h"
+#endif
 #include "control/drive.h"
+#include "control/sensors.h"
 #include "control/pos.h"
 #include "control/turn.h"
+#include "control/laps.h"
+#ifdef EMITTER_DIMMING
+#include "control/emitters.h"
+#endif
+#ifdef CASCADE
+#include "control/speed.h"
+#endif
+#ifdef SPEED_PROFILE
+#include "control/profile.h"
+#endif
 #include "ece3/ECE3.h" // Used for encoder functionality
+#ifdef STATIC_ALLOC
+#include "diag/heap.h"
+#endif
+#ifndef CYCLES_H
+#define CYCLES_H
+#include "diag/cycles.h"
+#endif
+#ifndef TRACE_H
+#define TRACE_H
+#include "diag/trace.h"
+#endif
+#ifdef TASKS
+#include "control/tasks.h"
+#endif
+
+#if defined(RECORD) && defined(TELEMETRY)
+#error "RECORD and TELEMETRY both use the serial port"
+#endif
+#if defined(RECORD) && defined(TASKS)
+#error "RECORD needs one frame per loop(), not TASKS"
+#endif
 
 Drive drive; //drive object 
+MotorDriver motors; //motor output stage
+CommandChannel commands; //live parameter tuning
+SensorPipeline sensors; //double buffered IR frames
+CrossDetector crossing; //turnaround trigger
+LapTimer laps; //lap and segment splits
+#ifdef EMITTER_DIMMING
+EmitterControl emitters; //dimming and read timeout
+#endif
+#ifdef CASCADE
+Cascade cascade; //wheel speed loops under the line loop
+
+//Inner loop tick, run by the sensor pipeline between compute stages and
+//while a frame discharges
+void innerLoop(){
+  cascade.service(motors, params);
+}
+#endif
+#ifdef RECORD
+Recorder recorder; //binary run recording
+#endif
+#ifdef TELEMETRY
+TelemetryWriter<TELEMETRY_CAPACITY> telemetry(TELEMETRY_FIELDS, TELEMETRY_FIELD_COUNT); //json frames
+Timing telemetryCycles; //cycles to write one frame
+int sinceTelemetry = 0;
+#endif
+#ifdef TASKS
+const int TASK_COUNT = 6;
+Scheduler<TASK_COUNT> scheduler; //loop() as cooperative tasks
+#endif
+
+int donuts = 0;
+bool reported = false;
+double lastPos = C; //line position of the last frame driven, for telemetry
+
+#ifdef TRACE
+//Encoder edge interrupt
+void traceEdge(uint8_t side){
+  TRACE_MARK(side ? TR_ENC_RIGHT : TR_ENC_LEFT, 0);
+}
+#endif
+
+//take tuning commands and make updates live between ticks
+void takeCommands(){
+  commands.poll();
+  commands.apply(params);
+}
+
+//Past the last cross line, stop and print the end of run reports once
+void stopped(){
+#ifdef CASCADE
+  cascade.hold();
+#endif
+  motors.write(motorStop());
+  if (!reported){
+#ifdef UART_TX
+    //queued frames first, Serial and the DMA must not share the port
+    uartTx.flush();
+#endif
+    sensors.report();
+    laps.report();
+#ifdef EMITTER_DIMMING
+    emitters.report();
+#endif
+#ifdef CASCADE
+    cascade.report();
+#endif
+#ifdef STATIC_ALLOC
+    heapReport();
+#endif
+#ifdef TELEMETRY
+    Serial.print("telemetry cycles ");
+    Serial.print(telemetryCycles.mean());
+    Serial.print(" (");
+    Serial.print(telemetryCycles.lo);
+    Serial.print("-");
+    Serial.print(telemetryCycles.hi);
+    Serial.print("), ");
+    Serial.print(TELEMETRY_CAPACITY);
+    Serial.println(" B max frame");
+#endif
+#ifdef TASKS
+    scheduler.report();
+#endif
+#ifdef UART_TX
+    uartTx.report();
+#endif
+#ifdef TRACE
+    traceBuffer.dump();
+#endif
+  }
+  reported = true;
+}
+
+//Follow the line on one frame, returns the line position
+double driveFrame(uint16_t *sensorValues){
+  uint16_t v = params.v[P_VMAX];
+  bool curve = false;
+  EncoderCounts enc = getEncoderCounts();
+  int loc = (enc.left + enc.right)/360;
+
+  //curve windows for the way there (0) and back (1)
+  curve = inCurve(params, donuts < 1 ? 0 : 1, loc);
+#ifdef SPEED_PROFILE
+  v = PROFILE_pwm(donuts < 1 ? 0 : 1, enc.left + enc.right);
+#endif
+
+  sensors.service();
+  double pos = posFind(sensorValues);
+  laps.update(donuts, enc.left + enc.right, C - pos, micros());
+  sensors.service();
+  TRACE_BEGIN(TR_DRIVE, 0);
+  drive.update(v, pos, curve);
+  TRACE_END(TR_DRIVE);
+  sensors.service();
+#ifdef CASCADE
+  cascade.target(drive.command());
+#else
+  motors.write(drive.command());
+#endif
+  sensors.actuated();
+  return pos;
+}
+
+//Turn detection on a frame, true on a cross line
+bool crossSeen(uint16_t *sensorValues){
+  TRACE_BEGIN(TR_CROSS, 0);
+  bool seen = crossing.update(sensorValues, params);
+  if (crossing.confidence() > 0) TRACE_MARK(TR_CROSS_CONF, crossing.confidence()*1000);
+  TRACE_END(TR_CROSS);
+  return seen;
+}
+
+//Cross line hit, count it and start spinning in place
+void turnaroundStart(){
+  donuts++;
+  TRACE_BEGIN(TR_DONUT, donuts);
+  laps.update(donuts, 0, 0, micros());
+
+  resetEncoderCount_left();
+  resetEncoderCount_right();
+
+#ifdef CASCADE
+  cascade.hold();
+#endif
+  motors.write(motorSpin());
+}
+
+//Spun far enough to face back down the track
+bool turnaroundDone(){
+  EncoderCounts spin = getEncoderCounts();
+  double revs = (spin.left + spin.right)/360.0;
+  return revs >= 1.5;
+}
+
+//Drive off forward on the way back
+void turnaroundEnd(){
+#ifdef RECORD
+  EncoderCounts spun = getEncoderCounts();
+  recorder.spin(spun.left, spun.right);
+#endif
+
+  motors.write(motorForward());
+
+  resetEncoderCount_left();
+  resetEncoderCount_right();
+
+  //the frame in flight was taken before the turnaround
+  sensors.restart();
+  TRACE_END(TR_DONUT);
+}
+
+#ifdef TELEMETRY
+//One json frame of the sensors, position, motor outputs and cross line
+//confidence
+void sendTelemetry(const uint16_t *sensorValues, double pos){
+  const MotorCommand &out = motors.current();
+  uint32_t start = cycles();
+  telemetry.begin();
+  telemetry.array(sensorValues);
+  telemetry.value(pos*1000);
+  telemetry.value(out.PWML);
+  telemetry.value(out.PWMR);
+  telemetry.value(crossing.confidence()*1000);
+  const char *frame = telemetry.end();
+  telemetryCycles.add(cycles() - start);
+  TRACE_BEGIN(TR_SERIAL, telemetry.length());
+#ifdef UART_TX
+  uartTx.send((const uint8_t *)frame, telemetry.length());
+#else
+  Serial.write((const uint8_t *)frame, telemetry.length());
+#endif
+  TRACE_END(TR_SERIAL);
+}
+#endif
+
+#ifdef TASKS
+//The loop as tasks, most urgent first: the turnaround spin, the wheel
+//loops, control on each new frame, sensing, commands and telemetry.
+//Sensing starts the next frame as soon as one completes, so it discharges
+//while control computes (PIPELINE is implied), and pauses while turning.
+int controlId = -1;
+int turnId = -1;
+bool turning = false;
+
+TaskStatus senseTask(Task &t){
+  TASK_BEGIN(t);
+  TASK_WAIT_UNTIL(t, !turning);
+  sensors.acquire();
+  TASK_WAIT_UNTIL(t, !turning && sensors.ready());
+  sensors.complete();
+#ifdef EMITTER_DIMMING
+  emitters.update(sensors.frame());
+#endif
+  sensors.acquire();
+  scheduler.signal(controlId);
+  TASK_END(t);
+}
+
+TaskStatus controlTask(Task &t){
+  TASK_BEGIN(t);
+  if (donuts > 1) stopped();
+  else if (!crossSeen(sensors.frame())) lastPos = driveFrame(sensors.frame());
+  else{
+    turning = true;
+    scheduler.signal(turnId);
+  }
+  TASK_END(t);
+}
+
+TaskStatus turnTask(Task &t){
+  TASK_BEGIN(t);
+  turnaroundStart();
+  TASK_WAIT_UNTIL(t, turnaroundDone());
+  turnaroundEnd();
+  turning = false;
+  TASK_END(t);
+}
+
+#ifdef CASCADE
+TaskStatus wheelTask(Task &t){
+  TASK_BEGIN(t);
+  innerLoop();
+  TASK_END(t);
+}
+#endif
+
+TaskStatus commandTask(Task &t){
+  TASK_BEGIN(t);
+  takeCommands();
+  TASK_END(t);
+}
+
+#ifdef TELEMETRY
+TaskStatus telemetryTask(Task &t){
+  TASK_BEGIN(t);
+  sendTelemetry(sensors.frame(), lastPos);
+  TASK_END(t);
+}
+#endif
+
+void addTasks(){
+  turnId = scheduler.add("turn", turnTask, 0, TASK_EVENT, 0);
+#ifdef CASCADE
+  scheduler.add("wheels", wheelTask, 1, CASCADE_PERIOD_US, CASCADE_PERIOD_US);
+#endif
+  controlId = scheduler.add("control", controlTask, 2, TASK_EVENT, CONTROL_DEADLINE_US);
+  scheduler.add("sense", senseTask, 3, 0, SENSE_DEADLINE_US);
+  scheduler.add("commands", commandTask, 4, COMMAND_PERIOD_US, COMMAND_PERIOD_US);
+#ifdef TELEMETRY
+  scheduler.add("telemetry", telemetryTask, 5, TELEMETRY_PERIOD_US, TELEMETRY_PERIOD_US);
+#endif
+}
+#endif
+
 void setup() {
 // This function runs once
 
   // Pin Settings
   pinMode(LED_RF, OUTPUT);
 
-  pinMode(nSLPL, OUTPUT);
-  pinMode(DIR_L, OUTPUT);
-  pinMode(PWML, OUTPUT);
-
-  pinMode(nSLPR, OUTPUT);
-  pinMode(DIR_R, OUTPUT);
-  pinMode(PWMR, OUTPUT);
+  motors.begin(PWM_FREQ);
 
   ECE3_Init(); // Used for encoder functionality
+  cyclesInit();
+#ifdef TRACE
+  setEncoderHook(traceEdge);
+#endif
 
+#if defined(UART_TX)
+  uartTx.begin(TX_BAUD, TX_DROP_OLDEST);
+#elif defined(RECORD) || defined(TELEMETRY) || defined(TRACE)
+  Serial.begin(RECORD_BAUD);
+#else
   Serial.begin(BAUD); // data rate for serial data transmission
+#endif
   Serial.print("Starting up....");
   delay(2000);
-  
+
+#ifdef TASKS
+  //the wheel loops are a task of their own
+  addTasks();
+#else
+#ifdef CASCADE
+  sensors.onIdle(innerLoop);
+#endif
+
+#ifdef PIPELINE
+  // first frame, the loop computes on it while the next one is acquired
+  sensors.acquire();
+  sensors.complete();
+#endif
+#endif
+
+#ifdef STATIC_ALLOC
+  heapAuditArm(); // no heap use allowed from here on
+#endif
+
 }
 
-int donuts = 0;
+#ifdef TASKS
 void loop() {
-  
-  //reading the IR sensor data
-  uint16_t sensorValues[sensor_width];
-  ECE3_read_IR(sensorValues);
-  
-  uint16_t v = VMAX;
+  scheduler.run();
+#ifdef UART_TX
+  uartTx.service();
+#endif
+}
+#else
+void loop() {
+  TRACE_BEGIN(TR_LOOP, 0);
+
+  takeCommands();
+
+  //reading the IR sensor data, with PIPELINE the next frame discharges
+  //while this one is computed
+  sensors.acquire();
+#ifndef PIPELINE
+  sensors.complete();
+#endif
+  uint16_t *sensorValues = sensors.frame();
+#ifdef RECORD
+  EncoderCounts counts = getEncoderCounts();
+  recorder.begin(micros(), sensorValues, counts.left, counts.right);
+#endif
 
   if (donuts > 1){
-    v = 0;
-    digitalWrite(nSLPL, HIGH);
-    digitalWrite(nSLPR, HIGH);
-    digitalWrite(DIR_L, FORWARD);
-    digitalWrite(DIR_R, FORWARD);
-    analogWrite(PWML, 0);
-    analogWrite(PWMR, 0);
+    stopped();
   }
-  else if (!turn(sensorValues)){
-
-    bool curve = false;
-    int loc = (getEncoderCount_left() + getEncoderCount_right())/360;
-
-    //way there
-    if (donuts < 1){
-      if (loc < 2) curve = true;
-      if (loc > 13 && loc < 20) curve = true;
-      if (loc > 24) curve = true;  
-    }
-    else{
-      if (loc < 3) curve = true;
-      if (loc > 7 && loc < 14) curve = true;
-      if (loc > 24) curve = true;
-    }
-
-    double pos = posFind(sensorValues);
-    drive.update(v, pos, curve);
-
-    digitalWrite(nSLPL, drive.nSLPL);
-    digitalWrite(nSLPR, drive.nSLPR);
-
-    digitalWrite(DIR_L, drive.DIR_L);
-    digitalWrite(DIR_R, drive.DIR_R);
-    analogWrite(PWML, drive.PWML);
-    analogWrite(PWMR, drive.PWMR);
-
+  else if (!crossSeen(sensorValues)){
+    lastPos = driveFrame(sensorValues);
   }
   else{
+    turnaroundStart();
+    while (!turnaroundDone());
+    turnaroundEnd();
+  }
 
-    donuts++;
-
-    resetEncoderCount_left();
-    resetEncoderCount_right();
-
-    digitalWrite(DIR_L, FORWARD);
-    digitalWrite(DIR_R, REVERSE);
-    analogWrite(PWML, PWMAX);
-    analogWrite(PWMR, PWMAX);
-
-    while(true){
-      double revs = (getEncoderCount_left() + getEncoderCount_right())/360.0;
-      if (revs >= 1.5) break;
-    }
-    
-    digitalWrite(DIR_L, FORWARD);
-    digitalWrite(DIR_R, FORWARD);
-    
-    analogWrite(PWML, PWMAX);
-    analogWrite(PWMR, PWMAX);
+#ifdef RECORD
+  TRACE_BEGIN(TR_SERIAL, 0);
+  recorder.end(motors.current());
+  TRACE_END(TR_SERIAL);
+#endif
 
-    resetEncoderCount_left();
-    resetEncoderCount_right();
+#ifdef PIPELINE
+  sensors.complete();
+#endif
+#ifdef EMITTER_DIMMING
+  //nothing in flight until the next loop
+  emitters.update(sensors.frame());
+#endif
 
+#ifdef TELEMETRY
+  if (++sinceTelemetry >= TELEMETRY_EVERY){
+    sinceTelemetry = 0;
+    sendTelemetry(sensorValues, lastPos);
   }
+#endif
+#ifdef UART_TX
+  uartTx.service();
+#endif
+  TRACE_END(TR_LOOP);
 
-  /*
-  //making a JSON string for export
-  Json json;
-  String sensor = atos(sensor_width, sensorValues);
-  json.push("sensor", sensor); 
-
-  //Buffer the output to protect data
-  BufferIO bufferedData;
-  bufferedData.setData(json.stringify());
-  bufferedData.setStartBuffer(startBufferLength);
-  bufferedData.setEndBuffer(endBufferLength);
-
-  //Output the buffered data
-  Serial.print(bufferedData.getOutput());
-  */
-  
 }
+#endif
@@ -0,0 +1,221 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef PARAMS_H
+#define PARAMS_H
+#include "../control/params.h"
+#endif
+
+#ifdef UART_TX
+#ifndef UARTTX_H
+#define UARTTX_H
+#include "uarttx.h"
+#endif
+#endif
+
+//Binary command channel for live parameter tuning
+//
+//Requests:  0xA5 cmd len payload[len] sum
+//Replies:   0x5A cmd status len payload[len] sum
+//sum is the xor of every byte between the sync byte and the sum. Values
+//travel as little endian f32.
+//
+//  CMD_GET       no payload, replies with the parameter block
+//  CMD_SET       id(u8) value(f32), replies once the value is live
+//  CMD_SET_BLOCK version(u16) v[P_COUNT](f32), replies once it is live
+//  CMD_DEFAULTS  no payload, back to PARAM_DEFAULTS
+//
+//A set that would leave the parameters out of range (paramsValid() in
+//control/params.h) is answered with ST_RANGE and changes nothing. Each
+//CMD_SET is checked on its own, so a window or the cross line thresholds
+//move in the order that keeps them valid, or in one CMD_SET_BLOCK.
+//
+//Bytes are taken from the interrupt filled serial RX buffer, at most
+//COMMAND_BUDGET per poll(), so a tick never waits on the port. Updates are
+//staged and only copied into the live parameters by apply(), which the loop
+//calls between control ticks, so a tick never sees half an update.
+//A reply goes out as one write, with UART_TX queued through uartTx like
+//the other frames, as the DMA owns the port; a full ring drops it.
+const uint8_t COMMAND_SYNC = 0xA5;
+const uint8_t REPLY_SYNC = 0x5A;
+const uint8_t COMMAND_BUDGET = 32;
+const uint8_t COMMAND_MAX_PAYLOAD = 2 + 4*P_COUNT;
+const uint8_t REPLY_MAX_PAYLOAD = 4 + 4*P_COUNT;
+
+enum CommandId{
+    CMD_GET = 1,
+    CMD_SET = 2,
+    CMD_SET_BLOCK = 3,
+    CMD_DEFAULTS = 4
+};
+
+enum CommandStatus{
+    ST_OK = 0,
+    ST_CHECKSUM = 1,
+    ST_BAD_REQUEST = 2,
+    ST_VERSION = 3,
+    ST_RANGE = 4
+};
+
+class CommandChannel{
+private:
+    enum State { SYNC, CMD, LEN, PAYLOAD, SUM };
+    State state;
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t got;
+    uint8_t sum;
+    uint8_t payload[COMMAND_MAX_PAYLOAD];
+
+    Params staged;
+    bool pending; //staged holds an update not yet applied
+    uint8_t pendingCmd; //command to acknowledge once applied
+
+    void handle();
+    void stage();
+    void reply(uint8_t cmd, uint8_t status, const uint8_t *data, uint8_t n);
+    void replyBlock(uint8_t cmd, const Params &p);
+public:
+    CommandChannel();
+    //Parse whatever has arrived, up to COMMAND_BUDGET bytes
+    void poll();
+    //Make staged updates live, call between control ticks
+    void apply(Params &live);
+};
+
+CommandChannel::CommandChannel(){
+    state = SYNC;
+    cmd = len = got = sum = 0;
+    pending = false;
+    pendingCmd = 0;
+    paramsDefault(staged);
+}
+
+void CommandChannel::poll(){
+    for (uint8_t n=0; n<COMMAND_BUDGET && Serial.available() > 0; n++){
+        uint8_t b = Serial.read();
+        switch (state){
+            case SYNC:
+                if (b == COMMAND_SYNC) state = CMD;
+                break;
+            case CMD:
+                cmd = b;
+                sum = b;
+                state = LEN;
+                break;
+            case LEN:
+                len = b;
+                sum ^= b;
+                got = 0;
+                if (len > COMMAND_MAX_PAYLOAD) state = SYNC;
+                else state = len ? PAYLOAD : SUM;
+                break;
+            case PAYLOAD:
+                payload[got++] = b;
+                sum ^= b;
+                if (got == len) state = SUM;
+                break;
+            case SUM:
+                state = SYNC;
+                if (b == sum) handle();
+                else reply(cmd, ST_CHECKSUM, 0, 0);
+                break;
+        }
+    }
+}
+
+void CommandChannel::stage(){
+    if (!pending) staged = params;
+    pending = true;
+    pendingCmd = cmd;
+}
+
+void CommandChannel::handle(){
+    switch (cmd){
+        case CMD_GET:
+            replyBlock(CMD_GET, pending ? staged : params);
+            return;
+        case CMD_SET:{
+            if (len != 5 || payload[0] >= P_COUNT) break;
+            float value;
+            memcpy(&value, &payload[1], sizeof(value));
+            Params next = pending ? staged : params;
+            next.v[payload[0]] = value;
+            if (!paramsValid(next)){
+                reply(cmd, ST_RANGE, 0, 0);
+                return;
+            }
+            stage();
+            staged = next;
+            return;
+        }
+        case CMD_SET_BLOCK:{
+            if (len != COMMAND_MAX_PAYLOAD) break;
+            uint16_t version = payload[0] | (payload[1] << 8);
+            if (version != PARAMS_VERSION){
+                reply(cmd, ST_VERSION, 0, 0);
+                return;
+            }
+            Params next = pending ? staged : params;
+            for (int i=0; i<P_COUNT; i++){
+                float value;
+                memcpy(&value, &payload[2 + 4*i], sizeof(value));
+                next.v[i] = value;
+            }
+            if (!paramsValid(next)){
+                reply(cmd, ST_RANGE, 0, 0);
+                return;
+            }
+            stage();
+            staged = next;
+            return;
+        }
+        case CMD_DEFAULTS:
+            stage();
+            paramsDefault(staged);
+            return;
+    }
+    reply(cmd, ST_BAD_REQUEST, 0, 0);
+}
+
+void CommandChannel::apply(Params &live){
+    if (!pending) return;
+    staged.revision = live.revision + 1;
+    live = staged;
+    pending = false;
+    replyBlock(pendingCmd, live);
+}
+
+void CommandChannel::reply(uint8_t cmd, uint8_t status, const uint8_t *data, uint8_t n){
+    uint8_t out[5 + REPLY_MAX_PAYLOAD];
+    out[0] = REPLY_SYNC;
+    out[1] = cmd;
+    out[2] = status;
+    out[3] = n;
+    uint8_t s = cmd ^ status ^ n;
+    for (uint8_t i=0; i<n; i++){
+        out[4 + i] = data[i];
+        s ^= data[i];
+    }
+    out[4 + n] = s;
+#ifdef UART_TX
+    uartTx.send(out, n + 5);
+#else
+    Serial.write(out, n + 5);
+#endif
+}
+
+void CommandChannel::replyBlock(uint8_t cmd, const Params &p){
+    uint8_t out[REPLY_MAX_PAYLOAD];
+    out[0] = p.version & 0xFF;
+    out[1] = p.version >> 8;
+    out[2] = p.revision & 0xFF;
+    out[3] = p.revision >> 8;
+    for (int i=0; i<P_COUNT; i++){
+        float value = p.v[i];
+        memcpy(&out[4 + 4*i], &value, sizeof(value));
+    }
+    reply(cmd, ST_OK, out, sizeof(out));
+}
@@ -0,0 +1,143 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+//Delta compressed run recording (RECORD_PACKED in const.h)
+//
+//Packs the 51 byte frames of record.h. A frame's 19 fields (t_us, 8
+//sensors, encL, encR, spinL, spinR and the 6 motor outputs) are coded as
+//the difference to a prediction from the frame before: the last value, or
+//for t_us and the encoders, which move at a steady rate, the last value
+//plus the last step. Residuals are zigzag varints, so a small change in
+//either direction takes one byte, and a 24 bit mask skips the fields that
+//came out exactly as predicted.
+//
+//  delta: 'R','D' seq(u8) len(u8) mask(u24) varint residuals... xor(u8)
+//  key:   'R' 0x80|seq the record.h body (48 bytes) xor(u8)
+//
+//seq counts frames modulo 128, a keyframe carries it in the high bit set
+//second byte so it is no longer than a raw record.h frame. len counts the
+//whole frame, checksum included. Every PACK_KEY_EVERY frames, and whenever
+//a delta frame would be longer than one, a keyframe carries the fields in
+//full and restarts the prediction, so a reader that lost bytes (bad
+//checksum, seq gap) picks the stream up again at the next one, and no
+//frame is ever bigger packed than raw. Packing is one pass over the 19
+//fields with at most 5 varint bytes each, so its cycles per frame are
+//bounded whatever the run looks like.
+//hostTools/recording.h decodes it.
+
+const uint8_t PACK_SYNC_DELTA = 'D';
+const uint8_t PACK_SYNC_KEY = 0x80; //or'ed with seq
+const uint8_t PACK_SEQ_MASK = 0x7F;
+const uint8_t PACK_FIELDS = 19;
+const uint8_t PACK_BODY_LEN = 48; //record.h frame less sync and checksum
+const uint8_t PACK_KEY_LEN = PACK_BODY_LEN + 3; //the size of a raw frame
+const uint8_t PACK_MAX_LEN = 7 + 5*PACK_FIELDS + 1; //a delta frame before the keyframe fallback
+const uint8_t PACK_KEY_EVERY = 64;
+
+//Bytes of each field in the record.h body, in order
+const uint8_t PACK_WIDTH[PACK_FIELDS] = {4, 2, 2, 2, 2, 2, 2, 2, 2, 4, 4, 4, 4, 2, 2, 2, 2, 2, 2};
+//Fields predicted as last value plus last step: t_us, encL, encR
+const uint32_t PACK_LINEAR = (1ul << 0) | (1ul << 9) | (1ul << 10);
+
+inline uint32_t zigzag(int32_t v){ return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t v){ return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+class FramePacker{
+private:
+    uint8_t out[PACK_MAX_LEN];
+    uint8_t len;
+    uint32_t last[PACK_FIELDS];
+    uint32_t step[PACK_FIELDS];
+    uint8_t seq;
+    uint8_t sinceKey; //delta frames since the last keyframe
+    uint8_t keyEvery;
+    void key(const uint8_t *body, const uint32_t *v);
+public:
+    //Keyframe every keyEvery frames, 1 for keyframes only
+    FramePacker(uint8_t keyEvery = PACK_KEY_EVERY);
+    //Pack a record.h frame, returns the packed frame
+    const uint8_t *pack(const uint8_t *frame);
+    //Bytes in the last packed frame
+    uint8_t length() const { return len; }
+    //Next frame is a keyframe, e.g. after the link dropped bytes
+    void resync(){ sinceKey = 0; }
+};
+
+FramePacker::FramePacker(uint8_t keyEvery) : keyEvery(keyEvery ? keyEvery : 1){
+    len = 0;
+    seq = 0;
+    sinceKey = 0;
+    for (uint8_t f=0; f<PACK_FIELDS; f++) last[f] = step[f] = 0;
+}
+
+void FramePacker::key(const uint8_t *body, const uint32_t *v){
+    out[0] = 'R';
+    out[1] = PACK_SYNC_KEY | (seq & PACK_SEQ_MASK);
+    memcpy(out + 2, body, PACK_BODY_LEN);
+    uint8_t sum = 0;
+    for (uint8_t i=0; i<PACK_KEY_LEN - 1; i++) sum ^= out[i];
+    out[PACK_KEY_LEN - 1] = sum;
+    len = PACK_KEY_LEN;
+    for (uint8_t f=0; f<PACK_FIELDS; f++){
+        last[f] = v[f];
+        step[f] = 0;
+    }
+    sinceKey = 1;
+}
+
+const uint8_t *FramePacker::pack(const uint8_t *frame){
+    const uint8_t *body = frame + 2;
+    uint32_t v[PACK_FIELDS];
+    const uint8_t *p = body;
+    for (uint8_t f=0; f<PACK_FIELDS; f++){
+        uint32_t x = p[0] | (p[1] << 8);
+        if (PACK_WIDTH[f] == 4) x |= ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        v[f] = x;
+        p += PACK_WIDTH[f];
+    }
+
+    if (sinceKey == 0 || sinceKey >= keyEvery){
+        key(body, v);
+        seq++;
+        return out;
+    }
+
+    uint32_t mask = 0;
+    uint8_t n = 7;
+    for (uint8_t f=0; f<PACK_FIELDS; f++){
+        uint32_t r = v[f] - (last[f] + step[f]);
+        if (!r) continue;
+        mask |= 1ul << f;
+        uint32_t z = zigzag((int32_t)r);
+        while (z >= 0x80){
+            out[n++] = (z & 0x7F) | 0x80;
+            z >>= 7;
+        }
+        out[n++] = z;
+    }
+    if (n + 1 > PACK_KEY_LEN){
+        key(body, v);
+        seq++;
+        return out;
+    }
+
+    for (uint8_t f=0; f<PACK_FIELDS; f++){
+        if (PACK_LINEAR & (1ul << f)) step[f] = v[f] - last[f];
+        last[f] = v[f];
+    }
+    out[0] = 'R';
+    out[1] = PACK_SYNC_DELTA;
+    out[2] = seq++ & PACK_SEQ_MASK;
+    out[3] = n + 1;
+    out[4] = mask & 0xFF;
+    out[5] = (mask >> 8) & 0xFF;
+    out[6] = mask >> 16;
+    uint8_t sum = 0;
+    for (uint8_t i=0; i<n; i++) sum ^= out[i];
+    out[n] = sum;
+    len = n + 1;
+    sinceKey++;
+    return out;
+}
@@ -0,0 +1,124 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "const.h"
+#endif
+
+#ifndef MOTOR_H
+#define MOTOR_H
+#include "../control/motor.h"
+#endif
+
+#ifdef RECORD_PACKED
+#include "pack.h"
+#endif
+
+#ifdef UART_TX
+#ifndef UARTTX_H
+#define UARTTX_H
+#include "uarttx.h"
+#endif
+#endif
+
+//Binary run recording
+//One frame is sent per loop() iteration when RECORD is defined. Frames are
+//little endian and start with the bytes 'R','F':
+//  t_us(u32) sensor[8](u16) encL encR(u32) spinL spinR(u32)
+//  nSLPL nSLPR DIR_L DIR_R PWML PWMR(u16) xor checksum(u8)
+//spinL/spinR are the encoder counts that ended a turnaround in that frame
+//(0 if there was none). hostTools/replay.cpp plays the frames back through
+//loop() on a host and diffs the outputs. With RECORD_PACKED the frames are
+//delta compressed on the way out (see pack.h), with UART_TX queued
+//without blocking the loop (see uarttx.h).
+const uint8_t RECORD_SYNC0 = 'R';
+const uint8_t RECORD_SYNC1 = 'F';
+const uint8_t RECORD_T = 2;
+const uint8_t RECORD_SENSOR = 6;
+const uint8_t RECORD_ENC = RECORD_SENSOR + 2*sensor_width;
+const uint8_t RECORD_SPIN = RECORD_ENC + 8;
+const uint8_t RECORD_CMD = RECORD_SPIN + 8;
+const uint8_t RECORD_SUM = RECORD_CMD + 12;
+const uint8_t RECORD_FRAME_LEN = RECORD_SUM + 1;
+
+class Recorder{
+private:
+    uint8_t frame[RECORD_FRAME_LEN];
+#ifdef RECORD_PACKED
+    FramePacker packer;
+#endif
+    void put16(uint8_t at, uint16_t v);
+    void put32(uint8_t at, uint32_t v);
+public:
+    Recorder();
+    //Start a frame right after the sensors were read
+    void begin(uint32_t t, uint16_t sensorValues[], uint32_t encL, uint32_t encR);
+    //Encoder counts that ended a turnaround
+    void spin(uint32_t encL, uint32_t encR);
+    //Finish the frame with the outputs of this iteration and send it
+    void end(const MotorCommand &cmd);
+};
+
+Recorder::Recorder(){
+    memset(frame, 0, sizeof(frame));
+    frame[0] = RECORD_SYNC0;
+    frame[1] = RECORD_SYNC1;
+}
+
+void Recorder::put16(uint8_t at, uint16_t v){
+    frame[at] = v & 0xFF;
+    frame[at + 1] = v >> 8;
+}
+
+void Recorder::put32(uint8_t at, uint32_t v){
+    put16(at, v & 0xFFFF);
+    put16(at + 2, v >> 16);
+}
+
+void Recorder::begin(uint32_t t, uint16_t sensorValues[], uint32_t encL, uint32_t encR){
+    put32(RECORD_T, t);
+    for (int i=0; i<sensor_width; i++) put16(RECORD_SENSOR + 2*i, sensorValues[i]);
+    put32(RECORD_ENC, encL);
+    put32(RECORD_ENC + 4, encR);
+    put32(RECORD_SPIN, 0);
+    put32(RECORD_SPIN + 4, 0);
+}
+
+void Recorder::spin(uint32_t encL, uint32_t encR){
+    put32(RECORD_SPIN, encL);
+    put32(RECORD_SPIN + 4, encR);
+}
+
+void Recorder::end(const MotorCommand &cmd){
+    put16(RECORD_CMD, cmd.nSLPL);
+    put16(RECORD_CMD + 2, cmd.nSLPR);
+    put16(RECORD_CMD + 4, cmd.DIR_L);
+    put16(RECORD_CMD + 6, cmd.DIR_R);
+    put16(RECORD_CMD + 8, cmd.PWML);
+    put16(RECORD_CMD + 10, cmd.PWMR);
+
+    uint8_t sum = 0;
+    for (int i=0; i<RECORD_SUM; i++) sum ^= frame[i];
+    frame[RECORD_SUM] = sum;
+
+#ifdef RECORD_PACKED
+    const uint8_t *out = packer.pack(frame);
+    uint8_t len = packer.length();
+#else
+    const uint8_t *out = frame;
+    uint8_t len = RECORD_FRAME_LEN;
+#endif
+#ifdef UART_TX
+    if (!uartTx.send(out, len)){
+#ifdef RECORD_PACKED
+        //a frame the next delta builds on never goes out
+        packer.resync();
+#endif
+    }
+#else
+    Serial.write(out, len);
+#endif
+}
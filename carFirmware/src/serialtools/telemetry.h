@@ -0,0 +1,170 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "../const.h"
+#endif
+
+//Schema driven json telemetry in a fixed buffer
+//
+//Writes the same frames as Json + atos + BufferIO, e.g.
+//  SSSSSSSSSS{"sensor":[620,540,...],"pos":4512}EEEEEEEEEE
+//so serialPlotter/getData.py and hostTools/telemetry.h read them unchanged,
+//without String or the heap. The fields are a constexpr list and the
+//longest possible frame is computed from it at compile time, so the buffer
+//always fits and writing a value needs no bounds check. Integers go out
+//two digits at a time from a lookup table.
+//
+//Values are written in schema order between begin() and end():
+//  telemetry.begin();
+//  telemetry.array(sensorValues);
+//  telemetry.value(pos);
+//  Serial.write(telemetry.end(), telemetry.length());
+
+//One key of the object, count 0 for an int32_t, otherwise a uint16_t array
+struct TelemetryField{
+    const char *key;
+    uint8_t count;
+};
+
+//Fields of the frame the loop sends with TELEMETRY
+constexpr TelemetryField TELEMETRY_FIELDS[] = {
+    {"sensor", sensor_width},
+    {"pos", 0}, //line position x1000
+    {"PWML", 0}, //PWM_FULLSCALE units
+    {"PWMR", 0},
+    {"cross", 0}, //cross line confidence x1000
+};
+const int TELEMETRY_FIELD_COUNT = sizeof(TELEMETRY_FIELDS)/sizeof(TELEMETRY_FIELDS[0]);
+
+constexpr int telemetryKeyLength(const char *s){
+    return *s ? 1 + telemetryKeyLength(s + 1) : 0;
+}
+
+//"key": and the longest value, "-2147483648" or [65535,...,65535],
+//whichever is longer so a value of the wrong kind still fits
+constexpr int telemetryFieldLength(const TelemetryField &f){
+    return telemetryKeyLength(f.key) + 3 + (6*f.count + 1 > 11 ? 6*f.count + 1 : 11);
+}
+
+//Longest frame for the first n fields, markers and the comma after each
+//field but the last included
+constexpr int telemetryLength(const TelemetryField *f, int n){
+    return n ? telemetryFieldLength(f[n - 1]) + (n > 1 ? 1 : 0) + telemetryLength(f, n - 1)
+             : startBufferLength + 2 + endBufferLength;
+}
+
+const int TELEMETRY_CAPACITY = telemetryLength(TELEMETRY_FIELDS, TELEMETRY_FIELD_COUNT);
+
+//"00" to "99"
+const char DIGIT_PAIRS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+//Decimal digits of v at p, returns the end
+inline char *writeDecimal(char *p, uint32_t v){
+    char tmp[10];
+    char *t = tmp + 10;
+    while (v >= 100){
+        uint32_t r = v % 100;
+        v /= 100;
+        t -= 2;
+        t[0] = DIGIT_PAIRS[2*r];
+        t[1] = DIGIT_PAIRS[2*r + 1];
+    }
+    if (v >= 10){
+        t -= 2;
+        t[0] = DIGIT_PAIRS[2*v];
+        t[1] = DIGIT_PAIRS[2*v + 1];
+    }
+    else *--t = '0' + v;
+    while (t < tmp + 10) *p++ = *t++;
+    return p;
+}
+
+template<int N>
+class TelemetryWriter{
+private:
+    char buf[N + 1];
+    char *at; //next character
+    const TelemetryField *fields;
+    int count;
+    int next; //field the next value belongs to
+    void key();
+public:
+    TelemetryWriter(const TelemetryField *fields, int count);
+    //Start markers and the opening brace
+    void begin();
+    //Next field, a scalar
+    void value(int32_t v);
+    //Next field, an array of its schema count
+    void array(const uint16_t *a);
+    //Close the object, add the end markers, returns the frame
+    const char *end();
+    //Characters in the frame
+    uint16_t length() const { return at - buf; }
+};
+
+template<int N>
+TelemetryWriter<N>::TelemetryWriter(const TelemetryField *fields, int count){
+    this->fields = fields;
+    this->count = count;
+    next = 0;
+    at = buf;
+    buf[0] = 0;
+}
+
+template<int N>
+void TelemetryWriter<N>::begin(){
+    at = buf;
+    for (int i=0; i<startBufferLength; i++) *at++ = 'S';
+    *at++ = '{';
+    next = 0;
+}
+
+template<int N>
+void TelemetryWriter<N>::key(){
+    if (next) *at++ = ',';
+    *at++ = '"';
+    for (const char *k = fields[next].key; *k; k++) *at++ = *k;
+    *at++ = '"';
+    *at++ = ':';
+}
+
+template<int N>
+void TelemetryWriter<N>::value(int32_t v){
+    if (next >= count) return;
+    key();
+    uint32_t u = v;
+    if (v < 0){
+        *at++ = '-';
+        u = -u;
+    }
+    at = writeDecimal(at, u);
+    next++;
+}
+
+template<int N>
+void TelemetryWriter<N>::array(const uint16_t *a){
+    if (next >= count) return;
+    key();
+    *at++ = '[';
+    for (uint8_t i=0; i<fields[next].count; i++){
+        if (i) *at++ = ',';
+        at = writeDecimal(at, a[i]);
+    }
+    *at++ = ']';
+    next++;
+}
+
+template<int N>
+const char *TelemetryWriter<N>::end(){
+    *at++ = '}';
+    for (int i=0; i<endBufferLength; i++) *at++ = 'E';
+    *at = 0;
+    return buf;
+}
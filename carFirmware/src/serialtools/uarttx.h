@@ -0,0 +1,232 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+#include <Arduino.h>
+#endif
+
+#ifndef CONST_H
+#define CONST_H
+#include "../const.h"
+#endif
+
+#ifdef __MSP432P401R__
+#include "msp.h"
+#endif
+
+//Non-blocking serial output (UART_TX in const.h)
+//
+//Serial.write() blocks as soon as the core's transmit buffer is full, so a
+//frame per loop at a low baud rate stalls the control loop. send() instead
+//queues the whole frame in a ring of N bytes and returns; frames leave one
+//at a time, each copied out of the ring into a transmit buffer that the
+//MSP432's uDMA feeds to EUSCI_A0 on its TX requests, without the CPU.
+//service() starts the next frame once the last one is out and is cheap
+//enough to call every loop.
+//
+//A frame that does not fit is dropped whole, so the reader never sees a
+//torn one: with TX_DROP_OLDEST the oldest queued frames make room for it
+//(latest state first, for telemetry), otherwise the new frame is the one
+//dropped (an unbroken run for as long as it lasts). Frames sent, bytes
+//sent, frames and bytes dropped and the ring's high water mark are kept
+//for report().
+//
+//The core's own serial driver must stay off the port while frames go out,
+//so anything printed with Serial goes after flush().
+//
+//On a host frames go to Serial straight away and the transmitter stays
+//busy for as long as the bytes would take at the baud rate, so drops come
+//out the same as on the car.
+
+const uint16_t TX_FRAME_MAX = 255; //longest frame, the length byte in the ring
+
+#ifdef __MSP432P401R__
+//uDMA channel 0 takes the EUSCI_A0 TX request (source 1). The control
+//table holds a primary and an alternate structure for each of the 8
+//channels and has to be aligned to its size.
+static volatile uint32_t txDmaTable[2*8*4] __attribute__((aligned(256)));
+
+void txInit(long baud){
+    (void)baud;
+    DMA_Control->CFG = DMA_CFG_MASTEN;
+    DMA_Control->CTLBASE = (uint32_t)txDmaTable;
+    DMA_Channel->CH_SRCCFG[0] = 1;
+    DMA_Control->ALTCLR = 1;
+    DMA_Control->USEBURSTCLR = 1;
+    DMA_Control->REQMASKCLR = 1;
+    EUSCI_A0->IE &= ~EUSCI_A_IE_TXIE;
+}
+
+void txStart(const uint8_t *p, uint16_t n){
+    txDmaTable[0] = (uint32_t)(p + n - 1); //source end
+    txDmaTable[1] = (uint32_t)&EUSCI_A0->TXBUF;
+    //fixed byte destination, byte source incrementing, basic mode
+    txDmaTable[2] = (3ul << 30) | ((uint32_t)(n - 1) << 4) | 1;
+    DMA_Control->ENASET = 1;
+    //TXIFG is already up, its edge will not come, so the first byte is
+    //requested in software
+    DMA_Channel->SW_CHTRIG = DMA_SW_CHTRIG_CH0;
+}
+
+bool txBusy(){
+    return DMA_Control->ENASET & 1;
+}
+#else
+static uint32_t txByteUs = 0; //us per byte, 10 bits at the baud rate
+static uint32_t txDoneAt = 0; //micros() the last frame is out
+
+void txInit(long baud){
+    txByteUs = 10000000/baud;
+    if (!txByteUs) txByteUs = 1;
+}
+
+void txStart(const uint8_t *p, uint16_t n){
+    Serial.write(p, n);
+    txDoneAt = micros() + n*txByteUs;
+}
+
+bool txBusy(){
+    return (int32_t)(micros() - txDoneAt) < 0;
+}
+#endif
+
+template<int N>
+class UartTx{
+private:
+    uint8_t ring[N]; //each frame is its length byte then the bytes
+    uint16_t head; //next byte written
+    uint16_t tail; //length byte of the oldest frame
+    uint16_t used;
+    uint8_t out[TX_FRAME_MAX]; //frame going out, stays put while it does
+    bool dropOldest;
+    void put(const uint8_t *p, uint8_t n);
+    void dropFirst();
+public:
+    uint32_t frames; //frames handed to the transmitter
+    uint32_t bytes;
+    uint32_t dropped; //frames dropped, too long ones included
+    uint32_t droppedBytes;
+    uint16_t highWater; //most bytes queued at once
+
+    UartTx();
+    //Open the port at baud, dropOldest chooses which frame a full ring drops
+    void begin(long baud, bool dropOldest);
+    //Queue a frame, never waits; false if it or older frames were dropped
+    bool send(const uint8_t *p, uint16_t n);
+    //Start the next frame when the last one is out
+    void service();
+    //Nothing queued or going out
+    bool idle();
+    //Wait until everything queued is out, e.g. before printing with Serial
+    void flush();
+    //Print frames and bytes sent and dropped
+    void report();
+};
+
+template<int N>
+UartTx<N>::UartTx(){
+    head = tail = used = 0;
+    dropOldest = true;
+    frames = bytes = dropped = droppedBytes = 0;
+    highWater = 0;
+}
+
+template<int N>
+void UartTx<N>::begin(long baud, bool dropOldest){
+    this->dropOldest = dropOldest;
+    Serial.begin(baud);
+    txInit(baud);
+}
+
+template<int N>
+void UartTx<N>::put(const uint8_t *p, uint8_t n){
+    for (uint8_t i=0; i<n; i++){
+        ring[head] = p[i];
+        if (++head == N) head = 0;
+    }
+    used += n;
+}
+
+template<int N>
+void UartTx<N>::dropFirst(){
+    uint16_t n = ring[tail] + 1;
+    tail = (tail + n) % N;
+    used -= n;
+    dropped++;
+    droppedBytes += n - 1;
+}
+
+template<int N>
+bool UartTx<N>::send(const uint8_t *p, uint16_t n){
+    if (n == 0) return true;
+    if (n > TX_FRAME_MAX || n + 1 > N){
+        dropped++;
+        droppedBytes += n;
+        return false;
+    }
+    bool full = used + n + 1 > N;
+    if (full){
+        if (!dropOldest){
+            dropped++;
+            droppedBytes += n;
+            service();
+            return false;
+        }
+        while (used + n + 1 > N) dropFirst();
+    }
+    uint8_t len = n;
+    put(&len, 1);
+    put(p, n);
+    if (used > highWater) highWater = used;
+    service();
+    return !full;
+}
+
+template<int N>
+void UartTx<N>::service(){
+    if (!used || txBusy()) return;
+    uint8_t n = ring[tail];
+    uint16_t at = tail + 1 == N ? 0 : tail + 1;
+    for (uint8_t i=0; i<n; i++){
+        out[i] = ring[at];
+        if (++at == N) at = 0;
+    }
+    tail = at;
+    used -= n + 1;
+    txStart(out, n);
+    frames++;
+    bytes += n;
+}
+
+template<int N>
+bool UartTx<N>::idle(){
+    return !used && !txBusy();
+}
+
+template<int N>
+void UartTx<N>::flush(){
+    while (!idle()){
+        service();
+        delayMicroseconds(10);
+    }
+}
+
+template<int N>
+void UartTx<N>::report(){
+    Serial.print("uart tx frames ");
+    Serial.print(frames);
+    Serial.print(" bytes ");
+    Serial.print(bytes);
+    Serial.print(", dropped frames ");
+    Serial.print(dropped);
+    Serial.print(" bytes ");
+    Serial.print(droppedBytes);
+    Serial.print(" (");
+    Serial.print(dropOldest ? "oldest" : "newest");
+    Serial.print("), ring high water ");
+    Serial.print(highWater);
+    Serial.print("/");
+    Serial.println(N);
+}
+
+#ifdef UART_TX
+UartTx<TX_RING> uartTx; //frames out of the loop
+#endif
@@ -0,0 +1,213 @@
+//Streaming aggregation for live plotting.
+//
+//Pyramid keeps, per channel, min/max/mean buckets at several resolutions:
+//level L buckets summarise base*fan^L samples and each level keeps the last
+//`slots` buckets in a ring. Memory is fixed at levels*slots buckets, recent
+//data stays at full resolution and older data is only kept coarsely. A
+//plotter asks for any time range at its pixel width and gets one bucket per
+//pixel from the finest level that still covers the range.
+//
+//RollingStats keeps mean, standard deviation, min and max over the last
+//`window` samples in O(1) per sample.
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct Bucket{
+    uint64_t t0 = 0; //first sample time
+    uint64_t t1 = 0; //last sample time
+    float min = 0;
+    float max = 0;
+    double sum = 0;
+    uint32_t n = 0;
+
+    void add(uint64_t t, float v){
+        if (!n){ t0 = t; min = max = v; }
+        else{
+            if (v < min) min = v;
+            if (v > max) max = v;
+        }
+        t1 = t;
+        sum += v;
+        n++;
+    }
+
+    void merge(const Bucket &b){
+        if (!b.n) return;
+        if (!n){ *this = b; return; }
+        if (b.t0 < t0) t0 = b.t0;
+        if (b.t1 > t1) t1 = b.t1;
+        if (b.min < min) min = b.min;
+        if (b.max > max) max = b.max;
+        sum += b.sum;
+        n += b.n;
+    }
+
+    float mean() const { return n ? sum/n : 0; }
+};
+
+class Pyramid{
+private:
+    struct Level{
+        std::vector<Bucket> ring;
+        size_t next = 0; //slot the next closed bucket goes to
+        size_t count = 0; //closed buckets held
+        uint64_t span = 0; //samples per bucket
+        Bucket open;
+
+        const Bucket &at(size_t i) const { //i = 0 is the oldest held bucket
+            return ring[(next + ring.size() - count + i) % ring.size()];
+        }
+        //First held bucket ending at or after t
+        size_t lowerBound(uint64_t t) const {
+            size_t lo = 0, hi = count;
+            while (lo < hi){
+                size_t mid = (lo + hi)/2;
+                if (at(mid).t1 < t) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+    };
+    std::vector<Level> levels;
+
+    //A level that never wrapped still holds everything since the start
+    bool covers(size_t L, uint64_t t0) const {
+        const Level &l = levels[L];
+        return l.count < l.ring.size() || l.at(0).t0 <= t0;
+    }
+    size_t inRange(size_t L, uint64_t t0) const {
+        return levels[L].count - levels[L].lowerBound(t0);
+    }
+public:
+    Pyramid(size_t base = 1, size_t fan = 4, size_t nlevels = 8, size_t slots = 512){
+        levels.resize(nlevels);
+        uint64_t span = base;
+        for (Level &l : levels){
+            l.ring.resize(slots);
+            l.span = span;
+            span *= fan;
+        }
+    }
+
+    void add(uint64_t t, float v){
+        for (Level &l : levels){
+            l.open.add(t, v);
+            if (l.open.n < l.span) continue;
+            l.ring[l.next] = l.open;
+            l.next = (l.next + 1) % l.ring.size();
+            if (l.count < l.ring.size()) l.count++;
+            l.open = Bucket();
+        }
+    }
+
+    //Fixed memory used by the buckets
+    size_t bytes() const { return levels.size()*levels[0].ring.size()*sizeof(Bucket); }
+
+    //Aggregate [t0, t1] into `pixels` equal time bins. Bins with no data
+    //have n == 0. Returns the level used, -1 if nothing is held.
+    int query(uint64_t t0, uint64_t t1, size_t pixels, std::vector<Bucket> &out) const {
+        out.assign(pixels, Bucket());
+        if (!pixels || t1 < t0) return -1;
+        //Finest level that covers t0, made coarser while the next level
+        //still has at least one bucket per pixel
+        int use = -1;
+        for (size_t L=0; L<levels.size(); L++){
+            if (!levels[L].count && !levels[L].open.n) continue;
+            use = L;
+            if (!covers(L, t0)) continue;
+            if (inRange(L, t0) <= 2*pixels) break;
+            if (L + 1 == levels.size() || !covers(L + 1, t0) || inRange(L + 1, t0) < pixels) break;
+        }
+        if (use < 0) return -1;
+
+        const Level &l = levels[use];
+        double width = (double)(t1 - t0 + 1)/pixels;
+        auto bin = [&](const Bucket &b){
+            if (!b.n || b.t1 < t0 || b.t0 > t1) return;
+            uint64_t mid = b.t0/2 + b.t1/2;
+            if (mid < t0) mid = t0;
+            if (mid > t1) mid = t1;
+            size_t px = (mid - t0)/width;
+            out[px < pixels ? px : pixels - 1].merge(b);
+        };
+        for (size_t i=l.lowerBound(t0); i<l.count && l.at(i).t0 <= t1; i++) bin(l.at(i));
+        bin(l.open);
+        return use;
+    }
+};
+
+class RollingStats{
+private:
+    std::vector<float> ring;
+    size_t next = 0;
+    size_t count = 0;
+    uint64_t seen = 0;
+    double sum = 0;
+    double sumsq = 0;
+    //Monotonic queues of sample numbers for the window min and max
+    std::vector<uint64_t> minq, maxq;
+    size_t minHead = 0, minLen = 0, maxHead = 0, maxLen = 0;
+
+    float valueOf(uint64_t k) const { return ring[k % ring.size()]; }
+    uint64_t &slot(std::vector<uint64_t> &q, size_t head, size_t i){ return q[(head + i) % q.size()]; }
+
+    void pushMono(std::vector<uint64_t> &q, size_t &head, size_t &len, uint64_t k, bool isMin){
+        while (len && slot(q, head, 0) + ring.size() <= k){
+            head = (head + 1) % q.size();
+            len--;
+        }
+        float v = valueOf(k);
+        while (len){
+            float back = valueOf(slot(q, head, len - 1));
+            if (isMin ? back < v : back > v) break;
+            len--;
+        }
+        slot(q, head, len++) = k;
+    }
+public:
+    explicit RollingStats(size_t window = 256) : ring(window ? window : 1), minq(ring.size()), maxq(ring.size()){}
+
+    void add(float v){
+        if (count == ring.size()){
+            float old = ring[next];
+            sum -= old;
+            sumsq -= (double)old*old;
+        }
+        else count++;
+        ring[next] = v;
+        next = (next + 1) % ring.size();
+        sum += v;
+        sumsq += (double)v*v;
+        pushMono(minq, minHead, minLen, seen, true);
+        pushMono(maxq, maxHead, maxLen, seen, false);
+        seen++;
+    }
+
+    size_t size() const { return count; }
+    double mean() const { return count ? sum/count : 0; }
+    double stddev() const {
+        if (count < 2) return 0;
+        double var = (sumsq - sum*sum/count)/(count - 1);
+        return var > 0 ? sqrt(var) : 0;
+    }
+    float min() const { return count ? valueOf(minq[minHead]) : 0; }
+    float max() const { return count ? valueOf(maxq[maxHead]) : 0; }
+};
+
+//A named channel with both views
+struct Channel{
+    std::string name;
+    Pyramid pyramid;
+    RollingStats window;
+
+    Channel(const std::string &name, size_t window = 256) : name(name), window(window){}
+
+    void add(uint64_t t, float v){
+        pyramid.add(t, v);
+        window.add(v);
+    }
+};
@@ -0,0 +1,179 @@
+//Converts tracks and telemetry into the columnar format in runfile.h.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -IhostTools/shim hostTools/convert.cpp -o convert
+//
+//Usage:
+//  convert track track.csv out.col     X,Y polyline, adds arc length s
+//  convert json capture.txt out.col    BufferIO framed {"sensor":[...],...} stream
+//  convert rec run.rec out.col         binary recording from RECORD firmware
+//  convert info file.col               print the header and column ranges
+
+#include "../carFirmware/src/control/pos.h"
+#include "recording.h"
+#include "runfile.h"
+#include "telemetry.h"
+#include "track.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+static int track(const char *in, const char *out){
+    std::vector<double> x, y, s;
+    if (!readTrackCSV(in, x, y)){
+        fprintf(stderr, "convert: cannot read %s\n", in);
+        return 2;
+    }
+    arcLength(x, y, s);
+
+    ColWriter w(KIND_TRACK);
+    w.add("x", x);
+    w.add("y", y);
+    w.add("s", s);
+    if (!w.write(out)){
+        fprintf(stderr, "convert: cannot write %s\n", out);
+        return 2;
+    }
+    printf("%zu points, %.3f long\n", x.size(), s.empty() ? 0.0 : s.back());
+    return 0;
+}
+
+//Write the sensor columns and the line position, the car's own where sent
+//(NAN where not) and otherwise what posFind computes
+static void addSensors(ColWriter &w, const std::vector<uint16_t> &frames, const std::vector<float> *sent = 0){
+    size_t n = frames.size()/REC_SENSORS;
+    std::vector<float> pos(n);
+    for (size_t k=0; k<n; k++){
+        pos[k] = sent && !isnan((*sent)[k]) ? (*sent)[k] : posFind((uint16_t *)&frames[k*REC_SENSORS]);
+    }
+    for (int i=0; i<REC_SENSORS; i++){
+        std::vector<uint16_t> col(n);
+        for (size_t k=0; k<n; k++) col[k] = frames[k*REC_SENSORS + i];
+        char name[16];
+        snprintf(name, sizeof(name), "sensor%d", i);
+        w.add(name, col);
+    }
+    w.add("pos", pos);
+}
+
+//Every S...{...}...E frame in a capture of the TELEMETRY firmware. pwmL and
+//pwmR are written when any frame carries them, 0 in frames that do not
+static int json(const char *in, const char *out){
+    std::vector<uint8_t> bytes;
+    if (!readFile(in, bytes)){
+        fprintf(stderr, "convert: cannot read %s\n", in);
+        return 2;
+    }
+    std::vector<uint16_t> frames, pwmL, pwmR;
+    std::vector<float> pos;
+    uint8_t has = 0;
+    TelemetryFramer framer;
+    framer.feed(bytes.data(), bytes.size(), [&](const TelemetryValues &v){
+        frames.insert(frames.end(), v.sensor, v.sensor + TELEMETRY_SENSORS);
+        pos.push_back(v.has & HAS_POS ? v.pos/1000.0 : NAN);
+        pwmL.push_back(v.has & HAS_PWML ? v.PWML : 0);
+        pwmR.push_back(v.has & HAS_PWMR ? v.PWMR : 0);
+        has |= v.has;
+    });
+    size_t skipped = framer.malformed;
+
+    ColWriter w(KIND_RUN);
+    addSensors(w, frames, &pos);
+    if (has & HAS_PWML) w.add("pwmL", pwmL);
+    if (has & HAS_PWMR) w.add("pwmR", pwmR);
+    if (!w.write(out)){
+        fprintf(stderr, "convert: cannot write %s\n", out);
+        return 2;
+    }
+    printf("%zu frames, %zu malformed\n", frames.size()/REC_SENSORS, skipped);
+    return 0;
+}
+
+static int rec(const char *in, const char *out){
+    std::vector<uint8_t> bytes;
+    std::vector<RecordFrame> fr;
+    size_t bad = 0;
+    if (!readFile(in, bytes)){
+        fprintf(stderr, "convert: cannot read %s\n", in);
+        return 2;
+    }
+    parseRecording(bytes.data(), bytes.size(), fr, &bad);
+
+    size_t n = fr.size();
+    std::vector<uint32_t> t(n), encL(n), encR(n), spinL(n), spinR(n);
+    std::vector<uint16_t> frames(n*REC_SENSORS), pwmL(n), pwmR(n), dirL(n), dirR(n), slpL(n), slpR(n);
+    for (size_t k=0; k<n; k++){
+        t[k] = fr[k].t_us;
+        memcpy(&frames[k*REC_SENSORS], fr[k].sensor, sizeof(fr[k].sensor));
+        pwmL[k] = fr[k].PWML;
+        pwmR[k] = fr[k].PWMR;
+        dirL[k] = fr[k].DIR_L;
+        dirR[k] = fr[k].DIR_R;
+        slpL[k] = fr[k].nSLPL;
+        slpR[k] = fr[k].nSLPR;
+        encL[k] = fr[k].encL;
+        encR[k] = fr[k].encR;
+        spinL[k] = fr[k].spinL;
+        spinR[k] = fr[k].spinR;
+    }
+
+    ColWriter w(KIND_RUN);
+    w.add("t_us", t);
+    addSensors(w, frames);
+    w.add("pwmL", pwmL);
+    w.add("pwmR", pwmR);
+    w.add("dirL", dirL);
+    w.add("dirR", dirR);
+    w.add("slpL", slpL);
+    w.add("slpR", slpR);
+    w.add("encL", encL);
+    w.add("encR", encR);
+    w.add("spinL", spinL);
+    w.add("spinR", spinR);
+    if (!w.write(out)){
+        fprintf(stderr, "convert: cannot write %s\n", out);
+        return 2;
+    }
+    printf("%zu frames, %zu bad checksums\n", n, bad);
+    return 0;
+}
+
+template<class T>
+static void range(const T *v, uint64_t n, double &lo, double &hi){
+    lo = hi = n ? v[0] : 0;
+    for (uint64_t i=1; i<n; i++){
+        if (v[i] < lo) lo = v[i];
+        if (v[i] > hi) hi = v[i];
+    }
+}
+
+static int info(const char *in){
+    ColFile f;
+    if (!f.open(in)){
+        fprintf(stderr, "convert: %s: %s\n", in, f.error().c_str());
+        return 2;
+    }
+    const char *kind = f.kind() == KIND_TRACK ? "track" : f.kind() == KIND_MODEL ? "model" : "run";
+    printf("%s, %llu rows\n", kind, (unsigned long long)f.rows());
+    for (uint32_t i=0; i<f.columns(); i++){
+        const ColEntry &e = f.entry(i);
+        double lo = 0, hi = 0;
+        switch (e.type){
+            case COL_U16: range(f.column<uint16_t>(e.name), f.rows(), lo, hi); break;
+            case COL_U32: range(f.column<uint32_t>(e.name), f.rows(), lo, hi); break;
+            case COL_F32: range(f.column<float>(e.name), f.rows(), lo, hi); break;
+            case COL_F64: range(f.column<double>(e.name), f.rows(), lo, hi); break;
+        }
+        printf("  %-10s [%g, %g]\n", e.name, lo, hi);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv){
+    if (argc == 3 && strcmp(argv[1], "info") == 0) return info(argv[2]);
+    if (argc == 4 && strcmp(argv[1], "track") == 0) return track(argv[2], argv[3]);
+    if (argc == 4 && strcmp(argv[1], "json") == 0) return json(argv[2], argv[3]);
+    if (argc == 4 && strcmp(argv[1], "rec") == 0) return rec(argv[2], argv[3]);
+    fprintf(stderr, "usage: convert track|json|rec in out | convert info file\n");
+    return 2;
+}
@@ -0,0 +1,412 @@
+//Multi-car telemetry ingest.
+//
+//One epoll thread reads every serial/pty stream and hands raw chunks to a
+//small pool of decode workers; each stream is pinned to one worker so its
+//frames stay in order. Workers decode the BufferIO framed sensor payloads
+//(telemetry.h) and fan the frames out through single producer/single
+//consumer queues to a recorder and a live view, which keeps the streaming
+//aggregates from aggregate.h a plotter queries. Nothing blocks on a full
+//queue: the chunk or frame is dropped and counted against its stream.
+//
+//Build:
+//  g++ -O2 -std=gnu++17 -pthread -IhostTools/shim hostTools/ingest.cpp -o ingest
+//
+//Usage:
+//  ingest [-w workers] [-b baud] [-t seconds] [-o dir] /dev/ttyACM0 ...
+//  ingest --load cars frames_per_s seconds [-w workers] [-o dir]
+//
+//--load creates one pty per car and a thread per car writing frames into it
+//at the given rate, then ingests the pty slaves like real serial ports.
+//With -o every stream is written to dir/car<N>.col (runfile.h format).
+
+#include "../carFirmware/src/control/pos.h"
+#include "aggregate.h"
+#include "spsc.h"
+#include "telemetry.h"
+#include "runfile.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+const int CHUNK = 256;
+const size_t CHUNK_QUEUE = 4096;
+const size_t FRAME_QUEUE = 16384;
+
+enum Consumer { RECORDER, VIEW, CONSUMERS };
+
+struct Chunk{
+    uint32_t stream;
+    uint16_t len;
+    uint64_t t_us;
+    uint8_t data[CHUNK];
+};
+
+struct Stream{
+    std::string name;
+    int fd = -1;
+    TelemetryFramer framer; //only touched by the stream's worker
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> malformed{0};
+    std::atomic<uint64_t> chunkDrops{0}; //reader to worker queue full
+    std::atomic<uint64_t> frameDrops{0}; //worker to consumer queue full
+    std::atomic<uint64_t> sent{0}; //frames written by the --load emitter
+    std::atomic<uint64_t> linkDrops{0}; //frames the emitter could not write
+};
+
+static std::vector<Stream *> streams;
+static std::atomic<bool> readingDone(false);
+static std::atomic<bool> decodingDone(false);
+static volatile sig_atomic_t interrupted = 0;
+
+static uint64_t nowUs(){
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void onSignal(int){
+    interrupted = 1;
+}
+
+static speed_t baudFlag(long baud){
+    switch (baud){
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+    }
+    return B9600;
+}
+
+//Open a serial port or pty slave raw and non blocking
+static int openStream(const char *path, long baud){
+    int fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) return -1;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0){
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baudFlag(baud));
+        cfsetospeed(&tio, baudFlag(baud));
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static void reader(std::vector<SpscQueue<Chunk> *> &work, std::atomic<bool> &stop){
+    int ep = epoll_create1(0);
+    for (size_t i=0; i<streams.size(); i++){
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, streams[i]->fd, &ev);
+    }
+    struct epoll_event ready[64];
+    Chunk c;
+    while (!stop){
+        int n = epoll_wait(ep, ready, 64, 50);
+        for (int k=0; k<n; k++){
+            uint32_t id = ready[k].data.u32;
+            Stream &s = *streams[id];
+            while (true){
+                ssize_t got = read(s.fd, c.data, CHUNK);
+                if (got <= 0){
+                    if (got == 0 || (errno != EAGAIN && errno != EINTR)) epoll_ctl(ep, EPOLL_CTL_DEL, s.fd, 0);
+                    break;
+                }
+                c.stream = id;
+                c.len = got;
+                c.t_us = nowUs();
+                s.bytes += got;
+                if (!work[id % work.size()]->push(c)) s.chunkDrops++;
+                if (got < CHUNK) break;
+            }
+        }
+    }
+    close(ep);
+    readingDone = true;
+}
+
+static void worker(SpscQueue<Chunk> &in, std::vector<SpscQueue<SensorFrame> *> &out){
+    Chunk c;
+    while (true){
+        if (!in.pop(c)){
+            if (readingDone && in.size() == 0) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        Stream &s = *streams[c.stream];
+        unsigned long bad = s.framer.malformed;
+        s.framer.feed(c.data, c.len, [&](const TelemetryValues &v){
+            SensorFrame f;
+            f.stream = c.stream;
+            f.t_us = c.t_us;
+            memcpy(f.sensor, v.sensor, sizeof(f.sensor));
+            s.frames++;
+            for (size_t q=0; q<out.size(); q++){
+                if (!out[q]->push(f)) s.frameDrops++;
+            }
+        });
+        s.malformed += s.framer.malformed - bad;
+    }
+}
+
+//Drain one consumer's queues, one queue per worker
+template<class F>
+static void consume(std::vector<SpscQueue<SensorFrame> *> &in, F handle){
+    SensorFrame f;
+    while (true){
+        bool any = false;
+        for (size_t w=0; w<in.size(); w++){
+            while (in[w]->pop(f)){
+                handle(f);
+                any = true;
+            }
+        }
+        if (!any){
+            if (decodingDone) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+//Live view of one stream: every sensor channel plus the line position error
+struct View{
+    SensorFrame latest;
+    std::vector<Channel> channels;
+
+    View(){
+        for (int i=0; i<TELEMETRY_SENSORS; i++) channels.emplace_back("sensor" + std::to_string(i));
+        channels.emplace_back("err");
+    }
+
+    void add(const SensorFrame &f){
+        latest = f;
+        for (int i=0; i<TELEMETRY_SENSORS; i++) channels[i].add(f.t_us, f.sensor[i]);
+        uint16_t v[TELEMETRY_SENSORS];
+        memcpy(v, f.sensor, sizeof(v));
+        channels[TELEMETRY_SENSORS].add(f.t_us, posFind(v) - LINE_CENTRE);
+    }
+};
+
+//Frames kept per stream for -o
+struct Recording{
+    std::vector<uint32_t> t;
+    std::vector<uint16_t> sensor[TELEMETRY_SENSORS];
+};
+
+static bool writeRecording(const Recording &r, const std::string &path){
+    ColWriter w(KIND_RUN);
+    w.add("t_us", r.t);
+    for (int i=0; i<TELEMETRY_SENSORS; i++){
+        char name[16];
+        snprintf(name, sizeof(name), "sensor%d", i);
+        w.add(name, r.sensor[i]);
+    }
+    return w.write(path.c_str());
+}
+
+//Load test source: writes frames for one car into a pty master. A frame the
+//pty only takes part of is finished before the next one is written, a
+//frame that finds the pty full or still busy with the last one is dropped
+static void emitter(int master, Stream &s, double rate, double seconds, std::atomic<bool> &stop){
+    uint64_t start = nowUs();
+    uint64_t due = 0;
+    char buf[160];
+    std::string rest; //unwritten end of a partly written frame
+    auto flush = [&]{
+        ssize_t put = write(master, rest.data(), rest.size());
+        if (put > 0) rest.erase(0, put);
+        if (put > 0 && rest.empty()) s.sent++;
+    };
+    while (!stop && !interrupted){
+        double elapsed = (nowUs() - start)/1e6;
+        if (elapsed >= seconds) break;
+        uint64_t target = elapsed*rate;
+        for (; due < target; due++){
+            if (!rest.empty()) flush();
+            if (!rest.empty()){
+                s.linkDrops++;
+                continue;
+            }
+            double pos = LINE_CENTRE + 3*sin(due*0.01);
+            int n = snprintf(buf, sizeof(buf), "SSSSSSSSSS{\"sensor\":[");
+            for (int i=0; i<TELEMETRY_SENSORS; i++){
+                double d = i + 1 - pos;
+                n += snprintf(buf + n, sizeof(buf) - n, "%d%s", (int)(200 + 2300*exp(-d*d)), i + 1 < TELEMETRY_SENSORS ? "," : "");
+            }
+            n += snprintf(buf + n, sizeof(buf) - n, "]}EEEEEEEEEE");
+            ssize_t put = write(master, buf, n);
+            if (put == n) s.sent++;
+            else if (put > 0) rest.assign(buf + put, n - put);
+            else s.linkDrops++;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    //finish a torn last frame while the reader is still draining
+    for (int tries=0; !rest.empty() && tries<100; tries++){
+        flush();
+        if (!rest.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!rest.empty()) s.linkDrops++;
+}
+
+static void report(double secs, bool load, const std::vector<View> &views){
+    printf("%-14s %10s %10s %10s %8s %8s %8s", "stream", "bytes", "frames", "frames/s", "bad", "qdrop", "fdrop");
+    if (load) printf(" %10s %8s %8s", "sent", "linkdrop", "lost");
+    printf("\n");
+    for (Stream *s : streams){
+        uint64_t frames = s->frames;
+        printf("%-14s %10llu %10llu %10.0f %8llu %8llu %8llu", s->name.c_str(),
+               (unsigned long long)s->bytes, (unsigned long long)frames, frames/secs,
+               (unsigned long long)s->malformed, (unsigned long long)s->chunkDrops, (unsigned long long)s->frameDrops);
+        if (load){
+            uint64_t sent = s->sent;
+            printf(" %10llu %8llu %8lld", (unsigned long long)sent, (unsigned long long)s->linkDrops,
+                   (long long)sent - (long long)frames);
+        }
+        printf("\n");
+    }
+    for (size_t i=0; i<streams.size(); i++){
+        if (!streams[i]->frames) continue;
+        const RollingStats &err = views[i].channels[TELEMETRY_SENSORS].window;
+        printf("%-14s last", streams[i]->name.c_str());
+        for (int k=0; k<TELEMETRY_SENSORS; k++) printf(" %u", views[i].latest.sensor[k]);
+        printf(", err mean %.3f sd %.3f range [%.3f, %.3f]\n", err.mean(), err.stddev(), err.min(), err.max());
+    }
+}
+
+int main(int argc, char **argv){
+    int workers = 2;
+    long baud = 9600;
+    double seconds = 0;
+    const char *outDir = 0;
+    int cars = 0;
+    double rate = 0;
+    std::vector<const char *> paths;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        if (a == "-w" && i + 1 < argc) workers = atoi(argv[++i]);
+        else if (a == "-b" && i + 1 < argc) baud = atol(argv[++i]);
+        else if (a == "-t" && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (a == "-o" && i + 1 < argc) outDir = argv[++i];
+        else if (a == "--load" && i + 3 < argc){
+            cars = atoi(argv[++i]);
+            rate = atof(argv[++i]);
+            seconds = atof(argv[++i]);
+        }
+        else paths.push_back(argv[i]);
+    }
+    if (workers < 1) workers = 1;
+    if ((cars <= 0) == paths.empty()){
+        fprintf(stderr, "usage: ingest [-w workers] [-b baud] [-t seconds] [-o dir] port...\n"
+                        "       ingest --load cars frames_per_s seconds [-w workers] [-o dir]\n");
+        return 2;
+    }
+
+    std::vector<int> masters;
+    size_t ports = paths.size(); //paths after these are pty slaves, strdup'ed
+    for (int c=0; c<cars; c++){
+        int m = posix_openpt(O_RDWR | O_NOCTTY);
+        if (m < 0 || grantpt(m) != 0 || unlockpt(m) != 0){
+            fprintf(stderr, "ingest: cannot create pty\n");
+            return 2;
+        }
+        fcntl(m, F_SETFL, fcntl(m, F_GETFL) | O_NONBLOCK);
+        masters.push_back(m);
+        paths.push_back(strdup(ptsname(m)));
+    }
+    for (size_t i=0; i<paths.size(); i++){
+        Stream *s = new Stream;
+        s->name = cars ? "car" + std::to_string(i) : paths[i];
+        s->fd = openStream(paths[i], baud);
+        if (s->fd < 0){
+            fprintf(stderr, "ingest: cannot open %s\n", paths[i]);
+            return 2;
+        }
+        streams.push_back(s);
+    }
+
+    std::vector<SpscQueue<Chunk> *> work;
+    std::vector<std::vector<SpscQueue<SensorFrame> *> > toConsumer(workers), fromWorker(CONSUMERS);
+    for (int w=0; w<workers; w++){
+        work.push_back(new SpscQueue<Chunk>(CHUNK_QUEUE));
+        for (int c=0; c<CONSUMERS; c++){
+            SpscQueue<SensorFrame> *q = new SpscQueue<SensorFrame>(FRAME_QUEUE);
+            toConsumer[w].push_back(q);
+            fromWorker[c].push_back(q);
+        }
+    }
+
+    signal(SIGINT, onSignal);
+    std::atomic<bool> stop(false);
+    std::vector<Recording> recordings(streams.size());
+    std::vector<View> views(streams.size());
+    uint64_t start = nowUs();
+
+    std::thread read([&]{ reader(work, stop); });
+    std::vector<std::thread> pool;
+    for (int w=0; w<workers; w++) pool.emplace_back([&, w]{ worker(*work[w], toConsumer[w]); });
+    std::thread record([&]{
+        consume(fromWorker[RECORDER], [&](const SensorFrame &f){
+            if (!outDir) return;
+            Recording &r = recordings[f.stream];
+            r.t.push_back(f.t_us - start);
+            for (int i=0; i<TELEMETRY_SENSORS; i++) r.sensor[i].push_back(f.sensor[i]);
+        });
+    });
+    std::thread view([&]{
+        consume(fromWorker[VIEW], [&](const SensorFrame &f){ views[f.stream].add(f); });
+    });
+    std::vector<std::thread> emitters;
+    for (int c=0; c<cars; c++) emitters.emplace_back([&, c]{ emitter(masters[c], *streams[c], rate, seconds, stop); });
+
+    while (!interrupted){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (seconds > 0 && (nowUs() - start)/1e6 >= seconds) break;
+    }
+    for (std::thread &t : emitters) t.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); //let the ptys drain
+    stop = true;
+    read.join();
+    for (std::thread &t : pool) t.join();
+    decodingDone = true;
+    record.join();
+    view.join();
+    double secs = (nowUs() - start)/1e6;
+
+    report(secs, cars > 0, views);
+    if (outDir){
+        for (size_t i=0; i<streams.size(); i++){
+            std::string path = std::string(outDir) + "/car" + std::to_string(i) + ".col";
+            if (!writeRecording(recordings[i], path)) fprintf(stderr, "ingest: cannot write %s\n", path.c_str());
+        }
+    }
+
+    for (Stream *s : streams){
+        close(s->fd);
+        delete s;
+    }
+    for (int m : masters) close(m);
+    for (size_t i=ports; i<paths.size(); i++) free((void *)paths[i]);
+    for (SpscQueue<Chunk> *q : work) delete q;
+    for (std::vector<SpscQueue<SensorFrame> *> &qs : toConsumer){
+        for (SpscQueue<SensorFrame> *q : qs) delete q;
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+//Compression benchmark for packed run recordings.
+//
+//Every frame of each input is packed with the firmware's FramePacker
+//(carFirmware/src/serialtools/pack.h) and the packed stream is decoded
+//again with parseRecording (recording.h), which must give back every frame
+//exactly. Prints the compression ratio, the frames per second the packed
+//stream fits into at 9600 and 115200 baud, the packing time per frame
+//(mean and worst single frame, clock overhead included) and the decoding
+//throughput.
+//
+//Inputs are recordings (raw or packed) and two synthetic runs of the given
+//length: "smooth", the line drifting under the array with sensor noise and
+//the wheels following the PWM, and "noisy", every field random, the worst
+//case for the delta coding that shows the keyframe fallback bounding it.
+//-e corrupts one byte every n bytes of the packed stream and reports how
+//many frames the decoder still recovers.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -IhostTools/shim hostTools/packbench.cpp hostTools/shim/Arduino.cpp -o packbench
+//
+//Usage:
+//  packbench [run.rec ...] [--synth frames] [-k key_every] [-r repeat] [-e n]
+//
+//Exit status is 0 when everything round trips, 1 if not, 2 on error.
+
+#include "../carFirmware/src/serialtools/pack.h"
+#include "recording.h"
+
+#include <chrono>
+#include <math.h>
+#include <string>
+#include <string.h>
+
+static_assert(PACK_KEY_LEN == REC_KEY_LEN, "recording.h out of sync with pack.h");
+static_assert(PACK_FIELDS == REC_FIELDS, "recording.h out of sync with pack.h");
+static_assert(PACK_BODY_LEN + 3 == REC_FRAME_LEN, "recording.h out of sync with pack.h");
+
+struct Options{
+    int keyEvery = PACK_KEY_EVERY;
+    long repeat = 20;
+    long errorEvery = 0;
+};
+
+//splitmix64, so the synthetic runs are the same everywhere
+struct Rng{
+    uint64_t state;
+    explicit Rng(uint64_t seed) : state(seed){}
+    uint32_t next(){
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+        return (uint32_t)((z ^ (z >> 31)) >> 32);
+    }
+};
+
+static void smooth(long n, std::vector<RecordFrame> &frames){
+    Rng rng(1);
+    uint32_t t = 2000000, encL = 0, encR = 0;
+    for (long k=0; k<n; k++){
+        RecordFrame fr;
+        memset(&fr, 0, sizeof(fr));
+        t += 2500 + rng.next() % 200;
+        fr.t_us = t;
+        double pos = 4.5 + 2.5*sin(k*0.004) + 0.3*sin(k*0.05);
+        for (int i=0; i<REC_SENSORS; i++){
+            double d = (i + 1) - pos;
+            fr.sensor[i] = (uint16_t)(180 + 2300*exp(-d*d/0.8) + rng.next() % 40);
+        }
+        double steer = 400*(pos - 4.5);
+        fr.PWML = (uint16_t)(3000 + steer);
+        fr.PWMR = (uint16_t)(3000 - steer);
+        fr.nSLPL = fr.nSLPR = 1;
+        encL += (fr.PWML*3 + rng.next() % 4095)/4095; //PWM_FULLSCALE
+        encR += (fr.PWMR*3 + rng.next() % 4095)/4095;
+        fr.encL = encL;
+        fr.encR = encR;
+        frames.push_back(fr);
+    }
+}
+
+static void noisy(long n, std::vector<RecordFrame> &frames){
+    Rng rng(2);
+    for (long k=0; k<n; k++){
+        RecordFrame fr;
+        fr.t_us = rng.next();
+        for (int i=0; i<REC_SENSORS; i++) fr.sensor[i] = rng.next();
+        fr.encL = rng.next();
+        fr.encR = rng.next();
+        fr.spinL = rng.next();
+        fr.spinR = rng.next();
+        fr.nSLPL = rng.next();
+        fr.nSLPR = rng.next();
+        fr.DIR_L = rng.next();
+        fr.DIR_R = rng.next();
+        fr.PWML = rng.next();
+        fr.PWMR = rng.next();
+        frames.push_back(fr);
+    }
+}
+
+static bool same(const RecordFrame &a, const RecordFrame &b){
+    std::vector<uint8_t> x, y;
+    writeFrame(a, x);
+    writeFrame(b, y);
+    return x == y;
+}
+
+static bool bench(const char *name, const std::vector<RecordFrame> &frames, const Options &o){
+    typedef std::chrono::steady_clock Clock;
+    size_t n = frames.size();
+    std::vector<uint8_t> raw;
+    raw.reserve(n*REC_FRAME_LEN);
+    for (size_t k=0; k<n; k++) writeFrame(frames[k], raw);
+
+    //pack, timing every frame for the worst case
+    std::vector<uint8_t> packed;
+    packed.reserve(raw.size());
+    FramePacker packer(o.keyEvery);
+    double worst = 0;
+    size_t keys = 0, longest = 0;
+    for (size_t k=0; k<n; k++){
+        Clock::time_point a = Clock::now();
+        const uint8_t *p = packer.pack(raw.data() + k*REC_FRAME_LEN);
+        Clock::time_point b = Clock::now();
+        double ns = std::chrono::duration<double, std::nano>(b - a).count();
+        if (ns > worst) worst = ns;
+        packed.insert(packed.end(), p, p + packer.length());
+        if (p[1] & PACK_SYNC_KEY) keys++;
+        if (packer.length() > longest) longest = packer.length();
+    }
+
+    //pack again untimed per frame for the mean
+    Clock::time_point a = Clock::now();
+    size_t sink = 0;
+    for (long r=0; r<o.repeat; r++){
+        FramePacker again(o.keyEvery);
+        for (size_t k=0; k<n; k++){
+            again.pack(raw.data() + k*REC_FRAME_LEN);
+            sink += again.length();
+        }
+    }
+    double packSecs = std::chrono::duration<double>(Clock::now() - a).count();
+    if (sink != packed.size()*o.repeat) return false;
+
+    std::vector<RecordFrame> back;
+    back.reserve(n);
+    a = Clock::now();
+    for (long r=0; r<o.repeat; r++){
+        back.clear();
+        parseRecording(packed.data(), packed.size(), back);
+    }
+    double decodeSecs = std::chrono::duration<double>(Clock::now() - a).count();
+
+    size_t first = n; //first frame that did not come back
+    for (size_t k=0; k<n && k<back.size(); k++){
+        if (!same(back[k], frames[k])){
+            first = k;
+            break;
+        }
+    }
+    bool wrong = back.size() != n || first < n;
+
+    double perFrame = packed.size()/(double)n;
+    printf("%s: %zu frames, %zu -> %zu bytes, ratio %.2f, %.1f B/frame (longest %zu, %zu keyframes)\n",
+           name, n, raw.size(), packed.size(), raw.size()/(double)packed.size(), perFrame, longest, keys);
+    printf("  fits %.0f frames/s at 9600 baud, %.0f at 115200 (raw %.0f, %.0f)\n",
+           960/perFrame, 11520/perFrame, 960.0/REC_FRAME_LEN, 11520.0/REC_FRAME_LEN);
+    printf("  pack %.0f ns/frame, worst %.0f ns; decode %.0f MB/s packed, %.1f M frames/s\n",
+           packSecs*1e9/(n*o.repeat), worst, packed.size()*o.repeat/decodeSecs/1e6, n*o.repeat/decodeSecs/1e6);
+    if (wrong){
+        printf("  round trip FAILED: %zu of %zu frames decoded, first difference at %zu\n", back.size(), n, first);
+        return false;
+    }
+
+    if (o.errorEvery > 0){
+        std::vector<uint8_t> hit = packed;
+        size_t flips = 0;
+        for (size_t i=o.errorEvery/2; i<hit.size(); i+=o.errorEvery){
+            hit[i] ^= 0x5A;
+            flips++;
+        }
+        std::vector<RecordFrame> got;
+        size_t bad = 0, lost = 0;
+        parseRecording(hit.data(), hit.size(), got, &bad, &lost);
+        printf("  %zu corrupted bytes: %zu frames recovered (%.1f%%), %zu bad checksums, %zu lost to resync\n",
+               flips, got.size(), 100.0*got.size()/n, bad, lost);
+    }
+    return true;
+}
+
+int main(int argc, char **argv){
+    Options o;
+    long synth = 0;
+    std::vector<const char *> paths;
+    bool bad = false;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "--synth" && more) synth = atol(argv[++i]);
+        else if (a == "-k" && more) o.keyEvery = atoi(argv[++i]);
+        else if (a == "-r" && more) o.repeat = atol(argv[++i]);
+        else if (a == "-e" && more) o.errorEvery = atol(argv[++i]);
+        else if (a[0] == '-') bad = true;
+        else paths.push_back(argv[i]);
+    }
+    if (bad || (paths.empty() && synth <= 0) || o.keyEvery < 1 || o.keyEvery > 255 || o.repeat < 1){
+        fprintf(stderr, "usage: packbench [run.rec ...] [--synth frames] [-k key_every] [-r repeat] [-e n]\n");
+        return 2;
+    }
+
+    bool ok = true;
+    for (const char *path : paths){
+        std::vector<uint8_t> bytes;
+        std::vector<RecordFrame> frames;
+        if (!readFile(path, bytes) || !parseRecording(bytes.data(), bytes.size(), frames)){
+            fprintf(stderr, "packbench: no frames in %s\n", path);
+            return 2;
+        }
+        ok &= bench(path, frames, o);
+    }
+    if (synth > 0){
+        std::vector<RecordFrame> frames;
+        smooth(synth, frames);
+        ok &= bench("smooth", frames, o);
+        frames.clear();
+        noisy(synth, frames);
+        ok &= bench("noisy", frames, o);
+    }
+    return ok ? 0 : 1;
+}
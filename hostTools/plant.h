@@ -0,0 +1,342 @@
+//Physics level model of the car for host simulation.
+//
+//QtrModel turns sensor height, floor and line reflectance, line geometry
+//and emitter state into the RC discharge time of each QTR channel, the
+//value QTRSensors::readPrivate measures. Each phototransistor sees a
+//gaussian spot of floor whose width grows with height; the line covers a
+//fraction of the spot and the collected light scales with the emitter
+//current and falls with the square of the height. The sense capacitor
+//discharges through the photocurrent, so the time is charge/current,
+//saturating at the read timeout. With saturation set the phototransistor
+//current levels off as the light grows, the way a glossy floor or a low
+//mount blinds the array at full brightness: white still reads whiteUs but
+//the line comes closer to it.
+//
+//MotorModel is a first order DC motor: duty (with a deadband) sets a
+//target wheel speed and the wheel approaches it with time constant tau and
+//a bounded acceleration. Plant puts both on a differential drive car
+//following a Track (track.h), a MotorModel per wheel so the two can differ,
+//and counts encoder edges as the wheels turn.
+//
+//saveModel() and loadModel() keep the car's parameters in a model file
+//(runfile.h, KIND_MODEL), one row with a column per parameter, which
+//hostTools/sysid.cpp fits from recorded runs and sim -m loads.
+//
+//Lengths are in track units (cm for simulation/track.csv), time in seconds
+//unless the name says _us.
+#pragma once
+
+#include "track.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static inline double normalCdf(double x){ return 0.5*erfc(-x*M_SQRT1_2); }
+
+//Fraction of a gaussian spot at offset d inside a band of width w,
+//exact 0 or 1 more than 6 sigma from an edge
+static inline double spotInBand(double d, double w, double sigma){
+    double a = fabs(d), edge = 6*sigma;
+    if (a > w/2 + edge) return 0;
+    if (a < w/2 - edge) return 1;
+    return normalCdf((d + w/2)/sigma) - normalCdf((d - w/2)/sigma);
+}
+
+struct QtrModel{
+    int channels = 8;
+    double pitch = 0.95; //between channel centres
+    double ahead = 7; //array centre in front of the axle
+    double height = 0.3; //above the floor
+    double nominalHeight = 0.3; //height the spot and gain are specified at
+    double spot = 0.25; //gaussian sigma of the seen spot at nominalHeight
+    double floorReflectance = 0.85;
+    double lineReflectance = 0.05;
+    double lineWidth = 1.9; //3/4 inch tape
+    double dark = 0.01; //ambient photocurrent relative to a lit white floor
+    double whiteUs = 220; //discharge time over white floor at nominalHeight
+    double timeoutUs = 2500;
+    double noise = 0.02; //relative standard deviation of each reading
+    double saturation = 0; //light at which the photocurrent levels off, 0 for none
+
+    //Photocurrent for the light collected, relative to a lit white floor
+    double sensed(double lit) const {
+        return saturation > 0 ? saturation*(1 - exp(-lit/saturation)) : lit;
+    }
+
+    //Discharge time for a channel seeing `coverage` (0..1) of line, light is
+    //the emitter current relative to full brightness, 0 with them off
+    double dischargeUs(double coverage, double light, double gauss) const {
+        double r = floorReflectance + (lineReflectance - floorReflectance)*coverage;
+        double h = nominalHeight/height;
+        double lit = sensed(light*r*h*h);
+        double charge = whiteUs*(dark + sensed(floorReflectance));
+        double t = charge/(dark + lit)*(1 + noise*gauss);
+        if (t < 0) t = 0;
+        return t < timeoutUs ? t : timeoutUs;
+    }
+
+    //Width of the seen spot at the current height
+    double sigma() const { return spot*height/nominalHeight; }
+
+    //Across the array from its centre, positive to the left, of channel i
+    double offset(int i) const { return (i - (channels - 1)/2.0)*pitch; }
+
+    //Noise free discharge time of channel i with the line's centre at
+    //lateral (same sense as offset()) and nothing else under the array
+    double lineUs(int i, double lateral, double light = 1) const {
+        return dischargeUs(spotInBand(offset(i) - lateral, lineWidth, sigma()), light, 0);
+    }
+};
+
+struct MotorModel{
+    double wheelRadius = 3.25;
+    double maxSpeed = 28.6; //rad/s at full duty
+    double tau = 0.05; //s
+    double maxAccel = 400; //rad/s^2
+    double deadband = 0.08; //duty below which the wheel does not turn
+    double coastTau = 0.15; //s, with the driver asleep
+
+    //Speed after dt with signed duty in [-1, 1]
+    double step(double omega, double duty, bool awake, double dt) const {
+        double target = 0, t = coastTau;
+        if (awake){
+            double mag = fabs(duty);
+            if (mag > 1) mag = 1;
+            mag = mag > deadband ? (mag - deadband)/(1 - deadband) : 0;
+            target = (duty < 0 ? -mag : mag)*maxSpeed;
+            t = tau;
+        }
+        double next = target + (omega - target)*exp(-dt/t);
+        double limit = maxAccel*dt;
+        if (next > omega + limit) next = omega + limit;
+        if (next < omega - limit) next = omega - limit;
+        return next;
+    }
+};
+
+//Motor driver inputs for one wheel
+struct WheelInput{
+    double duty = 0; //0..1
+    bool reverse = false;
+    bool awake = true;
+};
+
+//Where a point lies relative to the track
+struct TrackPoint{
+    size_t index; //segment start
+    double s; //arc length of the projection
+    double lateral; //signed distance, positive left of the direction of travel
+    double distance; //unsigned distance to the polyline
+};
+
+class Plant{
+private:
+    const Track &track;
+    std::vector<double> bars; //arc lengths of cross lines
+    std::vector<double> gaps; //unpainted stretches, start and end arc lengths in order
+    double barWidth = 1.9;
+    double barSpan = 12; //half the bar each side of the line
+
+    size_t hint = 0; //segment near the car, carried between calls
+    double encAccL = 0, encAccR = 0; //fractional encoder counts
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+    double gauss(){
+        //Irwin-Hall approximation, cheap and deterministic
+        double sum = 0;
+        for (int i=0; i<4; i++){
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            sum += (rng >> 11)*(1.0/9007199254740992.0);
+        }
+        return (sum - 2)*1.7320508075688772;
+    }
+
+    double segmentDistance2(size_t k, double px, double py, double &f) const {
+        double ax = track.x[k], ay = track.y[k];
+        double dx = track.x[k + 1] - ax, dy = track.y[k + 1] - ay;
+        double len2 = dx*dx + dy*dy;
+        f = len2 > 0 ? ((px - ax)*dx + (py - ay)*dy)/len2 : 0;
+        if (f < 0) f = 0;
+        if (f > 1) f = 1;
+        double ex = ax + f*dx - px, ey = ay + f*dy - py;
+        return ex*ex + ey*ey;
+    }
+
+public:
+    QtrModel qtr;
+    MotorModel motorL, motorR;
+    double wheelBase = 10.5;
+    double countsPerRev = 360;
+
+    //State
+    double x = 0, y = 0, heading = 0;
+    double omegaL = 0, omegaR = 0; //wheel speeds, rad/s
+    uint32_t countL = 0, countR = 0; //encoder edges, both directions count up
+    double time = 0;
+    bool emitters = true;
+    double brightness = 1; //emitter current relative to full, set by dimming
+
+    explicit Plant(const Track &t) : track(t){}
+
+    //Cross lines at these arc lengths, e.g. both ends of the track
+    void addBar(double s){ bars.push_back(s); }
+
+    //No line between arc lengths s0 and s1, added in order along the track
+    void addGap(double s0, double s1){
+        gaps.push_back(s0);
+        gaps.push_back(s1);
+    }
+
+    //True if arc length s is in a gap
+    bool inGap(double s) const {
+        size_t k = std::upper_bound(gaps.begin(), gaps.end(), s) - gaps.begin();
+        return k % 2 == 1;
+    }
+
+    //Put the car on the track at arc length s, facing along it
+    void place(double s, bool backwards = false){
+        size_t k = track.index(s);
+        x = track.x[k];
+        y = track.y[k];
+        heading = track.heading[k] + (backwards ? M_PI : 0);
+        omegaL = omegaR = 0;
+        hint = k;
+    }
+
+    //Nearest point of the track, searched from hint by walking downhill so
+    //consecutive queries near each other cost a few segments
+    TrackPoint locate(double px, double py, size_t &from) const {
+        TrackPoint tp = {0, 0, 0, 0};
+        size_t n = track.size();
+        if (n < 2) return tp;
+        size_t k = from < n - 1 ? from : n - 2;
+        double f, best = segmentDistance2(k, px, py, f), g;
+        while (k + 2 < n && segmentDistance2(k + 1, px, py, g) < best){
+            k++;
+            best = segmentDistance2(k, px, py, f);
+        }
+        while (k > 0 && segmentDistance2(k - 1, px, py, g) < best){
+            k--;
+            best = segmentDistance2(k, px, py, f);
+        }
+        from = k;
+        double dx = track.x[k + 1] - track.x[k], dy = track.y[k + 1] - track.y[k];
+        double cross = dx*(py - track.y[k]) - dy*(px - track.x[k]);
+        tp.index = k;
+        tp.s = track.s[k] + f*track.ds;
+        tp.distance = sqrt(best);
+        tp.lateral = cross < 0 ? -tp.distance : tp.distance;
+        return tp;
+    }
+
+    //Car centre relative to the track
+    TrackPoint where(){ return locate(x, y, hint); }
+
+    //Line coverage of the spot under a point on the floor
+    double coverage(double px, double py, size_t &from) const {
+        TrackPoint tp = locate(px, py, from);
+        double sigma = qtr.sigma();
+        double c = gaps.empty() || !inGap(tp.s) ? spotInBand(tp.distance, qtr.lineWidth, sigma) : 0;
+        for (double b : bars){
+            if (fabs(tp.lateral) > barSpan) continue;
+            c += spotInBand(tp.s - b, barWidth, sigma);
+        }
+        return c < 1 ? c : 1;
+    }
+
+    //Discharge time of every channel for the current pose, channel 0 on the
+    //right of the direction of travel like sensor pin 65 on the car
+    void sense(double *us){
+        double cx = x + qtr.ahead*cos(heading), cy = y + qtr.ahead*sin(heading);
+        double lx = -sin(heading), ly = cos(heading); //unit vector to the left
+        locate(cx, cy, hint);
+        size_t from = hint;
+        for (int i=0; i<qtr.channels; i++){
+            double o = qtr.offset(i);
+            double c = coverage(cx + o*lx, cy + o*ly, from);
+            us[i] = qtr.dischargeUs(c, emitters ? brightness : 0, gauss());
+        }
+    }
+
+    //Advance dt seconds with the given driver inputs
+    void step(const WheelInput &l, const WheelInput &r, double dt){
+        double oL = omegaL, oR = omegaR;
+        omegaL = motorL.step(omegaL, l.reverse ? -l.duty : l.duty, l.awake, dt);
+        omegaR = motorR.step(omegaR, r.reverse ? -r.duty : r.duty, r.awake, dt);
+        //trapezoid over the step for the distance each wheel rolled
+        double dl = 0.5*(oL + omegaL)*dt, dr = 0.5*(oR + omegaR)*dt;
+        double sl = dl*motorL.wheelRadius, sr = dr*motorR.wheelRadius;
+        double ds = 0.5*(sl + sr), dth = (sr - sl)/wheelBase;
+        double mid = heading + 0.5*dth;
+        x += ds*cos(mid);
+        y += ds*sin(mid);
+        heading += dth;
+
+        encAccL += fabs(dl)*countsPerRev/(2*M_PI);
+        encAccR += fabs(dr)*countsPerRev/(2*M_PI);
+        uint32_t el = (uint32_t)encAccL, er = (uint32_t)encAccR;
+        countL += el;
+        countR += er;
+        encAccL -= el;
+        encAccR -= er;
+        time += dt;
+    }
+
+    double speed() const { return 0.5*(omegaL*motorL.wheelRadius + omegaR*motorR.wheelRadius); }
+};
+
+//Parameters a model file holds, the motor ones once per wheel with L or R
+//after the name
+template<class T>
+struct ModelField{
+    const char *name;
+    double T::*value;
+};
+const ModelField<MotorModel> MOTOR_FIELDS[] = {
+    {"wheelRadius", &MotorModel::wheelRadius}, {"maxSpeed", &MotorModel::maxSpeed}, {"tau", &MotorModel::tau},
+    {"maxAccel", &MotorModel::maxAccel}, {"deadband", &MotorModel::deadband}, {"coastTau", &MotorModel::coastTau},
+};
+const ModelField<QtrModel> QTR_FIELDS[] = {
+    {"pitch", &QtrModel::pitch}, {"ahead", &QtrModel::ahead}, {"height", &QtrModel::height},
+    {"nominalHeight", &QtrModel::nominalHeight}, {"spot", &QtrModel::spot},
+    {"floorReflectance", &QtrModel::floorReflectance}, {"lineReflectance", &QtrModel::lineReflectance},
+    {"lineWidth", &QtrModel::lineWidth}, {"dark", &QtrModel::dark}, {"whiteUs", &QtrModel::whiteUs},
+    {"timeoutUs", &QtrModel::timeoutUs}, {"noise", &QtrModel::noise}, {"saturation", &QtrModel::saturation},
+};
+const ModelField<Plant> PLANT_FIELDS[] = {
+    {"wheelBase", &Plant::wheelBase}, {"countsPerRev", &Plant::countsPerRev},
+};
+
+//Call f(name, value) for every parameter of p
+template<class F>
+void eachModelField(Plant &p, F f){
+    for (const ModelField<MotorModel> &m : MOTOR_FIELDS){
+        f(std::string(m.name) + "L", p.motorL.*m.value);
+        f(std::string(m.name) + "R", p.motorR.*m.value);
+    }
+    for (const ModelField<QtrModel> &q : QTR_FIELDS) f(std::string(q.name), p.qtr.*q.value);
+    for (const ModelField<Plant> &c : PLANT_FIELDS) f(std::string(c.name), p.*c.value);
+}
+
+inline bool saveModel(Plant &p, const char *path){
+    ColWriter w(KIND_MODEL);
+    eachModelField(p, [&](const std::string &name, double &v){ w.add(name.c_str(), std::vector<double>(1, v)); });
+    return w.write(path);
+}
+
+//Load a model file into p. Parameters the file does not have keep their
+//values, so a file can hold just the ones that were measured.
+inline bool loadModel(const char *path, Plant &p){
+    ColFile f;
+    if (!f.open(path) || f.kind() != KIND_MODEL || f.rows() != 1) return false;
+    eachModelField(p, [&](const std::string &name, double &v){
+        const double *col = f.column<double>(name.c_str());
+        if (col) v = col[0];
+    });
+    return true;
+}
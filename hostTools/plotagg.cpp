@@ -0,0 +1,103 @@
+//Streams a run through the per channel aggregators in aggregate.h and
+//answers a plot query, the way a live plotter would use them.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 hostTools/plotagg.cpp -o plotagg
+//
+//Usage:
+//  plotagg run.col [-c channel] [-p pixels] [-r t0 t1] [-w window]
+//
+//Every column of the run (and err = pos - LINE_CENTRE, telemetry.h, when
+//pos is present) is fed sample by sample, indexed by t_us or by row if the
+//run has no timestamps. Prints the rolling window statistics of each
+//channel, then, for -c, one csv line per pixel (t0,t1,min,max,mean,n) over
+//the range -r (default all).
+
+#include "aggregate.h"
+#include "runfile.h"
+#include "telemetry.h"
+
+#include <chrono>
+#include <stdlib.h>
+
+template<class T>
+static void feed(Channel &c, const T *v, const uint32_t *t, uint64_t rows){
+    for (uint64_t i=0; i<rows; i++) c.add(t ? t[i] : i, v[i]);
+}
+
+int main(int argc, char **argv){
+    const char *path = 0;
+    std::string want;
+    size_t pixels = 80, window = 256;
+    bool ranged = false;
+    uint64_t r0 = 0, r1 = 0;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        if (a == "-c" && i + 1 < argc) want = argv[++i];
+        else if (a == "-p" && i + 1 < argc) pixels = atol(argv[++i]);
+        else if (a == "-w" && i + 1 < argc) window = atol(argv[++i]);
+        else if (a == "-r" && i + 2 < argc){
+            ranged = true;
+            r0 = strtoull(argv[++i], 0, 10);
+            r1 = strtoull(argv[++i], 0, 10);
+        }
+        else path = argv[i];
+    }
+    ColFile f;
+    if (!path || !f.open(path)){
+        fprintf(stderr, "usage: plotagg run.col [-c channel] [-p pixels] [-r t0 t1] [-w window]\n");
+        if (path) fprintf(stderr, "plotagg: %s: %s\n", path, f.error().c_str());
+        return 2;
+    }
+
+    const uint32_t *t = f.column<uint32_t>("t_us");
+    uint64_t rows = f.rows();
+    std::vector<Channel> channels;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i=0; i<f.columns(); i++){
+        const ColEntry &e = f.entry(i);
+        if (std::string(e.name) == "t_us") continue;
+        channels.emplace_back(e.name, window);
+        Channel &c = channels.back();
+        switch (e.type){
+            case COL_U16: feed(c, f.column<uint16_t>(e.name), t, rows); break;
+            case COL_U32: feed(c, f.column<uint32_t>(e.name), t, rows); break;
+            case COL_F32: feed(c, f.column<float>(e.name), t, rows); break;
+            case COL_F64: feed(c, f.column<double>(e.name), t, rows); break;
+        }
+    }
+    if (const float *pos = f.column<float>("pos")){
+        channels.emplace_back("err", window);
+        for (uint64_t i=0; i<rows; i++) channels.back().add(t ? t[i] : i, pos[i] - LINE_CENTRE);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%zu channels x %llu samples in %.3f s (%.1f M samples/s), %zu KB per channel\n",
+           channels.size(), (unsigned long long)rows, secs, channels.size()*rows/secs/1e6,
+           channels.empty() ? 0 : channels[0].pyramid.bytes()/1024);
+    printf("%-10s %12s %12s %12s %12s   (last %zu samples)\n", "channel", "mean", "stddev", "min", "max", window);
+    for (const Channel &c : channels){
+        printf("%-10s %12.3f %12.3f %12.3f %12.3f\n", c.name.c_str(), c.window.mean(), c.window.stddev(), c.window.min(), c.window.max());
+    }
+
+    if (want.empty()) return 0;
+    for (const Channel &c : channels){
+        if (c.name != want) continue;
+        if (!ranged){
+            r0 = t && rows ? t[0] : 0;
+            r1 = t && rows ? t[rows - 1] : rows ? rows - 1 : 0;
+        }
+        std::vector<Bucket> px;
+        auto q0 = std::chrono::steady_clock::now();
+        int level = c.pyramid.query(r0, r1, pixels, px);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - q0).count();
+        printf("# %s [%llu, %llu] from level %d in %.1f us\n", want.c_str(), (unsigned long long)r0, (unsigned long long)r1, level, us);
+        printf("t0,t1,min,max,mean,n\n");
+        for (const Bucket &b : px){
+            printf("%llu,%llu,%g,%g,%g,%u\n", (unsigned long long)b.t0, (unsigned long long)b.t1, b.min, b.max, b.mean(), b.n);
+        }
+        return 0;
+    }
+    fprintf(stderr, "plotagg: no channel %s\n", want.c_str());
+    return 2;
+}
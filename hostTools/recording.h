@@ -0,0 +1,198 @@
+//Reader/writer for binary run recordings made with RECORD defined in the
+//firmware (carFirmware/src/serialtools/record.h). The byte layout here must
+//match the RECORD_* offsets there; replay.cpp checks this at compile time.
+//Recordings delta compressed with RECORD_PACKED (serialtools/pack.h) are
+//decoded by the same parseRecording, raw and packed frames can be mixed.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+const int REC_SENSORS = 8;
+const size_t REC_FRAME_LEN = 51;
+
+//One loop() iteration as seen by the car
+struct RecordFrame{
+    uint32_t t_us;
+    uint16_t sensor[REC_SENSORS];
+    uint32_t encL;
+    uint32_t encR;
+    uint32_t spinL; //counts that ended a turnaround, 0 if none
+    uint32_t spinR;
+    uint16_t nSLPL;
+    uint16_t nSLPR;
+    uint16_t DIR_L;
+    uint16_t DIR_R;
+    uint16_t PWML; //PWM_FULLSCALE units
+    uint16_t PWMR;
+};
+
+//Packed recordings (serialtools/pack.h)
+const size_t REC_KEY_LEN = 51; //'R', 0x80|seq, body, checksum
+const size_t REC_OLD_KEY_LEN = 52; //'R','K',seq, body, checksum, before seq moved into the kind byte
+const uint8_t REC_SEQ_MASK = 0x7F;
+const size_t REC_DELTA_MIN = 8; //header, mask and checksum
+const int REC_FIELDS = 19;
+const uint8_t REC_WIDTH[REC_FIELDS] = {4, 2, 2, 2, 2, 2, 2, 2, 2, 4, 4, 4, 4, 2, 2, 2, 2, 2, 2};
+const uint32_t REC_LINEAR = (1u << 0) | (1u << 9) | (1u << 10);
+
+inline uint16_t rec16(const uint8_t *p){ return p[0] | (p[1] << 8); }
+inline uint32_t rec32(const uint8_t *p){ return rec16(p) | ((uint32_t)rec16(p + 2) << 16); }
+inline void put16(std::vector<uint8_t> &out, uint16_t v){ out.push_back(v & 0xFF); out.push_back(v >> 8); }
+inline void put32(std::vector<uint8_t> &out, uint32_t v){ put16(out, v & 0xFFFF); put16(out, v >> 16); }
+
+//Read a whole file, false if it could not be opened
+inline bool readFile(const char *path, std::vector<uint8_t> &out){
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    out.clear();
+    uint8_t buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+//Frame from its 19 fields in record order
+inline RecordFrame fromFields(const uint32_t *v){
+    RecordFrame fr;
+    fr.t_us = v[0];
+    for (int s=0; s<REC_SENSORS; s++) fr.sensor[s] = v[1 + s];
+    fr.encL = v[9];
+    fr.encR = v[10];
+    fr.spinL = v[11];
+    fr.spinR = v[12];
+    fr.nSLPL = v[13];
+    fr.nSLPR = v[14];
+    fr.DIR_L = v[15];
+    fr.DIR_R = v[16];
+    fr.PWML = v[17];
+    fr.PWMR = v[18];
+    return fr;
+}
+
+//Fields of a frame body (the frame less sync and checksum)
+inline void bodyFields(const uint8_t *p, uint32_t *v){
+    for (int f=0; f<REC_FIELDS; f++){
+        v[f] = REC_WIDTH[f] == 4 ? rec32(p) : rec16(p);
+        p += REC_WIDTH[f];
+    }
+}
+
+inline uint8_t xorSum(const uint8_t *p, size_t n){
+    uint8_t sum = 0;
+    for (size_t k=0; k<n; k++) sum ^= p[k];
+    return sum;
+}
+
+//Prediction state of a packed stream
+struct PackedState{
+    uint32_t last[REC_FIELDS];
+    uint32_t step[REC_FIELDS];
+    uint8_t seq; //expected next, modulo 128
+    bool synced; //a keyframe was seen and nothing lost since
+};
+
+//Apply the residuals of a delta frame of n bytes at p, false if they run
+//past the frame
+inline bool applyDelta(PackedState &st, const uint8_t *p, size_t n){
+    uint32_t mask = p[4] | (p[5] << 8) | ((uint32_t)p[6] << 16);
+    const uint8_t *q = p + 7, *end = p + n - 1;
+    for (int f=0; f<REC_FIELDS; f++){
+        uint32_t v = st.last[f] + st.step[f];
+        if (mask & (1u << f)){
+            uint32_t z = 0;
+            int shift = 0;
+            do{
+                if (q == end || shift > 28) return false;
+                z |= (uint32_t)(*q & 0x7F) << shift;
+                shift += 7;
+            } while (*q++ & 0x80);
+            v += (uint32_t)((int32_t)(z >> 1) ^ -(int32_t)(z & 1));
+        }
+        if (REC_LINEAR & (1u << f)) st.step[f] = v - st.last[f];
+        st.last[f] = v;
+    }
+    return q == end;
+}
+
+//Decode every frame in a captured serial stream. Bytes before, between or
+//after frames (boot messages, line noise) are skipped by resyncing on 'R'
+//and a frame kind ('F' raw, 0x80|seq keyframe, 'D' delta, 'K' the old
+//keyframe with its own seq byte) and the checksum.
+//Returns the number of frames decoded, bad counts frames that had a sync
+//but failed the checksum and lost the delta frames dropped because the
+//prediction they build on was lost with them (until the next keyframe).
+inline size_t parseRecording(const uint8_t *data, size_t len, std::vector<RecordFrame> &frames, size_t *bad = 0, size_t *lost = 0){
+    size_t i = 0, rejected = 0, dropped = 0, found = 0;
+    PackedState st;
+    st.synced = false;
+    uint32_t v[REC_FIELDS];
+    while (i + 1 < len){
+        if (data[i] != 'R'){ i++; continue; }
+        const uint8_t *p = data + i;
+        size_t n;
+        bool key = p[1] & 0x80;
+        if (p[1] == 'F') n = REC_FRAME_LEN;
+        else if (key) n = REC_KEY_LEN;
+        else if (p[1] == 'K') n = REC_OLD_KEY_LEN;
+        else if (p[1] == 'D' && i + 3 < len) n = p[3];
+        else{ i++; continue; }
+        if (n < REC_DELTA_MIN || n > REC_OLD_KEY_LEN || i + n > len){ i++; continue; }
+        if (xorSum(p, n - 1) != p[n - 1]){
+            rejected++;
+            i++;
+            continue;
+        }
+
+        if (p[1] == 'F'){
+            bodyFields(p + 2, v);
+            frames.push_back(fromFields(v));
+        }
+        else if (key || p[1] == 'K'){
+            bodyFields(p + (key ? 2 : 3), st.last);
+            for (int f=0; f<REC_FIELDS; f++) st.step[f] = 0;
+            st.seq = ((key ? p[1] : p[2]) + 1) & REC_SEQ_MASK;
+            st.synced = true;
+            frames.push_back(fromFields(st.last));
+        }
+        else{
+            if (!st.synced || (p[2] & REC_SEQ_MASK) != st.seq || !applyDelta(st, p, n)){
+                st.synced = false;
+                dropped++;
+                i += n;
+                continue;
+            }
+            st.seq = (st.seq + 1) & REC_SEQ_MASK;
+            frames.push_back(fromFields(st.last));
+        }
+        found++;
+        i += n;
+    }
+    if (bad) *bad = rejected;
+    if (lost) *lost = dropped;
+    return found;
+}
+
+//Encode a frame exactly as the firmware would send it
+inline void writeFrame(const RecordFrame &fr, std::vector<uint8_t> &out){
+    size_t start = out.size();
+    out.push_back('R');
+    out.push_back('F');
+    put32(out, fr.t_us);
+    for (int s=0; s<REC_SENSORS; s++) put16(out, fr.sensor[s]);
+    put32(out, fr.encL);
+    put32(out, fr.encR);
+    put32(out, fr.spinL);
+    put32(out, fr.spinR);
+    put16(out, fr.nSLPL);
+    put16(out, fr.nSLPR);
+    put16(out, fr.DIR_L);
+    put16(out, fr.DIR_R);
+    put16(out, fr.PWML);
+    put16(out, fr.PWMR);
+    uint8_t sum = 0;
+    for (size_t k=start; k<out.size(); k++) sum ^= out[k];
+    out.push_back(sum);
+}
@@ -0,0 +1,290 @@
+//Deterministic record/replay of the car's control loop on a host.
+//
+//The unmodified firmware (carFirmware/src/main.cpp with posFind, turn,
+//Drive::update and loop()) is compiled into this program against the host
+//Arduino shim. Each recorded frame is fed back through loop(): the recorded
+//IR frame is returned by the ECE3 reads, the recorded encoder counts by
+//getEncoderCount_*, and virtual time is set to the frame's timestamp. The
+//motor command loop() produces is diffed against the recorded one. With
+//PIPELINE the frame a loop acquires is the one the next loop computes on,
+//so the reads during loop k return frame k + 1.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -IhostTools/shim hostTools/replay.cpp hostTools/shim/Arduino.cpp -o replay
+//
+//Usage:
+//  replay run.rec [-n max_diffs] [-r repeat] [-q]
+//  replay --synth frames out.rec     write a self consistent recording
+//
+//Exit status is 0 when every frame matches, 1 on a mismatch, 2 on error.
+
+#include "../carFirmware/src/main.cpp"
+#include "recording.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+static_assert(RECORD_FRAME_LEN == REC_FRAME_LEN, "recording.h out of sync with record.h");
+static_assert(RECORD_CMD == 38, "recording.h out of sync with record.h");
+static_assert(sensor_width == REC_SENSORS, "recording.h out of sync with record.h");
+
+//Raised when loop() keeps polling the encoders past what the recording
+//can answer, e.g. a turnaround that did not end the same way
+struct Stuck{};
+
+//Harness state for the frame being replayed
+static const RecordFrame *cur = 0;
+static const RecordFrame *acq = 0; //frame the IR reads return
+static uint16_t *acqInto = 0;
+static int resetsL = 0;
+static int resetsR = 0;
+static long polls = 0;
+const long MAX_POLLS = 100000;
+
+//Live encoder model used by --synth instead of the recording
+static bool live = false;
+static uint32_t liveL = 0;
+static uint32_t liveR = 0;
+
+//Encoder counts are the recorded counts until the first reset of the frame,
+//the counts that ended the turnaround after it, and 0 after the second
+static uint32_t replayCount(uint32_t enc, uint32_t spin, int resets){
+    if (++polls > MAX_POLLS) throw Stuck();
+    if (resets == 0) return enc;
+    if (resets == 1) return spin;
+    return 0;
+}
+
+void ECE3_Init(){}
+
+void ECE3_read_IR(uint16_t *sensorValues){
+    for (int i=0; i<REC_SENSORS; i++) sensorValues[i] = acq->sensor[i];
+}
+
+void ECE3_start_IR(uint16_t *sensorValues){
+    acqInto = sensorValues;
+}
+
+bool ECE3_poll_IR(){
+    return true;
+}
+
+void ECE3_finish_IR(){
+    ECE3_read_IR(acqInto);
+}
+
+uint32_t getEncoderCount_left(){
+    if (live){ if (resetsL) liveL++; return liveL; }
+    return replayCount(cur->encL, cur->spinL, resetsL);
+}
+
+uint32_t getEncoderCount_right(){
+    if (live){ if (resetsR) liveR++; return liveR; }
+    return replayCount(cur->encR, cur->spinR, resetsR);
+}
+
+EncoderCounts getEncoderCounts(){
+    EncoderCounts c;
+    c.left = getEncoderCount_left();
+    c.right = getEncoderCount_right();
+    return c;
+}
+
+void resetEncoderCount_left(){
+    resetsL++;
+    liveL = 0;
+}
+
+void resetEncoderCount_right(){
+    resetsR++;
+    liveR = 0;
+}
+
+void ISR_LEFT(){}
+void ISR_RIGHT(){}
+void setEncoderHook(void (*hook)(uint8_t side)){ (void)hook; }
+
+//Frame the IR reads return while loop() runs on frames[k]
+static const RecordFrame *acquired(const std::vector<RecordFrame> &frames, size_t k){
+#ifdef PIPELINE
+    if (k + 1 < frames.size()) k++;
+#endif
+    return &frames[k];
+}
+
+//Put every firmware global back to its power on state, first is the
+//frame setup() reads
+static void resetFirmware(const RecordFrame &first){
+    hostReset();
+    drive = Drive();
+    motors = MotorDriver();
+    commands = CommandChannel();
+    sensors = SensorPipeline();
+    crossing = CrossDetector();
+    laps = LapTimer();
+    params = paramsInit();
+    donuts = 0;
+    reported = false;
+    acq = &first;
+    setup();
+}
+
+//Run loop() once on a frame, returns false if the loop got stuck
+static bool step(const RecordFrame &fr, const RecordFrame *next){
+    cur = &fr;
+    acq = next;
+    resetsL = resetsR = 0;
+    polls = 0;
+    hostBoard.clock_us = fr.t_us;
+    try{
+        loop();
+    }
+    catch (Stuck &){
+        return false;
+    }
+    return true;
+}
+
+static bool same(const MotorCommand &a, const RecordFrame &b){
+    return a.nSLPL == b.nSLPL && a.nSLPR == b.nSLPR && a.DIR_L == b.DIR_L &&
+           a.DIR_R == b.DIR_R && a.PWML == b.PWML && a.PWMR == b.PWMR;
+}
+
+//Synthetic run: the line swings under the array, the wheels advance with
+//PWM and a black cross line is inserted every `lap` frames
+static int synth(long n, const char *path){
+    const long lap = 3000;
+    std::vector<RecordFrame> frames(n);
+    std::vector<uint8_t> out;
+    if (n < 1) return 2;
+
+    //IR frames first, the pipeline reads one frame ahead
+    uint32_t t = 2000000;
+    for (long k=0; k<n; k++){
+        RecordFrame &fr = frames[k];
+        memset(&fr, 0, sizeof(fr));
+        t += 2500 + (k*7919 % 400);
+        fr.t_us = t;
+
+        double pos = 4.5 + 2.5*sin(k*0.004) + 0.3*sin(k*0.05);
+        bool cross = (k % lap) >= lap - 3;
+        for (int i=0; i<REC_SENSORS; i++){
+            double d = (i + 1) - pos;
+            fr.sensor[i] = cross ? 2500 : (uint16_t)(180 + 2300*exp(-d*d/0.8) + (k*31 + i*17) % 40);
+        }
+    }
+
+    live = true;
+    resetFirmware(frames[0]);
+    for (long k=0; k<n; k++){
+        RecordFrame &fr = frames[k];
+
+        const MotorCommand &c = motors.current();
+        liveL += (c.PWML*3 + PWM_FULLSCALE/2)/PWM_FULLSCALE;
+        liveR += (c.PWMR*3 + PWM_FULLSCALE/2)/PWM_FULLSCALE;
+        fr.encL = liveL;
+        fr.encR = liveR;
+
+        cur = &fr;
+        acq = acquired(frames, k);
+        resetsL = resetsR = 0;
+        int before = donuts;
+        hostBoard.clock_us = fr.t_us;
+        loop();
+        if (donuts != before){
+            //the turnaround polls until (L + R)/360 >= 1.5
+            fr.spinL = 270;
+            fr.spinR = 270;
+        }
+
+        const MotorCommand &o = motors.current();
+        fr.nSLPL = o.nSLPL;
+        fr.nSLPR = o.nSLPR;
+        fr.DIR_L = o.DIR_L;
+        fr.DIR_R = o.DIR_R;
+        fr.PWML = o.PWML;
+        fr.PWMR = o.PWMR;
+        writeFrame(fr, out);
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f){
+        fprintf(stderr, "replay: cannot write %s\n", path);
+        return 2;
+    }
+    fwrite(out.data(), 1, out.size(), f);
+    fclose(f);
+    printf("wrote %ld frames (%zu bytes) to %s\n", n, out.size(), path);
+    return 0;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: replay run.rec [-n max_diffs] [-r repeat] [-q]\n"
+                    "       replay --synth frames out.rec\n");
+}
+
+int main(int argc, char **argv){
+    if (argc == 4 && strcmp(argv[1], "--synth") == 0) return synth(atol(argv[2]), argv[3]);
+    if (argc < 2){
+        usage();
+        return 2;
+    }
+
+    const char *path = 0;
+    long maxDiffs = 10;
+    long repeat = 1;
+    bool quiet = false;
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) maxDiffs = atol(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) repeat = atol(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0) quiet = true;
+        else if (!path) path = argv[i];
+        else{
+            usage();
+            return 2;
+        }
+    }
+
+    std::vector<uint8_t> bytes;
+    if (!path || !readFile(path, bytes)){
+        fprintf(stderr, "replay: cannot read %s\n", path ? path : "");
+        return 2;
+    }
+    std::vector<RecordFrame> frames;
+    size_t bad = 0;
+    parseRecording(bytes.data(), bytes.size(), frames, &bad);
+    if (frames.empty()){
+        fprintf(stderr, "replay: no frames in %s\n", path);
+        return 2;
+    }
+
+    long diffs = 0, stuck = 0, donutsSeen = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long r=0; r<repeat; r++){
+        resetFirmware(frames[0]);
+        for (size_t k=0; k<frames.size(); k++){
+            const RecordFrame &fr = frames[k];
+            bool ok = step(fr, acquired(frames, k));
+            const MotorCommand &o = motors.current();
+            if (r > 0) continue;
+            if (!ok) stuck++;
+            if (ok && same(o, fr)) continue;
+            diffs++;
+            if (!quiet && diffs <= maxDiffs){
+                printf("frame %zu t=%lu us%s\n", k, (unsigned long)fr.t_us, ok ? "" : " (turnaround did not end)");
+                printf("  recorded nSLP %u %u DIR %u %u PWM %u %u\n", fr.nSLPL, fr.nSLPR, fr.DIR_L, fr.DIR_R, fr.PWML, fr.PWMR);
+                printf("  replayed nSLP %u %u DIR %u %u PWM %u %u\n", o.nSLPL, o.nSLPR, o.DIR_L, o.DIR_R, o.PWML, o.PWMR);
+            }
+        }
+        if (r == 0) donutsSeen = donuts;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double run = (frames.back().t_us - frames.front().t_us)/1e6;
+    printf("%zu frames (%.1f s of driving, %zu bad checksums), %ld turnarounds\n", frames.size(), run, bad, donutsSeen);
+    printf("%ld mismatched frames, %ld stuck turnarounds\n", diffs, stuck);
+    printf("replayed %ld x in %.3f s, %.0f frames/s\n", repeat, secs, frames.size()*repeat/secs);
+    return diffs ? 1 : 0;
+}
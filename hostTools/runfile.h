@@ -0,0 +1,221 @@
+//Columnar binary file format for runs and tracks.
+//
+//A file is a fixed header, a column directory and the column data. Every
+//column is a packed little endian array of `rows` values starting on a 64
+//byte boundary, so a mapped file can be scanned in place with no parsing or
+//copying.
+//
+//  header   magic "ECE3COL\0", version, kind, rows, column count, key
+//  columns  name[24], type, offset of the data from the start of the file
+//  data     one array per column
+//
+//Run files (KIND_RUN) hold t_us, sensor0..sensor7, pos, pwmL, pwmR, dirL,
+//dirR, slpL, slpR, encL, encR, spinL and spinR; converters only write the
+//columns their source has.
+//Track files (KIND_TRACK) hold x, y and the arc length s up to each point.
+//Model files (KIND_MODEL) are one row, a column per parameter of the host
+//plant model (plant.h).
+//The key is free for the writer, e.g. a hash of what a cache was built
+//from; files that do not set it have 0.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char COL_MAGIC[8] = {'E', 'C', 'E', '3', 'C', 'O', 'L', 0};
+const uint32_t COL_VERSION = 1;
+const uint32_t COL_ALIGN = 64;
+
+enum ColKind : uint32_t { KIND_RUN = 1, KIND_TRACK = 2, KIND_MODEL = 3 };
+enum ColType : uint32_t { COL_U16 = 1, COL_U32 = 2, COL_F32 = 3, COL_F64 = 4 };
+
+struct ColHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t rows;
+    uint32_t ncols;
+    uint32_t pad;
+    uint64_t key;
+    uint32_t reserved[6];
+};
+
+struct ColEntry{
+    char name[24];
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+static_assert(sizeof(ColHeader) == 64, "ColHeader must stay 64 bytes");
+static_assert(sizeof(ColEntry) == 48, "ColEntry must stay 48 bytes");
+
+inline size_t colSize(uint32_t type){
+    switch (type){
+        case COL_U16: return 2;
+        case COL_U32: return 4;
+        case COL_F32: return 4;
+        case COL_F64: return 8;
+    }
+    return 0;
+}
+
+template<class T> struct ColTypeOf;
+template<> struct ColTypeOf<uint16_t>{ static const uint32_t type = COL_U16; };
+template<> struct ColTypeOf<uint32_t>{ static const uint32_t type = COL_U32; };
+template<> struct ColTypeOf<float>{ static const uint32_t type = COL_F32; };
+template<> struct ColTypeOf<double>{ static const uint32_t type = COL_F64; };
+
+//Builds a file column by column, all columns must have the same length
+class ColWriter{
+private:
+    struct Col{
+        std::string name;
+        uint32_t type;
+        std::vector<uint8_t> data;
+    };
+    uint32_t kind;
+    uint64_t rows;
+    uint64_t key;
+    std::vector<Col> cols;
+public:
+    explicit ColWriter(uint32_t kind) : kind(kind), rows(0), key(0){}
+
+    void setKey(uint64_t k){ key = k; }
+
+    //Add a column, false if its length differs from the columns before it
+    template<class T>
+    bool add(const char *name, const std::vector<T> &values){
+        if (!cols.empty() && values.size() != rows) return false;
+        rows = values.size();
+        Col c;
+        c.name = name;
+        c.type = ColTypeOf<T>::type;
+        c.data.resize(values.size()*sizeof(T));
+        if (!values.empty()) memcpy(c.data.data(), values.data(), c.data.size());
+        cols.push_back(c);
+        return true;
+    }
+
+    bool write(const char *path){
+        std::vector<uint8_t> pad(COL_ALIGN, 0);
+        ColHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, COL_MAGIC, sizeof(h.magic));
+        h.version = COL_VERSION;
+        h.kind = kind;
+        h.rows = rows;
+        h.ncols = cols.size();
+        h.key = key;
+
+        std::vector<ColEntry> dir(cols.size());
+        uint64_t at = sizeof(ColHeader) + dir.size()*sizeof(ColEntry);
+        for (size_t i=0; i<cols.size(); i++){
+            at = (at + COL_ALIGN - 1)/COL_ALIGN*COL_ALIGN;
+            memset(&dir[i], 0, sizeof(ColEntry));
+            strncpy(dir[i].name, cols[i].name.c_str(), sizeof(dir[i].name) - 1);
+            dir[i].type = cols[i].type;
+            dir[i].offset = at;
+            dir[i].bytes = cols[i].data.size();
+            at += cols[i].data.size();
+        }
+
+        FILE *f = fopen(path, "wb");
+        if (!f) return false;
+        fwrite(&h, sizeof(h), 1, f);
+        if (!dir.empty()) fwrite(dir.data(), sizeof(ColEntry), dir.size(), f);
+        uint64_t pos = sizeof(ColHeader) + dir.size()*sizeof(ColEntry);
+        for (size_t i=0; i<cols.size(); i++){
+            fwrite(pad.data(), 1, dir[i].offset - pos, f);
+            fwrite(cols[i].data.data(), 1, cols[i].data.size(), f);
+            pos = dir[i].offset + dir[i].bytes;
+        }
+        bool ok = !ferror(f);
+        fclose(f);
+        return ok;
+    }
+};
+
+//Read only memory mapped view of a file
+class ColFile{
+private:
+    const uint8_t *base;
+    size_t size;
+    const ColHeader *head;
+    const ColEntry *dir;
+    std::string err;
+
+    bool fail(const char *why){
+        err = why;
+        close();
+        return false;
+    }
+public:
+    ColFile() : base(0), size(0), head(0), dir(0){}
+    ~ColFile(){ close(); }
+    ColFile(const ColFile &) = delete;
+    ColFile &operator=(const ColFile &) = delete;
+
+    bool open(const char *path){
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return fail("cannot open file");
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ColHeader)){
+            ::close(fd);
+            return fail("file too small");
+        }
+        void *p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return fail("mmap failed");
+        base = (const uint8_t *)p;
+        size = st.st_size;
+        head = (const ColHeader *)base;
+
+        if (memcmp(head->magic, COL_MAGIC, sizeof(COL_MAGIC)) != 0) return fail("bad magic");
+        if (head->version != COL_VERSION) return fail("unsupported version");
+        if (sizeof(ColHeader) + (uint64_t)head->ncols*sizeof(ColEntry) > size) return fail("truncated directory");
+        dir = (const ColEntry *)(base + sizeof(ColHeader));
+        for (uint32_t i=0; i<head->ncols; i++){
+            if (colSize(dir[i].type) == 0) return fail("unknown column type");
+            if (dir[i].bytes != head->rows*colSize(dir[i].type)) return fail("column length mismatch");
+            if (dir[i].offset % COL_ALIGN || dir[i].offset + dir[i].bytes > size) return fail("column out of bounds");
+        }
+        return true;
+    }
+
+    void close(){
+        if (base) munmap((void *)base, size);
+        base = 0;
+        size = 0;
+        head = 0;
+        dir = 0;
+    }
+
+    const std::string &error() const { return err; }
+    uint32_t kind() const { return head ? head->kind : 0; }
+    uint64_t rows() const { return head ? head->rows : 0; }
+    uint32_t columns() const { return head ? head->ncols : 0; }
+    uint64_t key() const { return head ? head->key : 0; }
+    const ColEntry &entry(uint32_t i) const { return dir[i]; }
+
+    //Column data, null if the column is missing or has another type
+    template<class T>
+    const T *column(const char *name) const {
+        for (uint32_t i=0; i<columns(); i++){
+            if (strncmp(dir[i].name, name, sizeof(dir[i].name)) != 0) continue;
+            if (dir[i].type != ColTypeOf<T>::type) return 0;
+            return (const T *)(base + dir[i].offset);
+        }
+        return 0;
+    }
+};
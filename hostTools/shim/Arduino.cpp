@@ -0,0 +1,72 @@
+#include "Arduino.h"
+
+HostBoard hostBoard;
+HostSerial Serial;
+
+void hostReset(){
+    memset(hostBoard.mode, 0, sizeof(hostBoard.mode));
+    memset(hostBoard.level, 0, sizeof(hostBoard.level));
+    memset(hostBoard.analog, 0, sizeof(hostBoard.analog));
+    memset(hostBoard.modeTime, 0, sizeof(hostBoard.modeTime));
+    hostBoard.writes = 0;
+    hostBoard.clock_us = 0;
+    Serial.out.clear();
+}
+
+void hostAdvance(uint64_t us){
+    hostBoard.clock_us += us;
+    if (hostBoard.tickHook) hostBoard.tickHook(hostBoard.clock_us);
+}
+
+void pinMode(int pin, int mode){
+    if (pin < 0 || pin >= HOST_PINS) return;
+    hostBoard.mode[pin] = mode;
+    hostBoard.modeTime[pin] = hostBoard.clock_us;
+}
+
+void digitalWrite(int pin, int value){
+    if (pin < 0 || pin >= HOST_PINS) return;
+    hostBoard.level[pin] = value ? HIGH : LOW;
+    hostBoard.writes++;
+    if (hostBoard.writeHook) hostBoard.writeHook(pin, hostBoard.level[pin]);
+}
+
+int digitalRead(int pin){
+    if (hostBoard.readHook){
+        int v = hostBoard.readHook(pin);
+        if (v >= 0) return v;
+    }
+    if (pin < 0 || pin >= HOST_PINS) return LOW;
+    return hostBoard.level[pin];
+}
+
+void analogWrite(int pin, int value){
+    if (pin < 0 || pin >= HOST_PINS) return;
+    hostBoard.analog[pin] = value;
+    hostBoard.writes++;
+}
+
+int analogRead(int pin){
+    if (pin < 0 || pin >= HOST_PINS) return 0;
+    return hostBoard.analog[pin];
+}
+
+unsigned long micros(){
+    return (unsigned long)hostBoard.clock_us;
+}
+
+unsigned long millis(){
+    return (unsigned long)(hostBoard.clock_us/1000);
+}
+
+void delay(unsigned long ms){
+    hostAdvance((uint64_t)ms*1000);
+}
+
+void delayMicroseconds(unsigned int us){
+    hostAdvance(us);
+}
+
+void noInterrupts(){}
+void interrupts(){}
+void attachInterrupt(int pin, void (*isr)(), int mode){ (void)pin; (void)isr; (void)mode; }
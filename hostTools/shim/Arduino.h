@@ -0,0 +1,120 @@
+//Host stand-in for the Energia/Arduino core.
+//Lets the unmodified firmware in carFirmware/src build and run on a Linux
+//host. Pin writes are latched in hostBoard, time is a virtual clock the
+//harness advances, and pin reads can be routed to a callback so a harness
+//can play back recorded or simulated hardware.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <string>
+
+using std::abs;
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+//Number of pins the host board tracks
+const int HOST_PINS = 128;
+
+//State of the virtual board
+struct HostBoard{
+    uint8_t mode[HOST_PINS];
+    uint8_t level[HOST_PINS];
+    uint16_t analog[HOST_PINS];
+    uint64_t modeTime[HOST_PINS]; //virtual time of the last pinMode
+    unsigned long writes; //digitalWrite/analogWrite calls that reached a pin
+    uint64_t clock_us; //virtual time, advanced by delays and by the harness
+    //Optional hook for digitalRead, returns -1 to fall back to the latch
+    int (*readHook)(int pin);
+    //Optional hook run whenever virtual time advances
+    void (*tickHook)(uint64_t clock_us);
+    //Optional hook run after every digitalWrite
+    void (*writeHook)(int pin, int value);
+};
+
+extern HostBoard hostBoard;
+
+//Clear pins and time
+void hostReset();
+//Advance virtual time
+void hostAdvance(uint64_t us);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+void analogWrite(int pin, int value);
+int analogRead(int pin);
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+void attachInterrupt(int pin, void (*isr)(), int mode);
+
+//Minimal Arduino String on top of std::string
+class String : public std::string{
+public:
+    String(){}
+    String(const char *s) : std::string(s){}
+    String(const std::string &s) : std::string(s){}
+    String(char c) : std::string(1, c){}
+    String(int v) : std::string(std::to_string(v)){}
+    String(unsigned int v) : std::string(std::to_string(v)){}
+    String(long v) : std::string(std::to_string(v)){}
+    String(unsigned long v) : std::string(std::to_string(v)){}
+    String(double v, int digits = 2) : std::string(fixed(v, digits)){}
+    unsigned int length() const { return size(); }
+    String substring(unsigned int from, unsigned int to) const { return String(substr(from, to - from)); }
+    String substring(unsigned int from) const { return String(substr(from)); }
+    const char *c_str() const { return std::string::c_str(); }
+private:
+    static std::string fixed(double v, int digits){
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", digits, v);
+        return buf;
+    }
+};
+
+template<class T>
+String operator+(const String &a, const T &b){ String s(a); s += String(b); return s; }
+inline String operator+(const char *a, const String &b){ String s(a); s += b; return s; }
+
+//Serial port that keeps everything printed so a harness can inspect it
+class HostSerial{
+public:
+    std::string out;
+    bool keep = false; //drop output unless a harness asks for it
+    std::string in; //bytes a harness queues for the firmware to read
+    size_t inPos = 0;
+    void begin(long baud){ (void)baud; }
+    int available(){ return in.size() - inPos; }
+    int read(){ return inPos < in.size() ? (uint8_t)in[inPos++] : -1; }
+    size_t write(uint8_t b){ if (keep) out += (char)b; return 1; }
+    size_t write(const uint8_t *buf, size_t len){ if (keep) out.append((const char *)buf, len); return len; }
+    size_t print(const String &s){ if (keep) out += s; return s.size(); }
+    size_t print(const char *s){ return print(String(s)); }
+    template<class T> size_t print(T v){ return print(String(v)); }
+    template<class T> size_t println(T v){ size_t n = print(v); return n + print("\r\n"); }
+    size_t print(double v, int digits){ return print(String(v, digits)); }
+    size_t println(double v, int digits){ size_t n = print(v, digits); return n + println(); }
+    size_t println(){ return print("\r\n"); }
+};
+
+extern HostSerial Serial;
@@ -0,0 +1,5 @@
+//Host stand-in for the MSP432 device header.
+//Only needed so firmware headers that include "msp.h" build on a host,
+//register level code is kept behind __MSP432P401R__.
+#pragma once
+#include <stdint.h>
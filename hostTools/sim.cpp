@@ -0,0 +1,275 @@
+//Closed loop simulation of the car on a host.
+//
+//The firmware (main.cpp with the real QTRSensors RC read, turnaround
+//detector, Drive and MotorDriver) runs against the host shim while the
+//plant model in plant.h plays the hardware: sensor pins discharge after
+//the times QtrModel gives for the car's pose, the motor pins drive
+//MotorModel wheels and the wheels advance the encoders. Virtual time moves
+//with the firmware's delays, every pin read (READ_NS each) and every
+//encoder poll, and the plant is integrated up to it in PLANT_STEP_US steps.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -IhostTools/shim hostTools/sim.cpp carFirmware/src/ece3/ECE3.cpp carFirmware/src/ece3/lib_files/QTRSensors.cpp hostTools/shim/Arduino.cpp -o sim
+//
+//Usage:
+//  sim track.csv [-m model.col] [-t seconds] [-h height] [-g saturation] [-o run.col] [-s]
+//  sim track.csv --bench steps
+//
+//Unpainted points of a generated track (trackgen) are gaps in the line.
+//-m loads the car's motor and sensor parameters from a model file, e.g.
+//one sysid fitted from recordings; -h and -g apply on top of it.
+//Prints the turnarounds, lateral error and speed of the run. -o writes
+//t_us, x, y, lateral, speed, PWML and PWMR per loop (runfile.h format).
+//-s prints what the firmware sent over serial, e.g. its end of run report.
+//-g makes the phototransistors level off at that much light (QtrModel
+//saturation, 1 is a lit white floor; 0.05 leaves the line reading 1.4
+//times the floor at full brightness). The emitter pin is decoded as a
+//dimmable driver, so dimming set by the firmware changes the light.
+//--bench times the plant alone, with and without an 8 channel read per
+//step.
+
+#include "../carFirmware/src/main.cpp"
+#include "plant.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Sensor and emitter pins set in ECE3_Init()
+const uint8_t IR_PINS[sensor_width] = {65, 48, 64, 47, 52, 68, 53, 69};
+const uint8_t EMITTER_PIN = 45;
+
+const uint32_t PLANT_STEP_US = 100;
+const uint32_t READ_NS = 500; //cost of one digitalRead on the MSP432
+const uint32_t POLL_US = 1; //cost of one encoder poll
+
+static Plant *plant = 0;
+static int8_t channelOf[HOST_PINS];
+static double discharge[sensor_width];
+static uint64_t sensedAt = ~0ull; //release time discharge[] belongs to
+static uint64_t plantUs = 0;
+static uint32_t readNs = 0;
+static uint32_t baseL = 0, baseR = 0; //encoder counts at the last reset
+static uint64_t steps = 0;
+static void (*edgeHook)(uint8_t side) = 0; //the encoder edge interrupts
+static uint32_t edgesL = 0, edgesR = 0; //edges passed to edgeHook
+
+static WheelInput wheel(int nslp, int dir, int pwm){
+    WheelInput w;
+    w.awake = hostBoard.level[nslp] == HIGH;
+    w.reverse = hostBoard.level[dir] == REVERSE;
+    w.duty = hostBoard.analog[pwm]/(double)PWMAX;
+    return w;
+}
+
+//Integrate the plant up to the virtual clock
+static void tick(uint64_t now){
+    while (plantUs + PLANT_STEP_US <= now){
+        plant->emitters = hostBoard.level[EMITTER_PIN] == HIGH;
+        plant->step(wheel(nSLPL, DIR_L, PWML), wheel(nSLPR, DIR_R, PWMR), PLANT_STEP_US*1e-6);
+        plantUs += PLANT_STEP_US;
+        steps++;
+        if (!edgeHook) continue;
+        for (; edgesL != plant->countL; edgesL++) edgeHook(0);
+        for (; edgesR != plant->countR; edgesR++) edgeHook(1);
+    }
+}
+
+//Dimmable emitter driver: after at least 1 ms off the emitters come on at
+//full current and every short low pulse after that steps the current down
+//one of 32 levels
+static uint64_t emitterLow = 0; //virtual time the pin last went low
+static int dimming = 0;
+
+static void writePin(int pin, int value){
+    if (pin != EMITTER_PIN) return;
+    if (value == LOW){
+        emitterLow = hostBoard.clock_us;
+        return;
+    }
+    if (hostBoard.clock_us - emitterLow >= 1000) dimming = 0;
+    else if (dimming < 31) dimming++;
+    plant->brightness = (32 - dimming)/32.0;
+}
+
+//Sensor lines read high until their discharge time after being released
+static int readPin(int pin){
+    if (pin < 0 || pin >= HOST_PINS || channelOf[pin] < 0) return -1;
+    readNs += READ_NS;
+    if (readNs >= 1000){
+        hostAdvance(readNs/1000);
+        readNs %= 1000;
+    }
+    if (hostBoard.mode[pin] != INPUT) return -1;
+    uint64_t released = hostBoard.modeTime[pin];
+    if (released != sensedAt){
+        plant->sense(discharge);
+        sensedAt = released;
+    }
+    return hostBoard.clock_us - released >= discharge[channelOf[pin]] ? LOW : HIGH;
+}
+
+uint32_t getEncoderCount_left(){
+    hostAdvance(POLL_US);
+    return plant->countL - baseL;
+}
+
+uint32_t getEncoderCount_right(){
+    hostAdvance(POLL_US);
+    return plant->countR - baseR;
+}
+
+EncoderCounts getEncoderCounts(){
+    hostAdvance(POLL_US);
+    EncoderCounts c = {plant->countL - baseL, plant->countR - baseR};
+    return c;
+}
+
+void resetEncoderCount_left(){ baseL = plant->countL; }
+void resetEncoderCount_right(){ baseR = plant->countR; }
+void ISR_LEFT(){}
+void ISR_RIGHT(){}
+
+void setEncoderHook(void (*hook)(uint8_t side)){ edgeHook = hook; }
+
+static int bench(Plant &p, long n){
+    double us[sensor_width];
+    WheelInput l, r;
+    l.duty = 0.6;
+    r.duty = 0.55;
+    double sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long k=0; k<n; k++){
+        p.step(l, r, PLANT_STEP_US*1e-6);
+        p.sense(us);
+        sink += us[k % sensor_width];
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%ld plant steps with sensing in %.3f s, %.0f steps/ms\n", n, secs, n/secs/1e3);
+
+    start = std::chrono::steady_clock::now();
+    for (long k=0; k<n; k++) p.step(l, r, PLANT_STEP_US*1e-6);
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%ld plant steps without sensing in %.3f s, %.0f steps/ms\n", n, secs, n/secs/1e3);
+    return sink + p.x > -1e300 ? 0 : 1;
+}
+
+int main(int argc, char **argv){
+    const char *path = 0, *out = 0, *model = 0;
+    double limit = 60, height = -1, glare = 0;
+    long benchSteps = 0;
+    bool serial = false;
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) limit = atof(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) model = argv[++i];
+        else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) height = atof(argv[++i]);
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) glare = atof(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0) serial = true;
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) benchSteps = atol(argv[++i]);
+        else path = argv[i];
+    }
+    std::vector<double> tx, ty;
+    std::vector<uint16_t> painted;
+    if (!path || !readTrackCSV(path, tx, ty, &painted) || tx.size() < 2){
+        fprintf(stderr, "usage: sim track.csv [-m model.col] [-t seconds] [-h height] [-g saturation] [-o run.col] [-s] [--bench steps]\n");
+        if (path) fprintf(stderr, "sim: cannot read %s\n", path);
+        return 2;
+    }
+    Track track = resampleTrack(tx, ty, 0.25);
+    Plant car(track);
+    if (model && !loadModel(model, car)){
+        fprintf(stderr, "sim: cannot load model %s\n", model);
+        return 2;
+    }
+    if (height > 0) car.qtr.height = height;
+    if (glare > 0) car.qtr.saturation = glare;
+    car.addBar(0);
+    car.addBar(track.length());
+    std::vector<double> ts;
+    arcLength(tx, ty, ts);
+    for (size_t i=0; i<painted.size(); i++){
+        if (painted[i]) continue;
+        size_t j = i;
+        while (j + 1 < painted.size() && !painted[j + 1]) j++;
+        car.addGap(ts[i], ts[j]);
+        i = j;
+    }
+    car.place(8);
+    plant = &car;
+    if (benchSteps) return bench(car, benchSteps);
+
+    memset(channelOf, -1, sizeof(channelOf));
+    for (int i=0; i<sensor_width; i++) channelOf[IR_PINS[i]] = i;
+    hostReset();
+    hostBoard.readHook = readPin;
+    hostBoard.tickHook = tick;
+    hostBoard.writeHook = writePin;
+    Serial.keep = serial;
+
+    std::vector<uint32_t> t_us;
+    std::vector<float> xs, ys, lat, spd;
+    std::vector<uint16_t> pl, pr;
+    double sumSq = 0, worst = 0;
+    long loops = 0;
+    int seen = 0;
+    uint64_t stoppedSince = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    setup();
+    while (hostBoard.clock_us < limit*1e6){
+        loop();
+        loops++;
+        TrackPoint tp = car.where();
+        if (donuts < 2){
+            sumSq += tp.lateral*tp.lateral;
+            if (fabs(tp.lateral) > worst) worst = fabs(tp.lateral);
+        }
+        if (donuts != seen){
+            seen = donuts;
+            printf("turnaround %d at %.3f s, s = %.1f, lateral %.2f\n", donuts, hostBoard.clock_us/1e6, tp.s, tp.lateral);
+        }
+        if (out){
+            t_us.push_back(hostBoard.clock_us);
+            xs.push_back(car.x);
+            ys.push_back(car.y);
+            lat.push_back(tp.lateral);
+            spd.push_back(car.speed());
+            pl.push_back(hostBoard.analog[PWML]);
+            pr.push_back(hostBoard.analog[PWMR]);
+        }
+        //stopped for half a second after the last turnaround
+        if (donuts > 1 && fabs(car.speed()) < 0.1){
+            if (!stoppedSince) stoppedSince = hostBoard.clock_us;
+            if (hostBoard.clock_us - stoppedSince > 500000) break;
+        }
+        else stoppedSince = 0;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double virt = hostBoard.clock_us/1e6;
+
+    printf("%s after %.3f s, %ld loops (%.0f Hz), %d turnarounds\n", donuts > 1 ? "stopped" : "time limit",
+           virt, loops, loops/(virt - 2), donuts);
+    printf("lateral error rms %.3f max %.3f\n", loops ? sqrt(sumSq/loops) : 0, worst);
+    printf("simulated %.3f s in %.3f s wall, %llu plant steps (%.0f steps/ms)\n", virt, secs,
+           (unsigned long long)steps, steps/secs/1e3);
+
+    if (serial) fwrite(Serial.out.data(), 1, Serial.out.size(), stdout);
+
+    if (out){
+        ColWriter w(KIND_RUN);
+        w.add("t_us", t_us);
+        w.add("x", xs);
+        w.add("y", ys);
+        w.add("lateral", lat);
+        w.add("speed", spd);
+        w.add("PWML", pl);
+        w.add("PWMR", pr);
+        if (!w.write(out)){
+            fprintf(stderr, "sim: cannot write %s\n", out);
+            return 2;
+        }
+    }
+    return donuts > 1 ? 0 : 1;
+}
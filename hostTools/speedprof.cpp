@@ -0,0 +1,223 @@
+//Minimum time speed profile for a known track.
+//
+//The track is resampled to arc length (track.h) and each sample gets the
+//speed the lateral grip allows on its curvature, sqrt(grip/|curvature|),
+//capped at the top speed. A forward pass then limits every sample to what
+//the car can reach accelerating from the one before and a backward pass to
+//what it can brake from to the one after. Acceleration and braking share
+//the grip with cornering (friction circle). Both passes are O(samples).
+//
+//The profile is emitted as a firmware header: for each leg (0 there, 1 back
+//along the reversed track) a uint8_t forward PWM per bin of summed encoder
+//counts, the slowest speed of the bin mapped through the PWM at which the
+//car does top speed.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 hostTools/speedprof.cpp -o speedprof
+//
+//Usage:
+//  speedprof track.csv|track.col [-d ds] [-w window] [-a accel] [-b brake]
+//            [-g grip] [-v vmax] [-m vmin] [-V v_at_pwmax] [-k counts_per_unit]
+//            [-B bin_counts] [-H out.h] [-n NAME] [-c profile.csv]
+//
+//Units are the track's (cm for simulation/track.csv) and seconds. Defaults:
+//ds 0.5, accel 150, brake 200, grip 300, vmax 90, vmin 20, V 93, counts per
+//unit 360/(7*pi), 32 counts per bin.
+
+#include "track.h"
+
+#include <chrono>
+#include <string>
+#include <string.h>
+
+struct Limits{
+    double accel = 150;
+    double brake = 200;
+    double grip = 300;
+    double vmax = 90;
+};
+
+//Raise u (speed squared) at sample i to what the car reaches from sample
+//`from` with acceleration a, less what cornering at `from` already uses
+static inline void reach(std::vector<double> &u, const std::vector<double> &q, size_t i, size_t from, double a, double ds){
+    double lat = u[from]*q[from]; //lateral over grip
+    double left = lat < 1e-3 ? a : lat < 1 ? a*sqrt(1 - lat*lat) : 0;
+    double r = u[from] + 2*left*ds;
+    if (r < u[i]) u[i] = r;
+}
+
+//Minimum time profile over uniformly spaced samples with curvature k,
+//starting and ending at rest. backwards drives from the last sample to the
+//first, which swaps where the car accelerates and brakes. Works on speed
+//squared so the passes need one sqrt per sample at most. Returns the time
+//to drive it.
+static double profile(const std::vector<double> &k, double ds, const Limits &L, bool backwards, std::vector<double> &v){
+    size_t n = k.size();
+    std::vector<double> &u = v;
+    std::vector<double> q(n);
+    u.resize(n);
+    double vmax2 = L.vmax*L.vmax;
+    for (size_t i=0; i<n; i++){
+        q[i] = fabs(k[i])/L.grip;
+        u[i] = q[i]*vmax2 > 1 ? 1/q[i] : vmax2;
+    }
+    if (!n) return 0;
+    u[0] = 0;
+    u[n - 1] = 0;
+    double up = backwards ? L.brake : L.accel;
+    double down = backwards ? L.accel : L.brake;
+    for (size_t i=1; i<n; i++) reach(u, q, i, i - 1, up, ds);
+    for (size_t i=n - 1; i-- > 0;) reach(u, q, i, i + 1, down, ds);
+
+    double t = 0;
+    for (size_t i=0; i<n; i++) v[i] = sqrt(u[i]);
+    for (size_t i=1; i<n; i++){
+        double mean = 0.5*(v[i] + v[i - 1]);
+        if (mean > 0) t += ds/mean;
+    }
+    return t;
+}
+
+//Slowest speed of each bin of summed encoder counts as a PWM, counting
+//from the last sample when driving backwards
+static std::vector<int> bins(const std::vector<double> &v, double ds, bool backwards, double cpu, double binCounts,
+                             double vmin, double vTop){
+    double per = binCounts/(2*cpu); //track units per bin
+    size_t n = v.size();
+    size_t nb = (size_t)ceil(n*ds/per);
+    if (!nb) nb = 1;
+    std::vector<double> slow(nb, 1e30);
+    double scale = ds/per;
+    for (size_t i=0; i<n; i++){
+        size_t b = (size_t)(i*scale);
+        if (b >= nb) b = nb - 1;
+        double s = v[backwards ? n - 1 - i : i];
+        if (s < slow[b]) slow[b] = s;
+    }
+    std::vector<int> pwm(nb);
+    for (size_t b=0; b<nb; b++){
+        double s = fmax(slow[b], vmin);
+        int p = (int)lround(s/vTop*255);
+        pwm[b] = p < 0 ? 0 : p > 255 ? 255 : p;
+    }
+    return pwm;
+}
+
+static bool header(const char *path, const char *src, const std::string &name, const std::vector<int> legs[2],
+                   double binCounts, const Limits &L, double t){
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    size_t nb = legs[0].size() > legs[1].size() ? legs[0].size() : legs[1].size();
+    fprintf(f, "//Generated by hostTools/speedprof from %s, do not edit.\n", src);
+    fprintf(f, "//accel %g brake %g grip %g vmax %g, %.3f s for the slower leg.\n\n", L.accel, L.brake, L.grip, L.vmax, t);
+    fprintf(f, "const int %s_BINS = %zu;\n", name.c_str(), nb);
+    fprintf(f, "const uint32_t %s_BIN_COUNTS = %g; //summed left + right counts per bin\n\n", name.c_str(), binCounts);
+    fprintf(f, "//Forward PWM per bin, leg 0 there and leg 1 back\n");
+    fprintf(f, "constexpr uint8_t %s_PWM[2][%zu] = {", name.c_str(), nb);
+    for (int leg=0; leg<2; leg++){
+        fprintf(f, "\n    {");
+        for (size_t b=0; b<nb; b++){
+            int p = b < legs[leg].size() ? legs[leg][b] : legs[leg].back();
+            if (b) fprintf(f, b % 16 ? ", " : ",");
+            if (b % 16 == 0) fprintf(f, "\n        ");
+            fprintf(f, "%d", p);
+        }
+        fprintf(f, "\n    }%s", leg ? "" : ",");
+    }
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "//Forward PWM for a leg and the summed encoder counts since it started\n");
+    fprintf(f, "inline uint8_t %s_pwm(int leg, uint32_t counts){\n", name.c_str());
+    fprintf(f, "    uint32_t b = counts/%s_BIN_COUNTS;\n", name.c_str());
+    fprintf(f, "    return %s_PWM[leg ? 1 : 0][b < %s_BINS ? b : %s_BINS - 1];\n", name.c_str(), name.c_str(), name.c_str());
+    fprintf(f, "}\n");
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char **argv){
+    const char *in = 0, *out = 0, *csvOut = 0;
+    std::string name = "PROFILE";
+    double ds = 0.5, cpu = 360/(7*M_PI), binCounts = 32, vmin = 20, vTop = 93;
+    int window = 2;
+    Limits L;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "-d" && more) ds = atof(argv[++i]);
+        else if (a == "-w" && more) window = atoi(argv[++i]);
+        else if (a == "-a" && more) L.accel = atof(argv[++i]);
+        else if (a == "-b" && more) L.brake = atof(argv[++i]);
+        else if (a == "-g" && more) L.grip = atof(argv[++i]);
+        else if (a == "-v" && more) L.vmax = atof(argv[++i]);
+        else if (a == "-m" && more) vmin = atof(argv[++i]);
+        else if (a == "-V" && more) vTop = atof(argv[++i]);
+        else if (a == "-k" && more) cpu = atof(argv[++i]);
+        else if (a == "-B" && more) binCounts = atof(argv[++i]);
+        else if (a == "-H" && more) out = argv[++i];
+        else if (a == "-n" && more) name = argv[++i];
+        else if (a == "-c" && more) csvOut = argv[++i];
+        else if (!in) in = argv[i];
+        else in = 0, i = argc;
+    }
+    if (!in || ds <= 0 || binCounts < 1 || L.accel <= 0 || L.brake <= 0 || L.grip <= 0 || vTop <= 0){
+        fprintf(stderr, "usage: speedprof track.csv|track.col [-d ds] [-w window] [-a accel] [-b brake] [-g grip]\n"
+                        "                 [-v vmax] [-m vmin] [-V v_at_pwmax] [-k counts_per_unit] [-B bin_counts]\n"
+                        "                 [-H out.h] [-n NAME] [-c profile.csv]\n");
+        return 2;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    Track t;
+    size_t len = strlen(in);
+    if (len > 4 && strcmp(in + len - 4, ".col") == 0){
+        //cached tracks are used at their own spacing
+        if (!loadTrack(in, t)){
+            fprintf(stderr, "speedprof: cannot load %s\n", in);
+            return 2;
+        }
+    }
+    else{
+        std::vector<double> x, y;
+        if (!readTrackCSV(in, x, y) || x.size() < 2){
+            fprintf(stderr, "speedprof: cannot read a track from %s\n", in);
+            return 2;
+        }
+        t = resampleTrack(x, y, ds, window);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::vector<double> v[2];
+    std::vector<int> legs[2];
+    double lap = 0;
+    for (int leg=0; leg<2; leg++){
+        double tl = profile(t.curvature, t.ds, L, leg == 1, v[leg]);
+        if (tl > lap) lap = tl;
+        legs[leg] = bins(v[leg], t.ds, leg == 1, cpu, binCounts, vmin, vTop);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double vmean = lap > 0 ? t.length()/lap : 0;
+    printf("%zu samples every %g, length %.3f: %.3f s for the slower leg (mean %.2f/s, flat out %.3f s)\n",
+           t.size(), t.ds, t.length(), lap, vmean, t.length()/L.vmax);
+    printf("load %.2f ms, profile %.2f ms, %zu bins of %g counts\n",
+           std::chrono::duration<double, std::milli>(t1 - t0).count(),
+           std::chrono::duration<double, std::milli>(t2 - t1).count(), legs[0].size(), binCounts);
+
+    if (csvOut){
+        FILE *f = fopen(csvOut, "w");
+        if (!f){
+            fprintf(stderr, "speedprof: cannot write %s\n", csvOut);
+            return 2;
+        }
+        fprintf(f, "s,curvature,v_there,v_back\n");
+        size_t n = t.size();
+        for (size_t i=0; i<n; i++) fprintf(f, "%g,%g,%g,%g\n", t.s[i], t.curvature[i], v[0][i], v[1][i]);
+        fclose(f);
+    }
+    if (out && !header(out, in, name, legs, binCounts, L, lap)){
+        fprintf(stderr, "speedprof: cannot write %s\n", out);
+        return 2;
+    }
+    return 0;
+}
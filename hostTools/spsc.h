@@ -0,0 +1,46 @@
+//Bounded lock free single producer/single consumer queue.
+//Exactly one thread may push and exactly one other thread may pop.
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+template<class T>
+class SpscQueue{
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head; //next slot to pop, owned by the consumer
+    alignas(64) std::atomic<size_t> tail; //next slot to push, owned by the producer
+public:
+    //Capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity) : head(0), tail(0){
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    //False if the queue is full, the value is not consumed
+    bool push(const T &v){
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask) return false;
+        slots[t & mask] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    //False if the queue is empty
+    bool pop(T &v){
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        v = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
@@ -0,0 +1,981 @@
+//System identification of the host plant model (plant.h) from recorded runs.
+//
+//Runs come as captures of the car's serial output with RECORD (and
+//RECORD_PACKED) defined, or as run files made from them (convert rec). Two
+//parts of the model are fitted:
+//  motors, per wheel: maxSpeed, the gain, so the two wheels' mismatch,
+//  the time constant tau and the deadband, from the PWM, direction and
+//  sleep commands against the encoder counts;
+//  sensors: whiteUs, lineReflectance and the spot width, the mapping from
+//  where the line lies under the array to the discharge times, from the
+//  sensor frames; noise is then set to what the fit leaves over.
+//Everything else is held as the start model, -m, or plant.h's defaults
+//have it: wheel radius, counts per revolution, maxAccel and coastTau; the
+//array's geometry, lineWidth and timeout; floorReflectance, dark current,
+//emitter light and saturation, height and nominalHeight. The runs should
+//be made at that height without EMITTER_DIMMING, the fit takes the
+//emitters at full current. The result is a model file sim -m loads.
+//
+//Motors: each wheel's speed is simulated through a run with
+//MotorModel::step, the command of a frame held until the next frame. A
+//run starts at rest; a turnaround (its frame's spinL/spinR) is simulated
+//as motorSpin() until the wheel has turned the counts that ended it, then
+//the frame's own command, so the stretch carries on past the encoder
+//reset. Other resets start again from the speed the first window of
+//counts shows. The residuals are the edges predicted less the edges
+//counted over windows of -w ms, leaving out windows with the driver
+//asleep.
+//
+//Sensors: only frames with the line under the array on its own (not lost,
+//not a cross line) are used. Each frame has the line's position as its
+//own unknown and every SLANT_FRAMES frames in a row share one for the
+//angle the line crosses at (with one per frame the two edge channels fit
+//exactly and the spot comes out too wide). Levenberg-Marquardt steps all
+//of them at once on the log discharge times, the per frame unknowns
+//eliminated group by group. Readings cut off at the timeout count as
+//censored, by how likely the model makes that, not as the timeout. Frames
+//that fit worse than FRAME_OUTLIER times the median (the edge of a cross
+//line, the end of the tape) are left out and the fit repeated until the
+//frames left out and the noise settle. The read loop's skew, how much
+//shorter each channel reads than the one before, is fitted with the rest
+//and printed but not saved; sim's read loop makes its own.
+//
+//Both fits are Levenberg-Marquardt with finite difference Jacobians. The
+//runs (motors) or groups of frames (sensors) are shared out to -j threads,
+//each adding up its part of the normal equations, so many runs fit in the
+//time of a few.
+//
+//Check: a run of sim's default plant (sim's Build line with -DRECORD,
+//then sim simulation/track.csv -s > def.rec) fits back to maxSpeed
+//28.57/28.59 +- 0.05, tau 0.0500/0.0502, deadband 0.080/0.082 +- 0.006,
+//whiteUs 220.0, lineReflectance 0.046 +- 0.0012, spot 0.256 +- 0.0022 and
+//noise 0.021 (0.02 and the 4 us steps of the read loop), against
+//plant.h's 28.6, 0.05, 0.08, 220, 0.05, 0.25 and 0.02. Over other tracks
+//and SLANT_FRAMES spot and lineReflectance move by about 0.003 and 0.002,
+//more than their standard errors say.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -pthread -IhostTools/shim hostTools/sysid.cpp -o sysid
+//
+//Usage:
+//  sysid [-m start.col] [-o model.col] [-j threads] [-w window_ms] run.rec|run.col ...
+//
+//Defaults: the start model is plant.h's defaults, model.col, one thread per
+//core, 20 ms windows. Prints each fitted parameter with its standard error
+//and the rms residual. Exit status is 0 on success, 1 if a fit had too
+//little data (its parameters are left as they started), 2 on error.
+
+#include <Arduino.h>
+#include "../carFirmware/src/const.h"
+#include "plant.h"
+#include "recording.h"
+#include "runfile.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <math.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+//One recorded run, per frame
+struct Run{
+    std::string path;
+    std::vector<double> t; //s
+    std::vector<uint16_t> sensor; //REC_SENSORS per frame
+    std::vector<double> duty[2]; //-1..1, negative in reverse
+    std::vector<uint8_t> awake[2];
+    std::vector<uint32_t> enc[2];
+    std::vector<uint32_t> spin[2]; //counts that ended a turnaround in this frame, 0 if none
+    std::vector<uint8_t> restart; //encoders were reset before this frame
+    bool motors; //has the commands and encoders
+};
+
+static double dutyOf(uint32_t pwm, uint32_t dir){
+    double d = pwm/(double)PWM_FULLSCALE;
+    return dir == REVERSE ? -d : d;
+}
+
+static bool loadRecording(const char *path, Run &r){
+    std::vector<uint8_t> bytes;
+    std::vector<RecordFrame> fr;
+    if (!readFile(path, bytes)) return false;
+    parseRecording(bytes.data(), bytes.size(), fr);
+    double t = 0;
+    for (size_t k=0; k<fr.size(); k++){
+        //t_us wraps every 71 minutes
+        t += k ? (uint32_t)(fr[k].t_us - fr[k - 1].t_us)*1e-6 : 0;
+        r.t.push_back(t);
+        r.sensor.insert(r.sensor.end(), fr[k].sensor, fr[k].sensor + REC_SENSORS);
+        r.duty[0].push_back(dutyOf(fr[k].PWML, fr[k].DIR_L));
+        r.duty[1].push_back(dutyOf(fr[k].PWMR, fr[k].DIR_R));
+        r.awake[0].push_back(fr[k].nSLPL == HIGH);
+        r.awake[1].push_back(fr[k].nSLPR == HIGH);
+        r.enc[0].push_back(fr[k].encL);
+        r.enc[1].push_back(fr[k].encR);
+        r.spin[0].push_back(fr[k].spinL);
+        r.spin[1].push_back(fr[k].spinR);
+        bool reset = !k || fr[k - 1].spinL || fr[k - 1].spinR || fr[k].encL < fr[k - 1].encL || fr[k].encR < fr[k - 1].encR;
+        r.restart.push_back(reset);
+    }
+    r.motors = true;
+    return !fr.empty();
+}
+
+//Run file from convert rec, the motor columns are optional
+static bool loadRunFile(ColFile &f, Run &r){
+    size_t n = f.rows();
+    const uint32_t *t = f.column<uint32_t>("t_us");
+    if (!t) return false;
+    const uint16_t *s[REC_SENSORS];
+    for (int i=0; i<REC_SENSORS; i++){
+        char name[16];
+        snprintf(name, sizeof(name), "sensor%d", i);
+        if (!(s[i] = f.column<uint16_t>(name))) return false;
+    }
+    const uint16_t *pwm[2] = {f.column<uint16_t>("pwmL"), f.column<uint16_t>("pwmR")};
+    const uint16_t *dir[2] = {f.column<uint16_t>("dirL"), f.column<uint16_t>("dirR")};
+    const uint16_t *slp[2] = {f.column<uint16_t>("slpL"), f.column<uint16_t>("slpR")};
+    const uint32_t *enc[2] = {f.column<uint32_t>("encL"), f.column<uint32_t>("encR")};
+    const uint32_t *spin[2] = {f.column<uint32_t>("spinL"), f.column<uint32_t>("spinR")};
+    r.motors = pwm[0] && pwm[1] && dir[0] && dir[1] && enc[0] && enc[1];
+    double at = 0;
+    for (size_t k=0; k<n; k++){
+        at += k ? (uint32_t)(t[k] - t[k - 1])*1e-6 : 0;
+        r.t.push_back(at);
+        for (int i=0; i<REC_SENSORS; i++) r.sensor.push_back(s[i][k]);
+        if (!r.motors) continue;
+        for (int w=0; w<2; w++){
+            r.duty[w].push_back(dutyOf(pwm[w][k], dir[w][k]));
+            //without the sleep columns the drivers are taken as awake
+            r.awake[w].push_back(!slp[w] || slp[w][k] == HIGH);
+            r.enc[w].push_back(enc[w][k]);
+            //without the spin columns a turnaround is a reset like any other
+            r.spin[w].push_back(spin[w] ? spin[w][k] : 0);
+        }
+        r.restart.push_back(!k || enc[0][k] < enc[0][k - 1] || enc[1][k] < enc[1][k - 1]);
+    }
+    return n > 0;
+}
+
+//Residuals of one chunk of the data at parameters p, appended to r. The
+//count must not depend on p.
+typedef std::function<void(const std::vector<double> &p, size_t chunk, std::vector<double> &r)> Residuals;
+
+//Run f(thread, chunk) for every chunk on up to threads threads
+template<class F>
+static void parallelChunks(size_t chunks, int threads, F f){
+    std::atomic<size_t> next(0);
+    auto work = [&](int id){
+        for (size_t c; (c = next++) < chunks;) f(id, c);
+    };
+    std::vector<std::thread> pool;
+    for (int i=1; i<threads; i++) pool.emplace_back(work, i);
+    work(0);
+    for (std::thread &th : pool) th.join();
+}
+
+//Solve a x = b in place by elimination with partial pivoting, false if
+//singular
+static bool solve(std::vector<double> a, std::vector<double> &b, size_t n){
+    for (size_t c=0; c<n; c++){
+        size_t piv = c;
+        for (size_t r=c + 1; r<n; r++){
+            if (fabs(a[r*n + c]) > fabs(a[piv*n + c])) piv = r;
+        }
+        if (a[piv*n + c] == 0) return false;
+        for (size_t k=0; k<n; k++) std::swap(a[piv*n + k], a[c*n + k]);
+        std::swap(b[piv], b[c]);
+        for (size_t r=c + 1; r<n; r++){
+            double f = a[r*n + c]/a[c*n + c];
+            for (size_t k=c; k<n; k++) a[r*n + k] -= f*a[c*n + k];
+            b[r] -= f*b[c];
+        }
+    }
+    for (size_t r=n; r-- > 0;){
+        for (size_t k=r + 1; k<n; k++) b[r] -= a[r*n + k]*b[k];
+        b[r] /= a[r*n + r];
+    }
+    return true;
+}
+
+struct Fit{
+    std::vector<double> p;
+    std::vector<double> se; //standard errors
+    double rms = 0;
+    size_t n = 0; //residuals
+    int iterations = 0;
+};
+
+//Sum of squares and count of the residuals at p
+static double cost(const std::vector<double> &p, size_t chunks, int threads, const Residuals &f, size_t *count = 0){
+    std::vector<double> sums(threads, 0);
+    std::vector<size_t> counts(threads, 0);
+    parallelChunks(chunks, threads, [&](int id, size_t c){
+        std::vector<double> r;
+        f(p, c, r);
+        for (double v : r) sums[id] += v*v;
+        counts[id] += r.size();
+    });
+    double s = 0;
+    size_t n = 0;
+    for (int i=0; i<threads; i++){
+        s += sums[i];
+        n += counts[i];
+    }
+    if (count) *count = n;
+    return s;
+}
+
+//Levenberg-Marquardt from p, each parameter kept within [lo, hi]
+static Fit levenbergMarquardt(std::vector<double> p, const std::vector<double> &lo, const std::vector<double> &hi,
+                              size_t chunks, int threads, const Residuals &f, int maxIterations = 50){
+    size_t np = p.size();
+    Fit fit;
+    double lambda = 1e-3;
+    std::vector<double> A(np*np), g(np);
+    double s = cost(p, chunks, threads, f, &fit.n);
+    for (int it=0; it<maxIterations && fit.n > np; it++){
+        fit.iterations = it + 1;
+        //J'J and J'r, each thread its own share
+        std::vector<std::vector<double> > As(threads, std::vector<double>(np*np, 0)), gs(threads, std::vector<double>(np, 0));
+        std::vector<double> step(np);
+        for (size_t j=0; j<np; j++) step[j] = 1e-6*fmax(fabs(p[j]), 1e-3);
+        parallelChunks(chunks, threads, [&](int id, size_t c){
+            std::vector<double> r0;
+            f(p, c, r0);
+            std::vector<std::vector<double> > J(np);
+            for (size_t j=0; j<np; j++){
+                std::vector<double> q = p;
+                q[j] += step[j];
+                f(q, c, J[j]);
+                for (size_t k=0; k<r0.size(); k++) J[j][k] = (J[j][k] - r0[k])/step[j];
+            }
+            for (size_t k=0; k<r0.size(); k++){
+                for (size_t a=0; a<np; a++){
+                    gs[id][a] += J[a][k]*r0[k];
+                    for (size_t b=0; b<=a; b++) As[id][a*np + b] += J[a][k]*J[b][k];
+                }
+            }
+        });
+        std::fill(A.begin(), A.end(), 0);
+        std::fill(g.begin(), g.end(), 0);
+        for (int t=0; t<threads; t++){
+            for (size_t a=0; a<np; a++){
+                g[a] += gs[t][a];
+                for (size_t b=0; b<=a; b++) A[a*np + b] += As[t][a*np + b];
+            }
+        }
+        for (size_t a=0; a<np; a++){
+            for (size_t b=0; b<a; b++) A[b*np + a] = A[a*np + b];
+        }
+
+        bool better = false;
+        double next = s;
+        std::vector<double> q(np);
+        for (int tries=0; tries<10 && !better; tries++){
+            std::vector<double> M = A, d(np);
+            for (size_t a=0; a<np; a++){
+                M[a*np + a] += lambda*fmax(A[a*np + a], 1e-12);
+                d[a] = -g[a];
+            }
+            if (!solve(M, d, np)){
+                lambda *= 4;
+                continue;
+            }
+            for (size_t a=0; a<np; a++) q[a] = fmin(hi[a], fmax(lo[a], p[a] + d[a]));
+            next = cost(q, chunks, threads, f);
+            if (next < s){
+                better = true;
+                lambda = fmax(lambda/3, 1e-9);
+            }
+            else lambda *= 4;
+        }
+        if (!better) break;
+        double drop = s - next;
+        p = q;
+        s = next;
+        if (drop <= 1e-10*s) break;
+    }
+    fit.p = p;
+    fit.rms = fit.n ? sqrt(s/fit.n) : 0;
+    //standard errors from the inverse of J'J at the last linearisation
+    fit.se.assign(np, 0);
+    if (fit.n > np){
+        double var = s/(fit.n - np);
+        for (size_t a=0; a<np; a++){
+            std::vector<double> e(np, 0);
+            e[a] = 1;
+            if (solve(A, e, np)) fit.se[a] = sqrt(fmax(0, e[a]*var));
+        }
+    }
+    return fit;
+}
+
+//Motor fit
+
+//The turnaround's command (motorSpin() in carFirmware/src/control/motor.h),
+//which its frame does not show: left forward, right reverse, full duty
+const double SPIN_DUTY[2] = {1, -1};
+
+//Predicted less counted encoder edges of wheel w per window of a run
+static void motorResiduals(const Run &r, int w, const MotorModel &m, double countsPerRev, double window,
+                           std::vector<double> &out){
+    const double perRad = countsPerRev/(2*M_PI);
+    size_t n = r.t.size(), a = 0;
+    while (a + 1 < n){
+        //stretch [a, b) between gaps in the frames and encoder resets other
+        //than turnarounds
+        size_t b = a + 1;
+        while (b < n && r.t[b] - r.t[b - 1] > 0 && r.t[b] - r.t[b - 1] < 0.5 &&
+               (!r.restart[b] || r.spin[0][b - 1] || r.spin[1][b - 1])) b++;
+
+        //a run starts standing, anything else from the speed of the first
+        //window
+        size_t k0 = a;
+        double omega = 0;
+        if (a){
+            while (k0 + 1 < b && r.t[k0] - r.t[a] < window) k0++;
+            if (r.t[k0] > r.t[a]) omega = (r.enc[w][k0] - r.enc[w][a])/perRad/(r.t[k0] - r.t[a]);
+            if (r.duty[w][a] < 0) omega = -omega;
+        }
+
+        double predicted = 0, mark = 0;
+        size_t from = k0;
+        bool asleep = false;
+        for (size_t k=a; k + 1<b; k++){
+            double dt = r.t[k + 1] - r.t[k];
+            //a turnaround spins until its counts are in, then drives off
+            //with the frame's command
+            bool turned = r.spin[0][k] || r.spin[1][k];
+            int sub = (int)ceil(dt/(turned ? 1e-4 : 1e-3));
+            double h = dt/sub, spun = 0;
+            for (int i=0; i<sub; i++){
+                double next = turned && spun < r.spin[w][k] ? m.step(omega, SPIN_DUTY[w], true, h)
+                                                             : m.step(omega, r.duty[w][k], r.awake[w][k], h);
+                double edges = 0.5*(fabs(omega) + fabs(next))*h*perRad;
+                predicted += edges;
+                spun += edges;
+                omega = next;
+            }
+            if (k + 1 <= k0 || turned){
+                //the window in progress ran into the reset
+                if (turned) from = k + 1;
+                mark = predicted;
+                asleep = false;
+                continue;
+            }
+            if (!r.awake[w][k]) asleep = true;
+            if (r.t[k + 1] - r.t[from] >= window){
+                if (!asleep) out.push_back((predicted - mark) - (double)(r.enc[w][k + 1] - r.enc[w][from]));
+                from = k + 1;
+                mark = predicted;
+                asleep = false;
+            }
+        }
+        a = b;
+    }
+}
+
+//Sensor fit
+
+const double SLANT_MIN = 0.8, SLANT_MAX = 4;
+//Frames in a row that share a slant. The car turns little over a few
+//frames, and a slant of its own would let every frame fit the readings on
+//both edges of the line exactly, leaving the spot and the line's
+//reflectance nothing to go on.
+const size_t SLANT_FRAMES = 4;
+//Readings this close to the timeout are taken as cut off by it, the read
+//loop's step short of it on the car
+const double CLIPPED = 0.99;
+//Noise below this is not believed when weighing the cut off readings
+const double NOISE_MIN = 0.005;
+//A frame is left out of the fit when its rms is more than this many times
+//the median frame's: an edge of a cross line or the end of the tape under
+//the array, which lineAlone() lets through
+const double FRAME_OUTLIER = 3;
+
+//Frames with the line alone under the array, their readings as logs
+struct SensorData{
+    std::vector<double> logUs; //REC_SENSORS per frame
+    std::vector<double> lateral; //line position per frame
+    std::vector<uint8_t> fits; //no more off the model than the frames around it
+    std::vector<size_t> groups; //first frame of each group sharing a slant, then the frame count
+    std::vector<double> slant; //per group, how many times its width the line looks across the array
+};
+
+static bool lineAlone(const uint16_t *v){
+    int lo = 0, hi = 0;
+    for (int i=1; i<REC_SENSORS; i++){
+        if (v[i] < v[lo]) lo = i;
+        if (v[i] > v[hi]) hi = i;
+    }
+    //lost, or the line off the end of the array
+    if (v[hi] < 2*v[lo] || hi == 0 || hi == REC_SENSORS - 1) return false;
+    int dark = 0;
+    for (int i=0; i<REC_SENSORS; i++) dark += v[i] > (v[lo] + v[hi])/2;
+    //a cross line darkens most of the array
+    return dark <= 3;
+}
+
+//What the sensor fit varies: the plant's QtrModel and the skew of the
+//firmware's read loop, which takes the time once a sweep but reads the
+//lines one after the other, so each reads short by the time it took to
+//read the line before it. The skew is fitted so it does not bend the rest
+//but is no part of the plant, sim's read loop makes its own.
+struct SensorModel{
+    QtrModel qtr;
+    double skewUs; //per channel, the middle of the array reading true
+};
+
+//Log discharge times of every channel with the line at lateral, crossing
+//the array at an angle that makes it look slant times as wide, before the
+//timeout cuts them off
+static void predictLog(const SensorModel &m, double lateral, double slant, double *out){
+    QtrModel q = m.qtr;
+    double sigma = q.sigma();
+    q.timeoutUs = INFINITY;
+    for (int i=0; i<REC_SENSORS; i++){
+        double c = spotInBand((q.offset(i) - lateral)/slant, q.lineWidth, sigma);
+        double t = q.dischargeUs(c, 1, 0) - m.skewUs*(i - (REC_SENSORS - 1)/2.0);
+        out[i] = log(fmax(t, 1.0));
+    }
+}
+
+//-log of the standard normal cdf, without underflow far into the tail
+static double negLogCdf(double z){
+    if (z > -30) return -log(normalCdf(z));
+    return 0.5*z*z + log(-z*sqrt(2*M_PI));
+}
+
+//Residuals of one frame, predicted less read log discharge times. A
+//reading the timeout cut off only says the time was longer, so it is
+//weighed by how likely that was with the model's noise (a censored
+//normal): nothing if the prediction is well past the timeout, growing like
+//an ordinary residual the further short of it.
+static void lineResiduals(const SensorModel &m, const double *logUs, double lateral, double slant, double *r){
+    predictLog(m, lateral, slant, r);
+    double logTimeout = log(m.qtr.timeoutUs), sigma = fmax(m.qtr.noise, NOISE_MIN);
+    for (int i=0; i<REC_SENSORS; i++){
+        if (logUs[i] >= logTimeout + log(CLIPPED)) r[i] = sigma*sqrt(2*negLogCdf((r[i] - logTimeout)/sigma));
+        else r[i] -= logUs[i];
+    }
+}
+
+static double frameCost(const SensorModel &m, const double *logUs, double lateral, double slant){
+    double r[REC_SENSORS], s = 0;
+    lineResiduals(m, logUs, lateral, slant, r);
+    for (int i=0; i<REC_SENSORS; i++) s += r[i]*r[i];
+    return s;
+}
+
+//Minimum of f on [a, b] by golden section
+template<class F>
+static double goldenSection(F f, double a, double b, int iterations){
+    const double phi = 0.5*(sqrt(5.0) - 1);
+    double c = b - phi*(b - a), d = a + phi*(b - a);
+    double fc = f(c), fd = f(d);
+    for (int i=0; i<iterations; i++){
+        if (fc < fd){
+            b = d;
+            d = c;
+            fd = fc;
+            c = b - phi*(b - a);
+            fc = f(c);
+        }
+        else{
+            a = c;
+            c = d;
+            fc = fd;
+            d = a + phi*(b - a);
+            fd = f(d);
+        }
+    }
+    return 0.5*(a + b);
+}
+
+//Line position under one frame at a given slant, searched on a grid within
+//reach of around and refined within one grid step of the best point
+static double fitLateral(const SensorModel &m, const double *logUs, double slant, double around, double reach){
+    const double grid = 0.05;
+    double best = around, bestCost = INFINITY;
+    for (double l=around - reach; l<=around + reach; l+=grid){
+        double c = frameCost(m, logUs, l, slant);
+        if (c < bestCost){
+            bestCost = c;
+            best = l;
+        }
+    }
+    return goldenSection([&](double l){ return frameCost(m, logUs, l, slant); }, best - grid, best + grid, 24);
+}
+
+//Line under group g: its frames' positions within reach of where they are,
+//then the slant by golden section with the positions refitted at each step.
+//A slant a little under 1 is allowed so noise does not pile the straight
+//groups up against the bound.
+static void placeGroup(const SensorModel &m, SensorData &sd, size_t g, double reach){
+    size_t a = sd.groups[g], b = sd.groups[g + 1];
+    for (size_t k=a; k<b; k++) sd.lateral[k] = fitLateral(m, &sd.logUs[k*REC_SENSORS], sd.slant[g], sd.lateral[k], reach);
+    auto cost = [&](double s){
+        double c = 0;
+        for (size_t k=a; k<b; k++){
+            const double *v = &sd.logUs[k*REC_SENSORS];
+            c += frameCost(m, v, fitLateral(m, v, s, sd.lateral[k], 0), s);
+        }
+        return c;
+    };
+    sd.slant[g] = goldenSection(cost, SLANT_MIN, SLANT_MAX, 20);
+    for (size_t k=a; k<b; k++) sd.lateral[k] = fitLateral(m, &sd.logUs[k*REC_SENSORS], sd.slant[g], sd.lateral[k], 0);
+}
+
+static SensorModel withSensor(QtrModel q, const std::vector<double> &p){
+    q.whiteUs = p[0];
+    q.lineReflectance = p[1];
+    q.spot = p[2];
+    SensorModel m = {q, p[3]};
+    return m;
+}
+
+//A group's residuals and their derivatives by its own unknowns: the
+//positions of its frames that fit, then the slant. C and e are J'J and J'r
+//over those unknowns.
+struct GroupJacobian{
+    size_t frame[SLANT_FRAMES];
+    size_t n; //frames that fit, the unknowns are one more
+    double r[SLANT_FRAMES][REC_SENSORS];
+    double dl[SLANT_FRAMES][REC_SENSORS]; //by the frame's position
+    double ds[SLANT_FRAMES][REC_SENSORS]; //by the slant
+    std::vector<double> C, e;
+};
+
+static void groupJacobian(const SensorModel &m, const SensorData &sd, size_t g, GroupJacobian &J){
+    const double h = 1e-6;
+    double slant = sd.slant[g], shifted[REC_SENSORS];
+    J.n = 0;
+    for (size_t k=sd.groups[g]; k<sd.groups[g + 1]; k++){
+        if (!sd.fits[k]) continue;
+        size_t j = J.n++;
+        const double *v = &sd.logUs[k*REC_SENSORS];
+        J.frame[j] = k;
+        lineResiduals(m, v, sd.lateral[k], slant, J.r[j]);
+        lineResiduals(m, v, sd.lateral[k] + h, slant, shifted);
+        for (int i=0; i<REC_SENSORS; i++) J.dl[j][i] = (shifted[i] - J.r[j][i])/h;
+        lineResiduals(m, v, sd.lateral[k], slant + h, shifted);
+        for (int i=0; i<REC_SENSORS; i++) J.ds[j][i] = (shifted[i] - J.r[j][i])/h;
+    }
+    size_t u = J.n + 1;
+    J.C.assign(u*u, 0);
+    J.e.assign(u, 0);
+    for (size_t j=0; j<J.n; j++){
+        for (int i=0; i<REC_SENSORS; i++){
+            J.C[j*u + j] += J.dl[j][i]*J.dl[j][i];
+            J.C[j*u + J.n] += J.dl[j][i]*J.ds[j][i];
+            J.C[J.n*u + J.n] += J.ds[j][i]*J.ds[j][i];
+            J.e[j] += J.dl[j][i]*J.r[j][i];
+            J.e[J.n] += J.ds[j][i]*J.r[j][i];
+        }
+        J.C[J.n*u + j] = J.C[j*u + J.n];
+    }
+}
+
+//Run f(group) for every group on up to threads threads
+template<class F>
+static void eachGroup(const SensorData &sd, int threads, F f){
+    const size_t BLOCK = 64, groups = sd.slant.size();
+    parallelChunks((groups + BLOCK - 1)/BLOCK, threads, [&](int id, size_t c){
+        for (size_t g=c*BLOCK; g<groups && g<(c + 1)*BLOCK; g++) f(id, g);
+    });
+}
+
+//Noise from the readings far enough short of the timeout that it cannot
+//have cut them off, less what fitting the lines took out of them (the
+//diagonal of the hat matrix of each group's unknowns)
+static double estimateNoise(const SensorModel &m, const SensorData &sd){
+    double sumSq = 0, dof = 0;
+    double logTimeout = log(m.qtr.timeoutUs), sigma = fmax(m.qtr.noise, NOISE_MIN);
+    GroupJacobian J;
+    for (size_t g=0; g<sd.slant.size(); g++){
+        groupJacobian(m, sd, g, J);
+        if (!J.n) continue;
+        size_t u = J.n + 1;
+        bool free = sd.slant[g] > SLANT_MIN && sd.slant[g] < SLANT_MAX;
+        for (size_t j=0; j<J.n; j++){
+            const double *v = &sd.logUs[J.frame[j]*REC_SENSORS];
+            double pred[REC_SENSORS];
+            predictLog(m, sd.lateral[J.frame[j]], sd.slant[g], pred);
+            for (int i=0; i<REC_SENSORS; i++){
+                if (pred[i] > logTimeout - 3*sigma || v[i] >= logTimeout + log(CLIPPED)) continue;
+                //row of J for this reading, C^-1 row'
+                std::vector<double> row(u, 0), x;
+                row[j] = J.dl[j][i];
+                if (free) row[J.n] = J.ds[j][i];
+                x = row;
+                std::vector<double> C = J.C;
+                if (!free){
+                    for (size_t a=0; a<u; a++) C[a*u + J.n] = C[J.n*u + a] = a == J.n;
+                }
+                double lev = 0;
+                if (solve(C, x, u)){
+                    for (size_t a=0; a<u; a++) lev += row[a]*x[a];
+                }
+                sumSq += (pred[i] - v[i])*(pred[i] - v[i]);
+                dof += 1 - lev;
+            }
+        }
+    }
+    return dof > 0 ? sqrt(sumSq/dof) : m.qtr.noise;
+}
+
+//Sum of squares over the frames that fit
+static double sensorCost(const QtrModel &base, const std::vector<double> &p, const SensorData &sd,
+                         const std::vector<double> &lateral, const std::vector<double> &slant, int threads){
+    SensorModel m = withSensor(base, p);
+    std::vector<double> sums(threads, 0);
+    eachGroup(sd, threads, [&](int id, size_t g){
+        for (size_t k=sd.groups[g]; k<sd.groups[g + 1]; k++){
+            if (sd.fits[k]) sums[id] += frameCost(m, &sd.logUs[k*REC_SENSORS], lateral[k], slant[g]);
+        }
+    });
+    double s = 0;
+    for (double v : sums) s += v;
+    return s;
+}
+
+//Levenberg-Marquardt over the sensor parameters p (whiteUs,
+//lineReflectance, spot and the read skew) and the lines under all
+//the frames that fit together. A group's positions and slant only move its
+//own residuals, so each step eliminates them group by group (the Schur
+//complement) and solves for the parameters alone, and the standard errors
+//are the parameters' with every line free as well.
+static Fit fitSensors(const QtrModel &base, std::vector<double> p, const std::vector<double> &lo, const std::vector<double> &hi,
+                      SensorData &sd, int threads, int maxIterations = 50){
+    const size_t NP = 4, U = SLANT_FRAMES + 1, groups = sd.slant.size();
+    Fit fit;
+    fit.p = p;
+    fit.se.assign(NP, 0);
+    size_t kept = 0, unknowns = 0;
+    for (size_t g=0; g<groups; g++){
+        size_t n = 0;
+        for (size_t k=sd.groups[g]; k<sd.groups[g + 1]; k++) n += sd.fits[k];
+        kept += n;
+        unknowns += n ? n + 1 : 0;
+    }
+    fit.n = kept*REC_SENSORS;
+    if (fit.n <= NP + unknowns) return fit;
+
+    //per group: its unknowns' frames, C and e, and B = Jp'J
+    std::vector<size_t> count(groups), frame(groups*SLANT_FRAMES);
+    std::vector<double> C(groups*U*U), e(groups*U), B(groups*NP*U);
+    std::vector<double> A(NP*NP), g(NP), S(NP*NP);
+    //reduce to the parameters with the lines damped by mu into M and d,
+    //keeping X = C^-1 B' and y = C^-1 e of each group for the way back
+    std::vector<double> X(groups*U*NP), y(groups*U);
+    std::vector<uint8_t> held(groups);
+    auto reduce = [&](double mu, std::vector<double> &M, std::vector<double> &d){
+        M = A;
+        d.assign(NP, 0);
+        for (size_t a=0; a<NP; a++){
+            M[a*NP + a] += mu*fmax(A[a*NP + a], 1e-12);
+            d[a] = -g[a];
+        }
+        for (size_t gr=0; gr<groups; gr++){
+            size_t u = count[gr] ? count[gr] + 1 : 0;
+            held[gr] = 1;
+            if (!u) continue;
+            std::vector<double> Cd(u*u);
+            for (size_t a=0; a<u; a++){
+                for (size_t b=0; b<u; b++) Cd[a*u + b] = C[gr*U*U + a*u + b];
+                Cd[a*u + a] += mu*fmax(Cd[a*u + a], 1e-12);
+            }
+            std::vector<double> yk(e.begin() + gr*U, e.begin() + gr*U + u);
+            //a group that cannot place its line keeps it where it is
+            if (!solve(Cd, yk, u)) continue;
+            std::vector<double> xk[NP];
+            bool ok = true;
+            for (size_t a=0; a<NP && ok; a++){
+                xk[a].assign(B.begin() + (gr*NP + a)*U, B.begin() + (gr*NP + a)*U + u);
+                ok = solve(Cd, xk[a], u);
+            }
+            if (!ok) continue;
+            held[gr] = 0;
+            for (size_t c=0; c<u; c++){
+                y[gr*U + c] = yk[c];
+                for (size_t a=0; a<NP; a++) X[(gr*U + c)*NP + a] = xk[a][c];
+            }
+            for (size_t a=0; a<NP; a++){
+                const double *Ba = &B[(gr*NP + a)*U];
+                for (size_t c=0; c<u; c++) d[a] += Ba[c]*yk[c];
+                for (size_t b=0; b<NP; b++){
+                    for (size_t c=0; c<u; c++) M[a*NP + b] -= Ba[c]*xk[b][c];
+                }
+            }
+        }
+    };
+
+    double lambda = 1e-3;
+    double s = sensorCost(base, p, sd, sd.lateral, sd.slant, threads);
+    for (int it=0; it<maxIterations; it++){
+        fit.iterations = it + 1;
+        std::vector<std::vector<double> > As(threads, std::vector<double>(NP*NP, 0)), gs(threads, std::vector<double>(NP, 0));
+        std::vector<double> step(NP);
+        for (size_t j=0; j<NP; j++) step[j] = 1e-6*fmax(fabs(p[j]), 1e-3);
+        SensorModel m0 = withSensor(base, p), ms[NP];
+        for (size_t j=0; j<NP; j++){
+            std::vector<double> pj = p;
+            pj[j] += step[j];
+            ms[j] = withSensor(base, pj);
+        }
+        eachGroup(sd, threads, [&](int id, size_t gr){
+            GroupJacobian J;
+            groupJacobian(m0, sd, gr, J);
+            count[gr] = J.n;
+            if (!J.n) return;
+            size_t u = J.n + 1;
+            for (size_t a=0; a<u*u; a++) C[gr*U*U + a] = J.C[a];
+            for (size_t a=0; a<u; a++) e[gr*U + a] = J.e[a];
+            std::fill(B.begin() + gr*NP*U, B.begin() + (gr + 1)*NP*U, 0);
+            for (size_t j=0; j<J.n; j++){
+                size_t k = J.frame[j];
+                frame[gr*SLANT_FRAMES + j] = k;
+                const double *v = &sd.logUs[k*REC_SENSORS];
+                double Jp[NP][REC_SENSORS];
+                for (size_t a=0; a<NP; a++){
+                    lineResiduals(ms[a], v, sd.lateral[k], sd.slant[gr], Jp[a]);
+                    for (int i=0; i<REC_SENSORS; i++) Jp[a][i] = (Jp[a][i] - J.r[j][i])/step[a];
+                }
+                for (size_t a=0; a<NP; a++){
+                    double *Ba = &B[(gr*NP + a)*U];
+                    for (int i=0; i<REC_SENSORS; i++){
+                        gs[id][a] += Jp[a][i]*J.r[j][i];
+                        for (size_t b=0; b<NP; b++) As[id][a*NP + b] += Jp[a][i]*Jp[b][i];
+                        Ba[j] += Jp[a][i]*J.dl[j][i];
+                        Ba[J.n] += Jp[a][i]*J.ds[j][i];
+                    }
+                }
+            }
+        });
+        std::fill(A.begin(), A.end(), 0);
+        std::fill(g.begin(), g.end(), 0);
+        for (int t=0; t<threads; t++){
+            for (size_t a=0; a<NP; a++){
+                g[a] += gs[t][a];
+                for (size_t b=0; b<NP; b++) A[a*NP + b] += As[t][a*NP + b];
+            }
+        }
+
+        bool better = false;
+        double next = s;
+        std::vector<double> q(NP), lat = sd.lateral, sl = sd.slant, d;
+        for (int tries=0; tries<10 && !better; tries++){
+            reduce(lambda, S, d);
+            if (!solve(S, d, NP)){
+                lambda *= 4;
+                continue;
+            }
+            for (size_t a=0; a<NP; a++) q[a] = fmin(hi[a], fmax(lo[a], p[a] + d[a]));
+            //each group's unknowns move by -C^-1 (e + B'dp)
+            for (size_t gr=0; gr<groups; gr++){
+                size_t n = count[gr];
+                if (!n || held[gr]) continue;
+                for (size_t c=0; c<=n; c++){
+                    double du = -y[gr*U + c];
+                    for (size_t a=0; a<NP; a++) du -= X[(gr*U + c)*NP + a]*d[a];
+                    if (c < n) lat[frame[gr*SLANT_FRAMES + c]] = sd.lateral[frame[gr*SLANT_FRAMES + c]] + du;
+                    else sl[gr] = fmin(SLANT_MAX, fmax(SLANT_MIN, sd.slant[gr] + du));
+                }
+            }
+            next = sensorCost(base, q, sd, lat, sl, threads);
+            if (next < s){
+                better = true;
+                lambda = fmax(lambda/3, 1e-9);
+            }
+            else lambda *= 4;
+        }
+        if (!better) break;
+        double drop = s - next;
+        p = q;
+        sd.lateral = lat;
+        sd.slant = sl;
+        s = next;
+        if (drop <= 1e-10*s) break;
+    }
+    fit.p = p;
+    fit.rms = sqrt(s/fit.n);
+    //standard errors from the inverse of the undamped reduced system
+    std::vector<double> d;
+    reduce(0, S, d);
+    double var = s/(fit.n - NP - unknowns);
+    for (size_t a=0; a<NP; a++){
+        std::vector<double> u(NP, 0);
+        u[a] = 1;
+        if (solve(S, u, NP)) fit.se[a] = sqrt(fmax(0, u[a]*var));
+    }
+    return fit;
+}
+
+static void printFit(const char *what, const Fit &f, const char *const *names){
+    printf("%s: %zu residuals, rms %.4g, %d iterations\n", what, f.n, f.rms, f.iterations);
+    for (size_t j=0; j<f.p.size(); j++) printf("  %-16s %10.5g +- %.2g\n", names[j], f.p[j], f.se[j]);
+}
+
+int main(int argc, char **argv){
+    const char *start = 0, *out = "model.col";
+    int threads = std::thread::hardware_concurrency();
+    double windowMs = 20;
+    std::vector<const char *> paths;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "-m" && more) start = argv[++i];
+        else if (a == "-o" && more) out = argv[++i];
+        else if (a == "-j" && more) threads = atoi(argv[++i]);
+        else if (a == "-w" && more) windowMs = atof(argv[++i]);
+        else if (a[0] == '-') paths.clear(), i = argc;
+        else paths.push_back(argv[i]);
+    }
+    if (threads < 1) threads = 1;
+    if (paths.empty() || windowMs <= 0){
+        fprintf(stderr, "usage: sysid [-m start.col] [-o model.col] [-j threads] [-w window_ms] run.rec|run.col ...\n");
+        return 2;
+    }
+
+    //the plant only holds the parameters here, it never drives
+    Track none;
+    Plant model(none);
+    if (start && !loadModel(start, model)){
+        fprintf(stderr, "sysid: cannot load model %s\n", start);
+        return 2;
+    }
+
+    std::vector<Run> runs(paths.size());
+    size_t frames = 0;
+    for (size_t i=0; i<paths.size(); i++){
+        Run &r = runs[i];
+        r.path = paths[i];
+        ColFile f;
+        bool ok = f.open(paths[i]) && f.kind() == KIND_RUN ? loadRunFile(f, r) : loadRecording(paths[i], r);
+        if (!ok){
+            fprintf(stderr, "sysid: no frames in %s\n", paths[i]);
+            return 2;
+        }
+        frames += r.t.size();
+    }
+    printf("%zu runs, %zu frames, %d threads\n", runs.size(), frames, threads);
+    auto t0 = std::chrono::steady_clock::now();
+    bool short_ = false;
+
+    //motors, the wheels one after the other, the runs across threads
+    std::vector<size_t> motorRuns;
+    for (size_t i=0; i<runs.size(); i++) if (runs[i].motors) motorRuns.push_back(i);
+    MotorModel *motor[2] = {&model.motorL, &model.motorR};
+    const char *side[2] = {"left motor", "right motor"};
+    const char *motorNames[3] = {"maxSpeed", "tau", "deadband"};
+    for (int w=0; w<2; w++){
+        MotorModel base = *motor[w];
+        Residuals f = [&](const std::vector<double> &p, size_t c, std::vector<double> &r){
+            MotorModel m = base;
+            m.maxSpeed = p[0];
+            m.tau = p[1];
+            m.deadband = p[2];
+            motorResiduals(runs[motorRuns[c]], w, m, model.countsPerRev, windowMs*1e-3, r);
+        };
+        std::vector<double> p = {base.maxSpeed, base.tau, base.deadband};
+        Fit fit = levenbergMarquardt(p, {1, 1e-3, 0}, {1e3, 2, 0.9}, motorRuns.size(), threads, f);
+        if (fit.n < 20){
+            printf("%s: %zu windows, too few to fit\n", side[w], fit.n);
+            short_ = true;
+            continue;
+        }
+        motor[w]->maxSpeed = fit.p[0];
+        motor[w]->tau = fit.p[1];
+        motor[w]->deadband = fit.p[2];
+        printFit(side[w], fit, motorNames);
+    }
+    if (model.motorL.maxSpeed > 0){
+        printf("gain mismatch right/left %.4f\n", model.motorR.maxSpeed/model.motorL.maxSpeed);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    //sensors, groups of frames across threads
+    SensorData sd;
+    for (const Run &r : runs){
+        size_t last = r.t.size();
+        for (size_t k=0; k<r.t.size(); k++){
+            const uint16_t *v = &r.sensor[k*REC_SENSORS];
+            if (!lineAlone(v)) continue;
+            //a group is frames in a row of one run
+            size_t used = sd.logUs.size()/REC_SENSORS;
+            if (k != last + 1 || sd.groups.empty() || used - sd.groups.back() == SLANT_FRAMES) sd.groups.push_back(used);
+            last = k;
+            for (int i=0; i<REC_SENSORS; i++) sd.logUs.push_back(log(fmax(v[i], 1)));
+        }
+    }
+    size_t used = sd.logUs.size()/REC_SENSORS;
+    sd.groups.push_back(used);
+    const char *sensorNames[4] = {"whiteUs", "lineReflectance", "spot", "skewUs"};
+    if (used < 50){
+        printf("sensors: %zu frames with the line under the array, too few to fit\n", used);
+        short_ = true;
+    }
+    else{
+        sd.lateral.assign(used, 0);
+        sd.fits.assign(used, 0);
+        sd.slant.assign(sd.groups.size() - 1, 1);
+        std::vector<double> p = {model.qtr.whiteUs, model.qtr.lineReflectance, model.qtr.spot, 0};
+        std::vector<double> frameRms(used);
+        double span = 0.5*(REC_SENSORS - 1)*model.qtr.pitch + 1;
+        Fit fit;
+        bool settled = false;
+        for (int round=0; round<8 && !settled; round++){
+            //the lines under every group the first time, over the whole
+            //array with the start parameters, after that the frames the fit
+            //left out
+            SensorModel m = withSensor(model.qtr, p);
+            eachGroup(sd, threads, [&](int, size_t g){
+                if (!round) placeGroup(m, sd, g, span);
+                for (size_t k=sd.groups[g]; k<sd.groups[g + 1]; k++){
+                    const double *v = &sd.logUs[k*REC_SENSORS];
+                    if (round && !sd.fits[k]) sd.lateral[k] = fitLateral(m, v, sd.slant[g], sd.lateral[k], 0);
+                    frameRms[k] = sqrt(frameCost(m, v, sd.lateral[k], sd.slant[g])/REC_SENSORS);
+                }
+            });
+            std::vector<double> sorted = frameRms;
+            std::nth_element(sorted.begin(), sorted.begin() + used/2, sorted.end());
+            double limit = FRAME_OUTLIER*sorted[used/2];
+            bool changed = false;
+            for (size_t k=0; k<used; k++){
+                bool fits = frameRms[k] <= limit;
+                changed |= fits != sd.fits[k];
+                sd.fits[k] = fits;
+            }
+            fit = fitSensors(model.qtr, p, {1, 1e-4, 0.01, -10}, {model.qtr.timeoutUs, model.qtr.floorReflectance, 5, 10}, sd, threads);
+            p = fit.p;
+            //the cut off readings are weighed by the noise, so again until
+            //it and the frames that fit stay put
+            double noise = estimateNoise(withSensor(model.qtr, p), sd);
+            settled = !changed && fabs(noise - model.qtr.noise) < 0.02*model.qtr.noise;
+            model.qtr.noise = noise;
+        }
+        model.qtr.whiteUs = p[0];
+        model.qtr.lineReflectance = p[1];
+        model.qtr.spot = p[2];
+        size_t kept = 0;
+        for (uint8_t f : sd.fits) kept += f;
+        printf("%zu of %zu frames with the line under the array, %zu left out\n", used, frames, used - kept);
+        printFit("sensors", fit, sensorNames);
+        printf("  %-16s %10.5g\n", "noise", model.qtr.noise);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    auto ms = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b){
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    printf("motor fit %.1f ms, sensor fit %.1f ms\n", ms(t0, t1), ms(t1, t2));
+    if (!saveModel(model, out)){
+        fprintf(stderr, "sysid: cannot write %s\n", out);
+        return 2;
+    }
+    printf("wrote %s\n", out);
+    return short_ ? 1 : 0;
+}
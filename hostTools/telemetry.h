@@ -0,0 +1,140 @@
+//Incremental decoder for the BufferIO framed telemetry the firmware prints:
+//a run of 'S' start markers, a json object, then a run of 'E' end markers,
+//e.g. SSSSSSSSSS{"sensor":[620,540,...],"pos":4512,"PWML":1200,"PWMR":1180}EEEEEEEEEE
+//
+//Bytes can be fed in any chunking; a frame is reported once its first end
+//marker arrives. The "sensor" array is required; "pos", "PWML" and "PWMR"
+//(the fields TelemetryWriter sends) are decoded when present and flagged in
+//TelemetryValues::has, other keys are ignored.
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int TELEMETRY_SENSORS = 8;
+//Middle of the array in posFind() units, which run 1 to 8 across it. The
+//car steers to const.h's C instead, a long, so 4: half a channel towards
+//sensor 0 of this.
+const float LINE_CENTRE = 4.5;
+const int TELEMETRY_MAX_PAYLOAD = 512; //longer payloads are treated as noise
+
+struct SensorFrame{
+    uint32_t stream; //which car/port the frame came from
+    uint64_t t_us; //host receive time
+    uint16_t sensor[TELEMETRY_SENSORS];
+};
+
+//Optional keys of a frame
+enum { HAS_POS = 1, HAS_PWML = 2, HAS_PWMR = 4 };
+
+//Everything decoded from one frame
+struct TelemetryValues{
+    uint16_t sensor[TELEMETRY_SENSORS];
+    int32_t pos; //line position x1000
+    int32_t PWML, PWMR;
+    uint8_t has; //HAS_* of the optional keys present
+};
+
+//Start of the value of "key": in a json payload, 0 if it is missing
+inline const char *findKey(const char *p, size_t len, const char *key){
+    const char *end = p + len;
+    size_t klen = strlen(key);
+    for (const char *s = p; s + klen + 3 <= end; s++){
+        if (s[0] == '"' && memcmp(s + 1, key, klen) == 0 && s[klen + 1] == '"' && s[klen + 2] == ':') return s + klen + 3;
+    }
+    return 0;
+}
+
+//Parse an integer key out of a json payload, false if it is missing or not a number
+inline bool parseIntPayload(const char *p, size_t len, const char *key, int32_t &out){
+    const char *end = p + len;
+    const char *q = findKey(p, len, key);
+    if (!q) return false;
+    bool neg = q < end && *q == '-';
+    if (neg) q++;
+    if (q >= end || *q < '0' || *q > '9') return false;
+    int64_t v = 0;
+    while (q < end && *q >= '0' && *q <= '9' && v <= 0x80000000ll) v = v*10 + (*q++ - '0');
+    if (v > (neg ? 0x80000000ll : 0x7FFFFFFFll)) return false;
+    out = neg ? -v : v;
+    return true;
+}
+
+//Parse the sensor array out of a json payload, false if it is missing or short
+inline bool parseSensorPayload(const char *p, size_t len, uint16_t *out){
+    const char *end = p + len;
+    const char *q = findKey(p, len, "sensor");
+    if (!q || q >= end || *q++ != '[') return false;
+    int got = 0;
+    while (got < TELEMETRY_SENSORS && q < end){
+        if (*q < '0' || *q > '9') return false;
+        uint32_t v = 0;
+        while (q < end && *q >= '0' && *q <= '9') v = v*10 + (*q++ - '0');
+        if (v > 0xFFFF) return false;
+        out[got++] = v;
+        if (q < end && *q == ',') q++;
+    }
+    return got == TELEMETRY_SENSORS;
+}
+
+//Parse a whole payload, false if the sensor array is missing or short
+inline bool parsePayload(const char *p, size_t len, TelemetryValues &v){
+    if (!parseSensorPayload(p, len, v.sensor)) return false;
+    v.has = 0;
+    v.pos = v.PWML = v.PWMR = 0;
+    if (parseIntPayload(p, len, "pos", v.pos)) v.has |= HAS_POS;
+    if (parseIntPayload(p, len, "PWML", v.PWML)) v.has |= HAS_PWML;
+    if (parseIntPayload(p, len, "PWMR", v.PWMR)) v.has |= HAS_PWMR;
+    return true;
+}
+
+class TelemetryFramer{
+private:
+    enum State { IDLE, START, PAYLOAD };
+    State state;
+    char payload[TELEMETRY_MAX_PAYLOAD];
+    int len;
+public:
+    unsigned long frames; //frames decoded
+    unsigned long malformed; //framed payloads without a usable sensor array
+
+    TelemetryFramer() : state(IDLE), len(0), frames(0), malformed(0){}
+
+    //Feed bytes, calls emit(const TelemetryValues &) for each decoded frame
+    template<class F>
+    void feed(const uint8_t *data, size_t n, F emit){
+        for (size_t i=0; i<n; i++){
+            char c = data[i];
+            switch (state){
+                case IDLE:
+                    if (c == 'S') state = START;
+                    break;
+                case START:
+                    if (c == '{'){
+                        state = PAYLOAD;
+                        len = 0;
+                        payload[len++] = c;
+                    }
+                    else if (c != 'S') state = IDLE;
+                    break;
+                case PAYLOAD:
+                    if (c == 'E'){
+                        TelemetryValues v;
+                        if (parsePayload(payload, len, v)){
+                            frames++;
+                            emit(v);
+                        }
+                        else malformed++;
+                        state = IDLE;
+                    }
+                    else if (len < TELEMETRY_MAX_PAYLOAD) payload[len++] = c;
+                    else{
+                        malformed++;
+                        state = c == 'S' ? START : IDLE;
+                    }
+                    break;
+            }
+        }
+    }
+};
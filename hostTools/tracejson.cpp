@@ -0,0 +1,226 @@
+//Converts a TRACE dump (carFirmware/src/diag/trace.h) into Chrome trace JSON.
+//
+//The input is a capture of the car's serial output, or sim -s output, with
+//the dump traceDump() sends after the run somewhere in it; other bytes
+//around it are skipped and the last dump that checks out is used. Every
+//track becomes a thread of the timeline, begin/end events slices and
+//encoder edges instants, with timestamps in microseconds from the first
+//event. Open the output in chrome://tracing or ui.perfetto.dev.
+//
+//Begin/end pairs are matched per track: an end left without its begin by
+//the ring wrapping is dropped and a slice still open at the end of the
+//dump is closed there. A summary goes to stdout: the events, the span
+//they cover and the events lost, then per event its count and duration
+//(slices) or interval (instants), and the loop's period and jitter.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -IhostTools/shim hostTools/tracejson.cpp -o tracejson
+//
+//Usage:
+//  tracejson capture.bin out.json
+//
+//Exit status is 0 on success, 1 when there is no valid dump, 2 on error.
+
+#include "recording.h"
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+struct TraceDump{
+    std::vector<std::string> tracks;
+    std::vector<std::string> names;
+    std::vector<uint8_t> trackOf;
+    uint32_t hz;
+    uint32_t lost;
+    struct Event{
+        uint64_t t; //cycles, unwrapped
+        uint8_t id;
+        uint8_t kind;
+        uint16_t arg;
+    };
+    std::vector<Event> events;
+};
+
+static uint32_t le32(const uint8_t *p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//NUL ended string at p[i], false past the end
+static bool cstring(const uint8_t *p, size_t len, size_t &i, std::string &out){
+    size_t j = i;
+    while (j < len && p[j]) j++;
+    if (j >= len) return false;
+    out.assign((const char *)p + i, j - i);
+    i = j + 1;
+    return true;
+}
+
+//Dump starting at data[at], false if it is cut short or fails the checksum
+static bool parseDump(const uint8_t *data, size_t len, size_t at, TraceDump &d){
+    const uint8_t *p = data + at;
+    size_t n = len - at, i = 4;
+    if (n < 4 || p[0] != 'T' || p[1] != 'H' || p[2] != 1) return false;
+    d.tracks.assign(p[3], std::string());
+    for (size_t k=0; k<d.tracks.size(); k++){
+        if (!cstring(p, n, i, d.tracks[k])) return false;
+    }
+    if (i >= n) return false;
+    d.names.assign(p[i], std::string());
+    d.trackOf.assign(p[i], 0);
+    i++;
+    for (size_t k=0; k<d.names.size(); k++){
+        if (i >= n) return false;
+        d.trackOf[k] = p[i++];
+        if (!cstring(p, n, i, d.names[k])) return false;
+        if (d.trackOf[k] >= d.tracks.size()) return false;
+    }
+    if (i + 10 > n) return false;
+    d.hz = le32(p + i);
+    d.lost = le32(p + i + 4);
+    size_t count = p[i + 8] | (p[i + 9] << 8);
+    i += 10;
+    if (i + 8*count + 1 > n || !d.hz) return false;
+    uint8_t sum = 0;
+    for (size_t k=0; k<i + 8*count; k++) sum ^= p[k];
+    if (sum != p[i + 8*count]) return false;
+
+    d.events.clear();
+    uint64_t t = 0;
+    uint32_t last = 0;
+    for (size_t k=0; k<count; k++, i+=8){
+        TraceDump::Event e;
+        uint32_t c = le32(p + i);
+        //cycles() wraps every 89 s, events are closer than that
+        t += k ? (uint32_t)(c - last) : 0;
+        last = c;
+        e.t = t;
+        e.id = p[i + 4];
+        e.kind = p[i + 5];
+        e.arg = p[i + 6] | (p[i + 7] << 8);
+        if (e.id >= d.names.size()) return false;
+        d.events.push_back(e);
+    }
+    return true;
+}
+
+//Escape a name for a JSON string
+static std::string quoted(const std::string &s){
+    std::string q = "\"";
+    for (char c : s){
+        if (c == '"' || c == '\\') q += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        q += c;
+    }
+    return q + "\"";
+}
+
+struct Stat{
+    size_t n = 0;
+    double sum = 0, sumSq = 0, hi = 0;
+    void add(double v){
+        n++;
+        sum += v;
+        sumSq += v*v;
+        if (v > hi) hi = v;
+    }
+    double mean() const { return n ? sum/n : 0; }
+    double sd() const { return n > 1 ? sqrt(fmax(0, sumSq/n - mean()*mean())) : 0; }
+};
+
+int main(int argc, char **argv){
+    if (argc != 3){
+        fprintf(stderr, "usage: tracejson capture.bin out.json\n");
+        return 2;
+    }
+    std::vector<uint8_t> bytes;
+    if (!readFile(argv[1], bytes)){
+        fprintf(stderr, "tracejson: cannot read %s\n", argv[1]);
+        return 2;
+    }
+    TraceDump d;
+    bool found = false;
+    for (size_t at=bytes.size(); at-- > 0;){
+        if (bytes[at] == 'T' && parseDump(bytes.data(), bytes.size(), at, d)){
+            found = true;
+            break;
+        }
+    }
+    if (!found){
+        fprintf(stderr, "tracejson: no trace dump in %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[2], "w");
+    if (!f){
+        fprintf(stderr, "tracejson: cannot write %s\n", argv[2]);
+        return 2;
+    }
+    double perUs = d.hz/1e6;
+    fprintf(f, "{\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"car\"}}");
+    for (size_t k=0; k<d.tracks.size(); k++){
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":%s}}", k, quoted(d.tracks[k]).c_str());
+        fprintf(f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"sort_index\":%zu}}", k, k);
+    }
+
+    std::vector<std::vector<size_t> > open(d.tracks.size()); //begin events per track
+    std::vector<Stat> slices(d.names.size()), marks(d.names.size());
+    std::vector<double> lastMark(d.names.size(), -1), lastBegin(d.names.size(), -1);
+    std::vector<Stat> periods(d.names.size());
+    size_t dropped = 0;
+    for (size_t k=0; k<d.events.size(); k++){
+        const TraceDump::Event &e = d.events[k];
+        double ts = e.t/perUs;
+        uint8_t tid = d.trackOf[e.id];
+        std::string name = quoted(d.names[e.id]);
+        if (e.kind == 'B'){
+            open[tid].push_back(k);
+            if (lastBegin[e.id] >= 0) periods[e.id].add(ts - lastBegin[e.id]);
+            lastBegin[e.id] = ts;
+            fprintf(f, ",\n{\"name\":%s,\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%u}}", name.c_str(), ts, tid, e.arg);
+        }
+        else if (e.kind == 'E'){
+            if (open[tid].empty()){
+                dropped++;
+                continue;
+            }
+            slices[e.id].add(ts - d.events[open[tid].back()].t/perUs);
+            open[tid].pop_back();
+            fprintf(f, ",\n{\"name\":%s,\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", name.c_str(), ts, tid);
+        }
+        else{
+            if (lastMark[e.id] >= 0) marks[e.id].add(ts - lastMark[e.id]);
+            lastMark[e.id] = ts;
+            fprintf(f, ",\n{\"name\":%s,\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%u}}", name.c_str(), ts, tid, e.arg);
+        }
+    }
+    double end = d.events.empty() ? 0 : d.events.back().t/perUs;
+    size_t closed = 0;
+    for (size_t tid=0; tid<open.size(); tid++){
+        while (!open[tid].empty()){
+            const TraceDump::Event &b = d.events[open[tid].back()];
+            open[tid].pop_back();
+            fprintf(f, ",\n{\"name\":%s,\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%zu}", quoted(d.names[b.id]).c_str(), end, tid);
+            closed++;
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"cpu_hz\":%u,\"lost\":%u}}\n", d.hz, d.lost);
+    fclose(f);
+
+    printf("%zu events over %.3f ms, %u lost to the ring, %zu unmatched ends dropped, %zu slices closed at the end\n",
+           d.events.size(), end/1000, d.lost, dropped, closed);
+    for (size_t id=0; id<d.names.size(); id++){
+        if (slices[id].n){
+            printf("%-14s %6zu slices, us mean %.1f sd %.1f max %.1f", d.names[id].c_str(), slices[id].n,
+                   slices[id].mean(), slices[id].sd(), slices[id].hi);
+            if (periods[id].n) printf(", period us mean %.1f sd %.1f max %.1f", periods[id].mean(), periods[id].sd(), periods[id].hi);
+            printf("\n");
+        }
+        else if (marks[id].n){
+            printf("%-14s %6zu marks, interval us mean %.1f max %.1f\n", d.names[id].c_str(), marks[id].n + 1,
+                   marks[id].mean(), marks[id].hi);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+//Track loading and preprocessing shared by the host tools.
+//
+//Raw tracks (simulation/track.csv, straight.csv) are unevenly spaced X,Y
+//polylines. A Track is the same path resampled to a uniform arc length step
+//ds, with heading and curvature per sample, so anything indexed by distance
+//along the track is a single array lookup.
+#pragma once
+
+#include "recording.h"
+#include "runfile.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+struct Track{
+    double ds; //arc length between samples
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> s; //arc length, s[k] = k*ds
+    std::vector<double> heading; //radians, unwrapped
+    std::vector<double> curvature; //1/units, positive turning left
+
+    size_t size() const { return x.size(); }
+    double length() const { return s.empty() ? 0 : s.back(); }
+
+    //Sample at or before a distance along the track, clamped to the ends
+    size_t index(double dist) const {
+        if (dist <= 0 || x.empty()) return 0;
+        size_t k = (size_t)(dist/ds);
+        return k < x.size() ? k : x.size() - 1;
+    }
+};
+
+//Parse an X,Y csv, the first line is a header. Generated tracks
+//(trackgen) add a third Line column, 0 where the line is not painted;
+//line gets it, 1 for files without one.
+inline bool readTrackCSV(const char *path, std::vector<double> &x, std::vector<double> &y,
+                         std::vector<uint16_t> *line = 0){
+    std::vector<uint8_t> bytes;
+    if (!readFile(path, bytes)) return false;
+    bytes.push_back(0);
+    const char *p = (const char *)bytes.data();
+    const char *end = p + bytes.size() - 1;
+    while (p < end && *p != '\n') p++; //header
+    while (p < end){
+        char *q;
+        double a = strtod(p, &q);
+        if (q == p){ p++; continue; }
+        p = q;
+        while (*p == ' ' || *p == ',') p++;
+        double b = strtod(p, &q);
+        if (q == p) break;
+        p = q;
+        x.push_back(a);
+        y.push_back(b);
+        if (line){
+            while (*p == ' ' || *p == ',') p++;
+            double c = strtod(p, &q);
+            line->push_back(q == p || c != 0 ? 1 : 0);
+        }
+        while (p < end && *p != '\n') p++;
+    }
+    return true;
+}
+
+//Cumulative arc length of a polyline
+inline void arcLength(const std::vector<double> &x, const std::vector<double> &y, std::vector<double> &s){
+    s.assign(x.size(), 0);
+    for (size_t i=1; i<x.size(); i++) s[i] = s[i - 1] + hypot(x[i] - x[i - 1], y[i] - y[i - 1]);
+}
+
+//Heading from central differences and curvature as the change of heading
+//over +-window samples
+inline void trackDerivatives(Track &t, int window){
+    size_t n = t.size();
+    t.heading.assign(n, 0);
+    t.curvature.assign(n, 0);
+    if (n < 2) return;
+    for (size_t k=0; k<n; k++){
+        size_t a = k > 0 ? k - 1 : 0;
+        size_t b = k + 1 < n ? k + 1 : n - 1;
+        t.heading[k] = atan2(t.y[b] - t.y[a], t.x[b] - t.x[a]);
+        if (k > 0){
+            double d = t.heading[k] - t.heading[k - 1];
+            t.heading[k] -= 2*M_PI*floor((d + M_PI)/(2*M_PI));
+        }
+    }
+    if (window < 1) window = 1;
+    for (size_t k=0; k<n; k++){
+        size_t a = k >= (size_t)window ? k - window : 0;
+        size_t b = k + window < n ? k + window : n - 1;
+        if (b > a) t.curvature[k] = (t.heading[b] - t.heading[a])/((b - a)*t.ds);
+    }
+}
+
+//Resample a polyline to a uniform arc length step. One pass over the input,
+//so this is O(points + samples).
+inline Track resampleTrack(const std::vector<double> &x, const std::vector<double> &y, double ds, int window = 2){
+    Track t;
+    t.ds = ds;
+    if (x.empty() || ds <= 0) return t;
+    std::vector<double> s;
+    arcLength(x, y, s);
+
+    size_t n = (size_t)(s.back()/ds) + 1;
+    t.x.resize(n);
+    t.y.resize(n);
+    t.s.resize(n);
+    size_t seg = 0;
+    for (size_t k=0; k<n; k++){
+        double at = k*ds;
+        while (seg + 2 < s.size() && s[seg + 1] < at) seg++;
+        double len = seg + 1 < s.size() ? s[seg + 1] - s[seg] : 0;
+        double f = len > 0 ? (at - s[seg])/len : 0;
+        if (f > 1) f = 1;
+        size_t nxt = seg + 1 < x.size() ? seg + 1 : seg;
+        t.x[k] = x[seg] + f*(x[nxt] - x[seg]);
+        t.y[k] = y[seg] + f*(y[nxt] - y[seg]);
+        t.s[k] = at;
+    }
+    trackDerivatives(t, window);
+    return t;
+}
+
+inline bool saveTrack(const Track &t, const char *path, uint64_t key = 0){
+    ColWriter w(KIND_TRACK);
+    w.setKey(key);
+    w.add("x", t.x);
+    w.add("y", t.y);
+    w.add("s", t.s);
+    w.add("heading", t.heading);
+    w.add("curvature", t.curvature);
+    return w.write(path);
+}
+
+//Load a track file. Files written by saveTrack come back as is, plain x,y
+//files (convert track) are resampled at their mean point spacing.
+inline bool loadTrack(const char *path, Track &t){
+    ColFile f;
+    if (!f.open(path) || f.kind() != KIND_TRACK) return false;
+    const double *x = f.column<double>("x");
+    const double *y = f.column<double>("y");
+    if (!x || !y) return false;
+    size_t n = f.rows();
+    std::vector<double> xs(x, x + n), ys(y, y + n);
+    const double *s = f.column<double>("s");
+    const double *h = f.column<double>("heading");
+    const double *c = f.column<double>("curvature");
+    if (!s || !h || !c){
+        std::vector<double> len;
+        arcLength(xs, ys, len);
+        t = resampleTrack(xs, ys, n > 1 ? len.back()/(n - 1) : 1);
+        return true;
+    }
+    t.x.swap(xs);
+    t.y.swap(ys);
+    t.s.assign(s, s + n);
+    t.heading.assign(h, h + n);
+    t.curvature.assign(c, c + n);
+    t.ds = n > 1 ? t.s[1] - t.s[0] : 0;
+    return true;
+}
@@ -0,0 +1,303 @@
+//Procedural track generator for scale and stress benchmarks.
+//
+//A track is a chain of pieces drawn from a fixed seed: straights, chicanes
+//(left, right, left), S-curves (a quarter turn each way), hairpins (a
+//switchback of two half turns), crossings (a 270 degree loop that runs back
+//across its own lead-in at right angles) and gaps (a straight with an
+//unpainted stretch). Every piece leaves the heading where it found it and
+//ends past the furthest x it reached, so pieces never run into each other
+//and the only crossings are the ones asked for. Points are placed every ds
+//of arc length across piece boundaries, from closed form arcs, until the
+//track is the requested length.
+//
+//The random numbers come from splitmix64 and are mapped to ranges by hand,
+//so a seed gives the same track on every platform and compiler.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 hostTools/trackgen.cpp -o trackgen
+//
+//Usage:
+//  trackgen [-l length] [-d ds] [-s seed] [-r min_radius] [-R max_radius]
+//           [-k kinds] [-o track.csv] [-b track.col]
+//
+//Defaults: length 2000, ds 1, seed 1, radius 15 to 60 (cm like
+//simulation/track.csv). kinds is a subset of "tcshxg" (straight, chicane,
+//S-curve, hairpin, crossing, gap), all by default. The csv is X,Y,Line
+//with Line 0 on unpainted points; tools that read X,Y ignore the third
+//column. The binary is a track file (runfile.h) with x, y, s and line.
+//Prints the piece counts and the time taken to build and write.
+
+#include "track.h"
+
+#include <chrono>
+#include <string>
+#include <string.h>
+
+//splitmix64
+struct Rng{
+    uint64_t state;
+    explicit Rng(uint64_t seed) : state(seed){}
+    uint64_t next(){
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    //Uniform in [lo, hi)
+    double range(double lo, double hi){ return lo + (hi - lo)*((next() >> 11)*(1.0/9007199254740992.0)); }
+    //Uniform in [0, n)
+    uint32_t below(uint32_t n){ return (uint32_t)(((next() >> 32)*n) >> 32); }
+};
+
+//Constant curvature stretch, curvature 0 for a straight
+struct Piece{
+    double curvature; //1/units, positive turning left
+    double length;
+    bool painted;
+};
+
+//Places points every ds along a chain of pieces
+class Tracer{
+private:
+    double ds;
+    double x, y, heading;
+    double along; //arc length of the next point from the start of the piece
+public:
+    double limit; //stop once the track is this long
+    double total; //arc length traced so far
+    double maxX; //furthest x of any point
+    std::vector<double> xs, ys;
+    std::vector<uint16_t> line;
+
+    Tracer(double ds, double limit) : ds(ds), x(0), y(0), heading(0), along(0), limit(limit), total(0), maxX(0){}
+
+    bool full() const { return total >= limit; }
+    double posX() const { return x; }
+
+    void add(const Piece &p){
+        double len = p.length;
+        if (total + len > limit) len = limit - total;
+        double k = p.curvature;
+        double s = along;
+        double c = cos(heading), sn = sin(heading);
+        while (s <= len + 1e-9){
+            double px, py;
+            if (fabs(k) < 1e-12){
+                px = x + s*c;
+                py = y + s*sn;
+            }
+            else{
+                double a = heading + k*s;
+                px = x + (sin(a) - sn)/k;
+                py = y - (cos(a) - c)/k;
+            }
+            xs.push_back(px);
+            ys.push_back(py);
+            line.push_back(p.painted ? 1 : 0);
+            if (px > maxX) maxX = px;
+            s += ds;
+        }
+        along = s - len;
+        if (fabs(k) < 1e-12){
+            x += len*c;
+            y += len*sn;
+        }
+        else{
+            double a = heading + k*len;
+            x += (sin(a) - sn)/k;
+            y -= (cos(a) - c)/k;
+            heading = a;
+        }
+        total += len;
+    }
+
+    void straight(double len, bool painted = true){ add({0, len, painted}); }
+    void arc(double radius, double angle){ add({angle > 0 ? 1/radius : -1/radius, fabs(angle)*radius, true}); }
+};
+
+struct Options{
+    double length = 2000;
+    double ds = 1;
+    uint64_t seed = 1;
+    double rmin = 15;
+    double rmax = 60;
+    std::string kinds = "tcshxg";
+};
+
+static const char *KIND_NAMES[] = {"straight", "chicane", "S-curve", "hairpin", "crossing", "gap"};
+static const char KIND_CODES[] = "tcshxg";
+
+//Move on to x so the next piece starts past everything drawn so far
+static void clear(Tracer &t){
+    double gap = t.maxX - t.posX();
+    if (gap > 1e-9) t.straight(gap);
+}
+
+static void generate(Tracer &t, const Options &o, long counts[6]){
+    Rng rng(o.seed);
+    std::vector<int> kinds;
+    for (char c : o.kinds){
+        const char *at = strchr(KIND_CODES, c);
+        if (!at) continue;
+        kinds.push_back(at - KIND_CODES);
+    }
+    if (kinds.empty()) kinds.push_back(0);
+
+    t.straight(20); //room for the start bar
+    while (!t.full()){
+        int kind = kinds[rng.below(kinds.size())];
+        double r = rng.range(o.rmin, o.rmax);
+        double side = rng.below(2) ? 1 : -1;
+        switch (kind){
+            case 0: //straight
+                t.straight(rng.range(20, 100));
+                break;
+            case 1:{ //chicane
+                double a = rng.range(0.3, 1.0)*side;
+                t.arc(r, a);
+                t.arc(r, -2*a);
+                t.arc(r, a);
+                break;
+            }
+            case 2: //S-curve
+                t.arc(r, side*M_PI/2);
+                t.arc(r, -side*M_PI/2);
+                break;
+            case 3:{ //hairpin switchback, the return leg stays inside the lead-in
+                double lead = rng.range(2*r, 4*r);
+                t.straight(lead);
+                t.arc(r, side*M_PI);
+                t.straight(rng.range(0, lead - r));
+                t.arc(r, -side*M_PI);
+                break;
+            }
+            case 4: //crossing: the loop comes back across the lead-in at r
+                t.straight(2*r);
+                t.arc(r, side*1.5*M_PI);
+                t.straight(2*r);
+                t.arc(r, side*M_PI/2);
+                break;
+            case 5:{ //gap
+                double g = rng.range(2, 8);
+                t.straight(rng.range(10, 30));
+                t.straight(g, false);
+                t.straight(rng.range(10, 30));
+                break;
+            }
+        }
+        clear(t);
+        counts[kind]++;
+    }
+}
+
+//v with 4 decimals at p, returns the end. fprintf spends seconds on a
+//few million points.
+static char *fixed4(char *p, double v){
+    long long q = llround(v*1e4);
+    if (q < 0){
+        *p++ = '-';
+        q = -q;
+    }
+    char tmp[24];
+    int n = 0;
+    long long whole = q/10000;
+    do{
+        tmp[n++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole);
+    while (n) *p++ = tmp[--n];
+    int frac = q % 10000;
+    *p++ = '.';
+    p[3] = '0' + frac % 10;
+    p[2] = '0' + frac/10 % 10;
+    p[1] = '0' + frac/100 % 10;
+    p[0] = '0' + frac/1000;
+    return p + 4;
+}
+
+static bool writeCSV(const char *path, const Tracer &t){
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "X,Y,Line\n");
+    std::vector<char> buf(1 << 20);
+    char *p = buf.data();
+    for (size_t i=0; i<t.xs.size(); i++){
+        if (p - buf.data() > (long)buf.size() - 64){
+            fwrite(buf.data(), 1, p - buf.data(), f);
+            p = buf.data();
+        }
+        p = fixed4(p, t.xs[i]);
+        *p++ = ',';
+        p = fixed4(p, t.ys[i]);
+        *p++ = ',';
+        *p++ = t.line[i] ? '1' : '0';
+        *p++ = '\n';
+    }
+    fwrite(buf.data(), 1, p - buf.data(), f);
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+static bool writeCol(const char *path, const Tracer &t){
+    std::vector<double> s;
+    arcLength(t.xs, t.ys, s);
+    ColWriter w(KIND_TRACK);
+    w.add("x", t.xs);
+    w.add("y", t.ys);
+    w.add("s", s);
+    w.add("line", t.line);
+    return w.write(path);
+}
+
+int main(int argc, char **argv){
+    Options o;
+    const char *csv = 0, *col = 0;
+    bool bad = false;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "-l" && more) o.length = atof(argv[++i]);
+        else if (a == "-d" && more) o.ds = atof(argv[++i]);
+        else if (a == "-s" && more) o.seed = strtoull(argv[++i], 0, 0);
+        else if (a == "-r" && more) o.rmin = atof(argv[++i]);
+        else if (a == "-R" && more) o.rmax = atof(argv[++i]);
+        else if (a == "-k" && more) o.kinds = argv[++i];
+        else if (a == "-o" && more) csv = argv[++i];
+        else if (a == "-b" && more) col = argv[++i];
+        else bad = true;
+    }
+    if (bad || o.length <= 0 || o.ds <= 0 || o.rmin <= 0 || o.rmax < o.rmin){
+        fprintf(stderr, "usage: trackgen [-l length] [-d ds] [-s seed] [-r min_radius] [-R max_radius]\n"
+                        "                [-k kinds] [-o track.csv] [-b track.col]\n");
+        return 2;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    Tracer t(o.ds, o.length);
+    t.xs.reserve((size_t)(o.length/o.ds) + 2);
+    t.ys.reserve(t.xs.capacity());
+    t.line.reserve(t.xs.capacity());
+    long counts[6] = {0};
+    generate(t, o, counts);
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (csv && !writeCSV(csv, t)){
+        fprintf(stderr, "trackgen: cannot write %s\n", csv);
+        return 2;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    if (col && !writeCol(col, t)){
+        fprintf(stderr, "trackgen: cannot write %s\n", col);
+        return 2;
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    printf("%zu points every %g, length %.1f, seed %llu:", t.xs.size(), o.ds, t.total, (unsigned long long)o.seed);
+    for (int k=0; k<6; k++) if (counts[k]) printf(" %ld %s", counts[k], KIND_NAMES[k]);
+    printf("\n");
+    auto ms = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b){
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    printf("generate %.1f ms, csv %.1f ms, binary %.1f ms\n", ms(t0, t1), ms(t1, t2), ms(t2, t3));
+    return 0;
+}
@@ -0,0 +1,135 @@
+//Track preprocessing: resample an X,Y track to uniform arc length, compute
+//heading and curvature, cache the result and emit a firmware header.
+//
+//Build:
+//  g++ -O2 -std=gnu++11 hostTools/trackprep.cpp -o trackprep
+//
+//Usage:
+//  trackprep track.csv [-d ds] [-w window] [-c cache.col] [-H out.h]
+//            [-n NAME] [-k counts_per_unit]
+//
+//  -d  arc length between samples (default 1, same units as the csv)
+//  -w  curvature window in samples either side (default 2)
+//  -c  binary cache, reused while it is newer than the csv and was built
+//      from the same csv (by absolute path) with the same ds and window
+//  -H  header with constexpr NAME_HEADING/NAME_CURVATURE tables indexed by
+//      distance and NAME_index() mapping summed encoder counts to a sample
+//  -n  prefix for the header symbols (default TRACK)
+//  -k  encoder counts per track unit for one wheel. The default assumes cm
+//      and the 70 mm RSLK wheel: 360/(7*pi) = 16.37
+
+#include "track.h"
+
+#include <chrono>
+#include <limits.h>
+#include <string>
+#include <sys/stat.h>
+
+static bool newer(const char *a, const char *b){
+    struct stat sa, sb;
+    if (stat(a, &sa) != 0 || stat(b, &sb) != 0) return false;
+    return sa.st_mtime >= sb.st_mtime;
+}
+
+//FNV-1a of the inputs a cache is built from, stored as its key
+static uint64_t cacheKey(const char *csv, double ds, int window){
+    char full[PATH_MAX];
+    std::string in = realpath(csv, full) ? full : csv;
+    in.append((const char *)&ds, sizeof(ds));
+    in.append((const char *)&window, sizeof(window));
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : in){
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static bool cacheMatches(const char *cache, uint64_t key){
+    ColFile f;
+    return f.open(cache) && f.key() == key;
+}
+
+static void table(FILE *f, const std::string &name, const std::vector<double> &v){
+    fprintf(f, "constexpr float %s[%zu] = {", name.c_str(), v.size());
+    for (size_t i=0; i<v.size(); i++){
+        if (i % 8 == 0) fprintf(f, "\n    ");
+        fprintf(f, "%.7g%s", v[i], i + 1 < v.size() ? ", " : "");
+    }
+    fprintf(f, "\n};\n\n");
+}
+
+static bool header(const Track &t, const char *path, const char *src, const std::string &name, double cpu){
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "//Generated by hostTools/trackprep from %s, do not edit.\n", src);
+    fprintf(f, "//%zu samples, one every %g units of arc length.\n\n", t.size(), t.ds);
+    fprintf(f, "const int %s_SAMPLES = %zu;\n", name.c_str(), t.size());
+    fprintf(f, "constexpr float %s_DS = %.9g;\n", name.c_str(), t.ds);
+    fprintf(f, "constexpr float %s_LENGTH = %.9g;\n", name.c_str(), t.length());
+    fprintf(f, "constexpr float %s_COUNTS_PER_UNIT = %.9g;\n\n", name.c_str(), cpu);
+    fprintf(f, "//Heading in radians\n");
+    table(f, name + "_HEADING", t.heading);
+    fprintf(f, "//Curvature in 1/units, positive turning left\n");
+    table(f, name + "_CURVATURE", t.curvature);
+    fprintf(f, "//Sample for the summed left + right encoder counts\n");
+    fprintf(f, "inline int %s_index(uint32_t counts){\n", name.c_str());
+    fprintf(f, "    uint32_t k = counts/(2*%s_COUNTS_PER_UNIT*%s_DS);\n", name.c_str(), name.c_str());
+    fprintf(f, "    return k < %s_SAMPLES ? k : %s_SAMPLES - 1;\n", name.c_str(), name.c_str());
+    fprintf(f, "}\n");
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char **argv){
+    const char *csv = 0, *cache = 0, *out = 0;
+    std::string name = "TRACK";
+    double ds = 1, cpu = 360/(7*M_PI);
+    int window = 2;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "-d" && more) ds = atof(argv[++i]);
+        else if (a == "-w" && more) window = atoi(argv[++i]);
+        else if (a == "-c" && more) cache = argv[++i];
+        else if (a == "-H" && more) out = argv[++i];
+        else if (a == "-n" && more) name = argv[++i];
+        else if (a == "-k" && more) cpu = atof(argv[++i]);
+        else if (!csv) csv = argv[i];
+        else csv = 0, i = argc;
+    }
+    if (!csv || ds <= 0){
+        fprintf(stderr, "usage: trackprep track.csv [-d ds] [-w window] [-c cache.col] [-H out.h] [-n NAME] [-k counts_per_unit]\n");
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Track t;
+    uint64_t key = cacheKey(csv, ds, window);
+    bool cached = cache && newer(cache, csv) && cacheMatches(cache, key) && loadTrack(cache, t);
+    if (!cached){
+        std::vector<double> x, y;
+        if (!readTrackCSV(csv, x, y) || x.size() < 2){
+            fprintf(stderr, "trackprep: cannot read a track from %s\n", csv);
+            return 2;
+        }
+        t = resampleTrack(x, y, ds, window);
+        if (cache && !saveTrack(t, cache, key)){
+            fprintf(stderr, "trackprep: cannot write %s\n", cache);
+            return 2;
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double kmax = 0;
+    for (double k : t.curvature) kmax = fmax(kmax, fabs(k));
+    printf("%zu samples every %g, length %.3f, max |curvature| %.4f (%s in %.2f ms)\n",
+           t.size(), t.ds, t.length(), kmax, cached ? "cache" : "built", ms);
+
+    if (out && !header(t, out, csv, name, cpu)){
+        fprintf(stderr, "trackprep: cannot write %s\n", out);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,219 @@
+//Live parameter tuning over the binary command channel
+//(carFirmware/src/serialtools/command.h).
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -IhostTools/shim hostTools/tune.cpp hostTools/shim/Arduino.cpp -o tune
+//
+//Usage:
+//  tune [-b baud] /dev/ttyACM0 get
+//  tune [-b baud] /dev/ttyACM0 set name value [name value ...]
+//  tune [-b baud] /dev/ttyACM0 block v0 v1 ... (all P_COUNT values)
+//  tune [-b baud] /dev/ttyACM0 defaults
+//
+//Names are kp ki kd turn_kp turn_kd vmax vturn, w<leg><i><lo|hi> for the
+//curve windows (w00lo is the low edge of the first window on the way
+//there), then cross_on cross_off confirm for the cross line detector and
+//wheel_kp wheel_ki for the wheel speed loops.
+//Every command waits for the reply and prints the live block.
+
+#include "../carFirmware/src/serialtools/command.h"
+#ifndef CONST_H
+#define CONST_H
+#include "../carFirmware/src/const.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+static const char *FIXED_NAMES[P_WINDOW] = {"kp", "ki", "kd", "turn_kp", "turn_kd", "vmax", "vturn"};
+static const char *CROSS_NAMES[P_COUNT - P_CROSS_ON] = {"cross_on", "cross_off", "confirm", "wheel_kp", "wheel_ki"};
+
+static std::string paramName(int id){
+    if (id < P_WINDOW) return FIXED_NAMES[id];
+    if (id >= P_CROSS_ON) return CROSS_NAMES[id - P_CROSS_ON];
+    int w = id - P_WINDOW;
+    char buf[16];
+    snprintf(buf, sizeof(buf), "w%d%d%s", w/(2*CURVE_WINDOWS), (w/2)%CURVE_WINDOWS, w%2 ? "hi" : "lo");
+    return buf;
+}
+
+static int paramId(const std::string &name){
+    for (int i=0; i<P_COUNT; i++) if (paramName(i) == name) return i;
+    return -1;
+}
+
+static speed_t baudFlag(long baud){
+    switch (baud){
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+    }
+    return B9600;
+}
+
+static int openPort(const char *path, long baud){
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) return -1;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0){
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baudFlag(baud));
+        cfsetospeed(&tio, baudFlag(baud));
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static bool send(int fd, uint8_t cmd, const std::vector<uint8_t> &payload){
+    std::vector<uint8_t> out;
+    out.push_back(COMMAND_SYNC);
+    out.push_back(cmd);
+    out.push_back(payload.size());
+    uint8_t sum = cmd ^ payload.size();
+    for (uint8_t b : payload){
+        out.push_back(b);
+        sum ^= b;
+    }
+    out.push_back(sum);
+    return write(fd, out.data(), out.size()) == (ssize_t)out.size();
+}
+
+static int readByte(int fd, int timeoutMs){
+    struct pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, timeoutMs) <= 0) return -1;
+    uint8_t b;
+    return read(fd, &b, 1) == 1 ? b : -1;
+}
+
+//Wait for the reply to cmd; anything else on the line (telemetry, replies
+//to earlier commands) is skipped. Returns the status or -1 on timeout.
+static int receive(int fd, uint8_t cmd, std::vector<uint8_t> &payload, int timeoutMs = 2000){
+    while (true){
+        int b = readByte(fd, timeoutMs);
+        if (b < 0) return -1;
+        if (b != REPLY_SYNC) continue;
+        int c = readByte(fd, timeoutMs), st = readByte(fd, timeoutMs), n = readByte(fd, timeoutMs);
+        if (c < 0 || st < 0 || n < 0) return -1;
+        payload.resize(n);
+        uint8_t sum = c ^ st ^ n;
+        bool ok = true;
+        for (int i=0; i<n && ok; i++){
+            int v = readByte(fd, timeoutMs);
+            ok = v >= 0;
+            payload[i] = v;
+            sum ^= v;
+        }
+        int s = readByte(fd, timeoutMs);
+        if (!ok || s < 0) return -1;
+        if (s != sum || c != cmd) continue;
+        return st;
+    }
+}
+
+static void printBlock(const std::vector<uint8_t> &p){
+    if (p.size() != 4 + 4*P_COUNT){
+        fprintf(stderr, "tune: unexpected block of %zu bytes\n", p.size());
+        return;
+    }
+    printf("version %u revision %u\n", p[0] | (p[1] << 8), p[2] | (p[3] << 8));
+    for (int i=0; i<P_COUNT; i++){
+        float v;
+        memcpy(&v, &p[4 + 4*i], sizeof(v));
+        printf("  %-8s %g\n", paramName(i).c_str(), v);
+    }
+}
+
+static void putFloat(std::vector<uint8_t> &out, float v){
+    uint8_t b[4];
+    memcpy(b, &v, sizeof(v));
+    out.insert(out.end(), b, b + 4);
+}
+
+static int usage(){
+    fprintf(stderr, "usage: tune [-b baud] port get|defaults|set name value ...|block v0 .. v%d\n", P_COUNT - 1);
+    return 2;
+}
+
+//Send one command and print the block it answers with
+static int transact(int fd, uint8_t cmd, const std::vector<uint8_t> &payload){
+    std::vector<uint8_t> reply;
+    if (!send(fd, cmd, payload)){
+        fprintf(stderr, "tune: write failed: %s\n", strerror(errno));
+        return 2;
+    }
+    int st = receive(fd, cmd, reply);
+    if (st < 0){
+        fprintf(stderr, "tune: no reply\n");
+        return 1;
+    }
+    if (st != ST_OK){
+        const char *why[] = {"ok", "checksum", "bad request", "version mismatch", "out of range"};
+        fprintf(stderr, "tune: rejected (%s)\n", st < 5 ? why[st] : "unknown");
+        return 1;
+    }
+    printBlock(reply);
+    return 0;
+}
+
+int main(int argc, char **argv){
+    long baud = BAUD;
+    std::vector<std::string> args;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        if (a == "-b" && i + 1 < argc) baud = atol(argv[++i]);
+        else args.push_back(a);
+    }
+    if (args.size() < 2) return usage();
+
+    int fd = openPort(args[0].c_str(), baud);
+    if (fd < 0){
+        fprintf(stderr, "tune: %s: %s\n", args[0].c_str(), strerror(errno));
+        return 2;
+    }
+    const std::string &what = args[1];
+    std::vector<uint8_t> payload;
+    if (what == "get") return transact(fd, CMD_GET, payload);
+    if (what == "defaults") return transact(fd, CMD_DEFAULTS, payload);
+    if (what == "block"){
+        if (args.size() != (size_t)P_COUNT + 2) return usage();
+        payload.push_back(PARAMS_VERSION & 0xFF);
+        payload.push_back(PARAMS_VERSION >> 8);
+        for (int i=0; i<P_COUNT; i++) putFloat(payload, atof(args[2 + i].c_str()));
+        return transact(fd, CMD_SET_BLOCK, payload);
+    }
+    if (what == "set"){
+        if (args.size() < 4 || args.size() % 2) return usage();
+        //Each set is applied on its own tick, only the last block is printed
+        for (size_t i=2; i<args.size(); i+=2){
+            int id = paramId(args[i]);
+            if (id < 0){
+                fprintf(stderr, "tune: no parameter %s\n", args[i].c_str());
+                return 2;
+            }
+            payload.clear();
+            payload.push_back(id);
+            putFloat(payload, atof(args[i + 1].c_str()));
+            if (i + 2 < args.size()){
+                std::vector<uint8_t> reply;
+                if (!send(fd, CMD_SET, payload) || receive(fd, CMD_SET, reply) != ST_OK){
+                    fprintf(stderr, "tune: set %s failed\n", args[i].c_str());
+                    return 1;
+                }
+            }
+            else return transact(fd, CMD_SET, payload);
+        }
+    }
+    return usage();
+}
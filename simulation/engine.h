@@ -0,0 +1,477 @@
+//Adaptive time step engine for the pid.ipynb car.
+//
+//The notebook moves the car VB per cycle and runs the PID once per cycle,
+//so a run costs the same per unit of track on a straight as in a hairpin.
+//Here the same car is a continuous system in time measured in cycles:
+//
+//  x' = VB cos h   y' = VB sin h   h' = (2/W) diff
+//  diff = KP e + KI I + KD (e - f)/tauD   I' = e   f' = (e - f)/tauD
+//
+//with f a first order filter of the error for the derivative term, which
+//stands in for the notebook's one cycle difference. e is err() on the
+//track as a polyline instead of its points: where the sensor array, the
+//line through the car across its heading, crosses the track, as the
+//offset from the car along the array (cx - ix in the notebook). No
+//crossing within L/2 is a lost line and e is maxE, as in the notebook. A
+//uniform grid of the segments makes err() constant time whatever the track
+//length.
+//
+//Where the track runs over itself the array sees two stretches at once.
+//Like the firmware's turn detection, which holds the line through a
+//crossing, the car keeps following the stretch it was on: the runs pass
+//the arc position last followed to the model (follow()) and err() takes
+//the crossing nearest the centre from that stretch, any other crossing
+//only when it has none.
+//
+//runAdaptive() integrates it with the Dormand-Prince 5(4) pair, six
+//evaluations a step as the last one starts the next step, the step sized
+//from the difference of the two solutions. Steps whose error exceeds tol
+//are rejected and shrunk. The car is not stiff, its time constants are a
+//cycle or so, so an explicit pair takes larger steps than an implicit one
+//for the same error. A step never runs past the next point where the
+//track's curvature changes (straight into arc, arc into straight), but the
+//step size is carried on past it and past events, so a clamp costs one
+//short step and not a climb back up from it.
+//
+//The steps do not open up much on straights. The car weaves about the
+//line with a period of about 4 cycles that barely dies out between
+//curves, and every vertex of the polyline puts a corner in e. A third
+//order pair needed steps of 0.2 to 0.3 cycle for that and lost to RK4 at
+//a fixed step; this one takes about 1.5 cycles at tol 1e-3. What it gains
+//is the line the car takes (compare()'s path), not when the car gets
+//there: the error of a step is mostly along the track and adds up over a
+//lap. simbench -w has the table.
+//
+//Jumps in e, the line lost or found away from the end of the array,
+//following another stretch and reaching the end, are located by halving
+//the step that contains them down to eventTol. Crossings and the line
+//leaving past the end of the array leave e continuous and are stepped
+//through.
+//
+//runFixed() integrates with classic RK4 at a fixed step, the reference the
+//adaptive runs are checked against, and compare() measures how far one run
+//strays from another.
+
+#pragma once
+
+#include "../hostTools/track.h"
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+struct EngineParams{
+    double L = 15; //length of sensor array
+    double W = 20; //width of the car
+    double VB = 2; //distance per cycle
+    double KP = M_PI*10/7.5; //(np.pi)*(W/2)/(0.5*L)
+    double KI = 0;
+    double KD = 0.05*M_PI*10/7.5;
+    double tauD = 1; //derivative filter, cycles
+    double maxDist = 1; //done this close to the end of the track
+};
+
+struct AdaptiveOptions{
+    double tol = 1e-4; //per step, absolute for the position, else relative
+    double hMin = 1e-6;
+    double hMax = 200; //cycles
+    double eventTol = 1e-3; //cycles a jump is located to
+    double kinkTol = 5e-3; //curvature change, 1/units, that counts as a change
+};
+
+const int STATE_N = 5; //x, y, h, I, f
+
+struct Sample{
+    double t; //cycles
+    double x, y, h;
+    double e;
+    bool lost;
+};
+
+//What the array sees
+struct Reading{
+    double e;
+    bool lost;
+    bool crossing; //another stretch of track under the array
+    double arc; //arc position followed, -1 when lost
+};
+
+struct RunStats{
+    long steps = 0; //accepted
+    long rejected = 0;
+    long evals = 0; //right hand side evaluations
+    long events = 0; //lost, found, crossings, the end
+    double t = 0; //simulated cycles
+    bool finished = false; //reached the end of the track
+};
+
+//Track polyline with a segment grid for err()
+class TrackGeom{
+private:
+    std::vector<double> x, y, s;
+    double x0, y0, cell;
+    int nx, ny;
+    std::vector<int> start; //grid cell -> first index in items
+    std::vector<int> items; //segment ids per cell
+    std::vector<double> kinks; //arc positions where the curvature changes
+public:
+    TrackGeom(const std::vector<double> &tx, const std::vector<double> &ty, double reach, double kinkTol);
+    //Offset along the array of the crossing nearest the car's centre and
+    //its arc position, false when nothing crosses within reach. Crossings
+    //with arc in [from, to] come first, other is set when there are others.
+    bool cross(double cx, double cy, double h, double reach, double from, double to,
+               double &offset, double &arc, bool &other) const;
+    //Arc position of the first curvature change past arc, or the end
+    double nextKink(double arc) const;
+    double length() const { return s.back(); }
+    double endX() const { return x.back(); }
+    double endY() const { return y.back(); }
+    size_t points() const { return x.size(); }
+    size_t kinkCount() const { return kinks.size(); }
+};
+
+TrackGeom::TrackGeom(const std::vector<double> &tx, const std::vector<double> &ty, double reach, double kinkTol) : x(tx), y(ty){
+    arcLength(x, y, s);
+    double x1 = x0 = x[0], y1 = y0 = y[0];
+    for (size_t i=0; i<x.size(); i++){
+        x0 = fmin(x0, x[i]);
+        y0 = fmin(y0, y[i]);
+        x1 = fmax(x1, x[i]);
+        y1 = fmax(y1, y[i]);
+    }
+    cell = reach;
+    x0 -= 2*cell;
+    y0 -= 2*cell;
+    nx = (int)((x1 - x0)/cell) + 3;
+    ny = (int)((y1 - y0)/cell) + 3;
+
+    //counting sort of the segments into every cell their box touches
+    std::vector<int> count(nx*ny + 1, 0);
+    for (int pass=0; pass<2; pass++){
+        std::vector<int> fill;
+        if (pass) fill.assign(start.begin(), start.end() - 1);
+        for (size_t i=0; i + 1<x.size(); i++){
+            int ax = (int)((fmin(x[i], x[i + 1]) - x0)/cell), bx = (int)((fmax(x[i], x[i + 1]) - x0)/cell);
+            int ay = (int)((fmin(y[i], y[i + 1]) - y0)/cell), by = (int)((fmax(y[i], y[i + 1]) - y0)/cell);
+            for (int cy=ay; cy<=by; cy++){
+                for (int cx=ax; cx<=bx; cx++){
+                    if (pass) items[fill[cy*nx + cx]++] = i;
+                    else count[cy*nx + cx]++;
+                }
+            }
+        }
+        if (!pass){
+            start.assign(nx*ny + 1, 0);
+            for (int c=0; c<nx*ny; c++) start[c + 1] = start[c] + count[c];
+            items.resize(start.back());
+        }
+    }
+
+    //curvature at each vertex, turn angle over the mean segment length
+    std::vector<double> k(x.size(), 0);
+    for (size_t i=1; i + 1<x.size(); i++){
+        double a = atan2(y[i] - y[i - 1], x[i] - x[i - 1]);
+        double b = atan2(y[i + 1] - y[i], x[i + 1] - x[i]);
+        double turn = remainder(b - a, 2*M_PI);
+        double ds = 0.5*(s[i + 1] - s[i - 1]);
+        k[i] = ds > 0 ? turn/ds : 0;
+    }
+    for (size_t i=1; i<x.size(); i++){
+        if (fabs(k[i] - k[i - 1]) > kinkTol) kinks.push_back(s[i]);
+    }
+}
+
+bool TrackGeom::cross(double cx, double cy, double h, double reach, double from, double to,
+                      double &offset, double &arc, bool &other) const{
+    //array direction u and heading n
+    double ux = sin(h), uy = -cos(h);
+    double nxh = cos(h), nyh = sin(h);
+    double half = 0.5*reach;
+    double lx = fmin(cx - half*ux, cx + half*ux), hx = fmax(cx - half*ux, cx + half*ux);
+    double ly = fmin(cy - half*uy, cy + half*uy), hy = fmax(cy - half*uy, cy + half*uy);
+    int ax = std::max(0, (int)((lx - x0)/cell)), bx = std::min(nx - 1, (int)((hx - x0)/cell));
+    int ay = std::max(0, (int)((ly - y0)/cell)), by = std::min(ny - 1, (int)((hy - y0)/cell));
+    bool found = false, inside = false;
+    double best = half;
+    other = false;
+    for (int gy=ay; gy<=by; gy++){
+        for (int gx=ax; gx<=bx; gx++){
+            int c = gy*nx + gx;
+            for (int k=start[c]; k<start[c + 1]; k++){
+                int i = items[k];
+                double da = nxh*(x[i] - cx) + nyh*(y[i] - cy);
+                double db = nxh*(x[i + 1] - cx) + nyh*(y[i + 1] - cy);
+                if ((da > 0 && db > 0) || (da < 0 && db < 0) || da == db) continue;
+                double t = da/(da - db);
+                double px = x[i] + t*(x[i + 1] - x[i]), py = y[i] + t*(y[i + 1] - y[i]);
+                double off = ux*(px - cx) + uy*(py - cy);
+                if (fabs(off) > half) continue;
+                double a = s[i] + t*(s[i + 1] - s[i]);
+                bool in = a >= from && a <= to;
+                if (!in) other = true;
+                if (inside && !in) continue;
+                if (in == inside && (fabs(off) > best || (found && fabs(off) == best))) continue;
+                best = fabs(off);
+                offset = off;
+                arc = a;
+                found = true;
+                inside = in;
+            }
+        }
+    }
+    return found;
+}
+
+double TrackGeom::nextKink(double arc) const{
+    std::vector<double>::const_iterator it = std::upper_bound(kinks.begin(), kinks.end(), arc);
+    return it == kinks.end() ? s.back() : *it;
+}
+
+class CarModel{
+private:
+    double from, to; //arc positions of the stretch followed
+public:
+    const TrackGeom &track;
+    EngineParams p;
+    long evals;
+
+    CarModel(const TrackGeom &track, const EngineParams &p) : from(-INFINITY), to(INFINITY), track(track), p(p), evals(0){}
+
+    //Follow the stretch from arc to where a step of h cycles can reach,
+    //any stretch when arc is negative (lost, or not started)
+    void follow(double arc, double h){
+        from = arc < 0 ? -INFINITY : arc - p.L;
+        to = arc < 0 ? INFINITY : arc + p.VB*h + p.L;
+    }
+
+    Reading err(const double *y) const{
+        Reading r;
+        double off;
+        r.lost = !track.cross(y[0], y[1], y[2], p.L, from, to, off, r.arc, r.crossing);
+        if (r.lost){
+            r.arc = -1;
+            r.e = 0.5*p.L;
+        }
+        else r.e = -off;
+        return r;
+    }
+
+    Reading rhs(const double *y, double *dy){
+        evals++;
+        Reading r = err(y);
+        double d = (r.e - y[4])/p.tauD;
+        double diff = p.KP*r.e + p.KI*y[3] + p.KD*d;
+        dy[0] = p.VB*cos(y[2]);
+        dy[1] = p.VB*sin(y[2]);
+        dy[2] = (2/p.W)*diff;
+        dy[3] = r.e;
+        dy[4] = d;
+        return r;
+    }
+
+    bool done(const double *y) const{
+        return hypot(track.endX() - y[0], track.endY() - y[1]) <= p.maxDist;
+    }
+
+    Sample sample(double t, const double *y) const{
+        Reading r = err(y);
+        Sample s;
+        s.t = t;
+        s.x = y[0];
+        s.y = y[1];
+        s.h = y[2];
+        s.e = r.e;
+        s.lost = r.lost;
+        return s;
+    }
+};
+
+//Initial state: at (x, y) facing h, no integral or derivative history
+inline void initialState(double x, double y, double h, double *state){
+    state[0] = x;
+    state[1] = y;
+    state[2] = h;
+    state[3] = 0;
+    state[4] = 0;
+}
+
+//Classic RK4 at step h until the end of the track or tEnd
+inline RunStats runFixed(CarModel &m, const double *y0, double h, double tEnd, std::vector<Sample> *out){
+    RunStats st;
+    double y[STATE_N], k[4][STATE_N], tmp[STATE_N];
+    std::copy(y0, y0 + STATE_N, y);
+    long start = m.evals;
+    double t = 0;
+    m.follow(-1, h);
+    Reading last = m.err(y);
+    if (out) out->push_back(m.sample(t, y));
+    while (t < tEnd && !m.done(y)){
+        Reading r = m.rhs(y, k[0]);
+        m.follow(r.arc, h);
+        if (r.lost != last.lost || r.crossing != last.crossing) st.events++;
+        last = r;
+        for (int i=0; i<STATE_N; i++) tmp[i] = y[i] + 0.5*h*k[0][i];
+        m.rhs(tmp, k[1]);
+        for (int i=0; i<STATE_N; i++) tmp[i] = y[i] + 0.5*h*k[1][i];
+        m.rhs(tmp, k[2]);
+        for (int i=0; i<STATE_N; i++) tmp[i] = y[i] + h*k[2][i];
+        m.rhs(tmp, k[3]);
+        for (int i=0; i<STATE_N; i++) y[i] += h/6*(k[0][i] + 2*k[1][i] + 2*k[2][i] + k[3][i]);
+        t += h;
+        st.steps++;
+        if (out) out->push_back(m.sample(t, y));
+    }
+    st.t = t;
+    st.finished = m.done(y);
+    if (st.finished) st.events++;
+    st.evals = m.evals - start;
+    return st;
+}
+
+//Dormand-Prince 5(4) with error control, geometry limited steps and
+//located jumps
+inline RunStats runAdaptive(CarModel &m, const double *y0, const AdaptiveOptions &o, double tEnd, std::vector<Sample> *out){
+    //stage coefficients, the last row the fifth order weights as the pair
+    //is FSAL, and E the fifth less the fourth order weights
+    static const double A[6][6] = {
+        {1.0/5},
+        {3.0/40, 9.0/40},
+        {44.0/45, -56.0/15, 32.0/9},
+        {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+        {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+        {35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}};
+    static const double E[7] = {71.0/57600, 0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40};
+    RunStats st;
+    long start = m.evals;
+    double y[STATE_N], k[7][STATE_N];
+    std::copy(y0, y0 + STATE_N, y);
+    m.follow(-1, 0);
+    Reading r = m.rhs(y, k[0]);
+    double t = 0, h = 0.1;
+    double resume = 0, bracket = 0; //step size to go on with once the jump in a step ending at bracket is located
+    if (out) out->push_back(m.sample(t, y));
+
+    while (t < tEnd && !m.done(y)){
+        //the step ends at the next curvature change under the array, one
+        //it has all but reached counting as passed
+        double limit = fmin(o.hMax, tEnd - t);
+        if (!r.lost) limit = fmin(limit, (m.track.nextKink(r.arc + 0.01*m.p.VB*h) - r.arc)/m.p.VB);
+        double step = fmax(fmin(h, limit), o.hMin);
+        bool clamped = step < h;
+        m.follow(r.arc, step);
+
+        double tmp[STATE_N], yn[STATE_N];
+        Reading rn;
+        for (int s=1; s<7; s++){
+            double *to = s < 6 ? tmp : yn;
+            for (int i=0; i<STATE_N; i++){
+                double sum = 0;
+                for (int j=0; j<s; j++) sum += A[s - 1][j]*k[j][i];
+                to[i] = y[i] + step*sum;
+            }
+            //k[6] is the next step's k[0], rn ends up its reading
+            rn = m.rhs(to, k[s]);
+        }
+
+        double err = 0;
+        for (int i=0; i<STATE_N; i++){
+            double diff = 0;
+            for (int j=0; j<7; j++) diff += E[j]*k[j][i];
+            //position absolute, where the track lies makes no difference
+            double scale = i < 2 ? o.tol : o.tol*(1 + fmax(fabs(y[i]), fabs(yn[i])));
+            err = fmax(err, fabs(step*diff)/scale);
+        }
+        double grow = err > 0 ? fmin(4, fmax(0.2, 0.9*pow(err, -1.0/5))) : 4;
+
+        //a jump in the step: halve it until the jump is pinned down
+        bool jump = (rn.lost != r.lost && fabs(rn.e - r.e) > 0.05*m.p.L) ||
+                    (!r.lost && !rn.lost && fabs(rn.arc - r.arc) > m.p.VB*step + m.p.L) || m.done(yn);
+        if (jump && step > o.eventTol){
+            if (!resume){
+                resume = h;
+                bracket = t + step;
+            }
+            st.rejected++;
+            h = step/2;
+            continue;
+        }
+        if (!jump && err > 1 && step > o.hMin){
+            st.rejected++;
+            h = step*grow;
+            continue;
+        }
+        if (rn.lost != r.lost || rn.crossing != r.crossing || m.done(yn)) st.events++;
+
+        std::copy(yn, yn + STATE_N, y);
+        std::copy(k[6], k[6] + STATE_N, k[0]);
+        r = rn;
+        t += step;
+        st.steps++;
+        if (jump || (resume && t >= bracket - o.hMin)){
+            if (resume) h = resume;
+            resume = 0;
+        }
+        else if (resume) h = fmin(step*grow, bracket - t); //the jump is in the rest
+        else h = clamped ? fmax(h, step*grow) : step*grow;
+        if (out) out->push_back(m.sample(t, y));
+    }
+    st.t = t;
+    st.finished = m.done(y);
+    st.evals = m.evals - start;
+    return st;
+}
+
+struct Deviation{
+    double pos = 0; //max distance between the two cars at the same time
+    double path = 0; //max distance of run's samples from ref's path
+    double finish = 0; //difference of the time at the end
+};
+
+//How far run strays from ref. pos compares at ref's times, run linear
+//between its samples, so it grows with any lag that builds up over a lap;
+//path takes each of run's own samples to the nearest point of ref's path
+//ahead of the last one matched and heading the same way (not the stretch
+//crossing it), which is what a lap's line looks like.
+inline Deviation compare(const std::vector<Sample> &ref, const std::vector<Sample> &run){
+    Deviation d;
+    if (ref.empty() || run.empty()) return d;
+    size_t j = 0;
+    for (size_t i=0; i<ref.size(); i++){
+        double t = ref[i].t;
+        if (t > run.back().t) break;
+        while (j + 1 < run.size() && run[j + 1].t < t) j++;
+        const Sample &a = run[j];
+        const Sample &b = j + 1 < run.size() ? run[j + 1] : run[j];
+        double w = b.t > a.t ? (t - a.t)/(b.t - a.t) : 0;
+        w = fmin(1, fmax(0, w));
+        double x = a.x + w*(b.x - a.x), y = a.y + w*(b.y - a.y);
+        d.pos = fmax(d.pos, hypot(x - ref[i].x, y - ref[i].y));
+    }
+
+    const size_t window = 4096; //ref samples searched ahead
+    size_t k = 0;
+    for (size_t i=0; i<run.size(); i++){
+        double best = INFINITY;
+        size_t at = k;
+        for (size_t r=k; r + 1<ref.size() && r<k + window; r++){
+            //not the stretch crossing this one
+            if (cos(run[i].h - ref[r].h) < 0.5) continue;
+            //distance to the segment ref[r], ref[r + 1]
+            double sx = ref[r + 1].x - ref[r].x, sy = ref[r + 1].y - ref[r].y;
+            double qx = run[i].x - ref[r].x, qy = run[i].y - ref[r].y;
+            double len = sx*sx + sy*sy;
+            double u = len > 0 ? fmin(1, fmax(0, (qx*sx + qy*sy)/len)) : 0;
+            double dist = hypot(qx - u*sx, qy - u*sy);
+            if (dist < best){
+                best = dist;
+                at = r;
+            }
+        }
+        if (best < INFINITY){
+            d.path = fmax(d.path, best);
+            k = at;
+        }
+    }
+    d.finish = run.back().t - ref.back().t;
+    return d;
+}
@@ -0,0 +1,126 @@
+//Wall time per simulated lap of the adaptive engine (engine.h) against
+//fixed steps, across tracks of any size.
+//
+//Each track is run three ways from its first point, facing along its first
+//segment, to within maxDist of its last point: the reference, RK4 at a
+//small fixed step; RK4 at a fixed step, one per cycle by default, the
+//notebook's resolution; and the adaptive engine at tolerance tol. Every
+//run is timed without keeping samples, best of -r repeats, then run once
+//more keeping them to compare against the reference. Per track and method
+//it prints the step or tol, the steps (and rejected steps), right hand
+//side evaluations, wall time per lap, and against the reference the
+//largest distance from its path and from the reference car at the same
+//time (compare() in engine.h) and the difference in lap time, in cycles.
+//A run that does not finish within 3 times the track's length in cycles
+//is marked DNF.
+//
+//-w makes it a work-precision table: RK4 at fixed_step and four halvings
+//of it and the adaptive engine from 100 times tol down to tol/1000 by
+//decades, so error against ms/lap over both. The adaptive runs keep to
+//the path for a quarter of the time RK4 needs or less, RK4 losing the line
+//on track.csv at 1/2 cycle, and below tol 1e-5 there the path is as close
+//as the reference can tell (take -h smaller). RK4 keeps better time at
+//every tol, see engine.h.
+//
+//Tracks of several sizes come from trackgen, e.g.
+//  trackgen -l 2000 -k tcshx -o /tmp/t2k.csv
+//
+//Build:
+//  g++ -O2 -std=gnu++11 simulation/simbench.cpp -o simbench
+//
+//Usage:
+//  simbench [-w] [-t tol] [-h ref_step] [-f fixed_step] [-r repeats] [-v speed] track.csv...
+//
+//Defaults: tol 1e-4, ref_step 1/32 cycle, fixed_step 1, repeats 3, speed 2
+//(VB). Exit status is 0 when every adaptive run finishes and stays within 1
+//unit of the reference's path, 1 when one does not, 2 on error.
+
+#include "engine.h"
+
+#include <chrono>
+#include <string>
+
+struct Method{
+    const char *name;
+    int kind; //0 fixed RK4, 1 adaptive
+    double at; //step, or tol
+};
+
+static RunStats runOnce(CarModel &m, const Method &k, const AdaptiveOptions &o, const double *y0, double tEnd,
+                        std::vector<Sample> *out){
+    m.evals = 0;
+    if (!k.kind) return runFixed(m, y0, k.at, tEnd, out);
+    AdaptiveOptions at = o;
+    at.tol = k.at;
+    return runAdaptive(m, y0, at, tEnd, out);
+}
+
+int main(int argc, char **argv){
+    AdaptiveOptions o;
+    EngineParams p;
+    double hRef = 1.0/32, hFixed = 1;
+    int repeats = 3;
+    bool sweep = false;
+    std::vector<const char *> paths;
+    for (int i=1; i<argc; i++){
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "-w") sweep = true;
+        else if (a == "-t" && more) o.tol = atof(argv[++i]);
+        else if (a == "-h" && more) hRef = atof(argv[++i]);
+        else if (a == "-f" && more) hFixed = atof(argv[++i]);
+        else if (a == "-r" && more) repeats = atoi(argv[++i]);
+        else if (a == "-v" && more) p.VB = atof(argv[++i]);
+        else if (a[0] == '-') paths.clear(), i = argc;
+        else paths.push_back(argv[i]);
+    }
+    if (paths.empty() || o.tol <= 0 || hRef <= 0 || hFixed <= 0 || repeats < 1 || p.VB <= 0){
+        fprintf(stderr, "usage: simbench [-w] [-t tol] [-h ref_step] [-f fixed_step] [-r repeats] [-v speed] track.csv...\n");
+        return 2;
+    }
+
+    std::vector<Method> methods;
+    methods.push_back({"reference", 0, hRef});
+    for (int i=0; i<(sweep ? 5 : 1); i++) methods.push_back({"fixed", 0, hFixed/(1 << i)});
+    for (int i=0; i<(sweep ? 6 : 1); i++) methods.push_back({"adaptive", 1, sweep ? o.tol*100/pow(10, i) : o.tol});
+    bool ok = true;
+    printf("%-20s %7s %6s %-9s %8s %8s %6s %8s %9s %8s %8s %8s\n", "track", "length", "kinks", "method",
+           "at", "steps", "rej", "evals", "ms/lap", "path", "time", "lap");
+    for (size_t t=0; t<paths.size(); t++){
+        std::vector<double> x, y;
+        if (!readTrackCSV(paths[t], x, y) || x.size() < 2){
+            fprintf(stderr, "simbench: cannot read %s\n", paths[t]);
+            return 2;
+        }
+        TrackGeom geom(x, y, p.L, o.kinkTol);
+        CarModel m(geom, p);
+        double y0[STATE_N];
+        initialState(x[0], y[0], atan2(y[1] - y[0], x[1] - x[0]), y0);
+        double tEnd = 3*geom.length()/p.VB;
+
+        std::vector<Sample> ref;
+        for (size_t k=0; k<methods.size(); k++){
+            double best = INFINITY;
+            RunStats st;
+            for (int r=0; r<repeats; r++){
+                auto a = std::chrono::steady_clock::now();
+                st = runOnce(m, methods[k], o, y0, tEnd, 0);
+                auto b = std::chrono::steady_clock::now();
+                best = fmin(best, std::chrono::duration<double, std::milli>(b - a).count());
+            }
+            std::vector<Sample> samples;
+            runOnce(m, methods[k], o, y0, tEnd, &samples);
+            Deviation d;
+            if (k == 0) ref.swap(samples);
+            else d = compare(ref, samples);
+
+            printf("%-20s %7.0f %6zu %-9s %8.3g %8ld %6ld %8ld %9.3f", paths[t], geom.length(), geom.kinkCount(),
+                   methods[k].name, methods[k].at, st.steps, st.rejected, st.evals, best);
+            if (!st.finished) printf(" %8s\n", "DNF");
+            else if (k == 0) printf(" %8s %8s %8s\n", "-", "-", "-");
+            else printf(" %8.4f %8.4f %8.3f\n", d.path, d.pos, d.finish);
+            if (methods[k].kind && (!st.finished || d.path > 1)) ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+//C++ core of the pid.ipynb simulation, called from Python through simcore.py.
+//
+//The car model (theta, v, p), the error function err() and the PID step are
+//the notebook's, line for line, so a run gives the same path and errors.
+//run() steps a whole trajectory per call and writes it straight into
+//arrays the caller allocated (NumPy arrays from simcore.py), so nothing is
+//appended or copied per step.
+//
+//err() keeps the notebook's geometry as it is. Its temp = ry aliases ry, so
+//the nearest point's y reads inf, the track path through the two nearest
+//points has an infinite slope and the intersection is the nearest point's
+//x along the sensor array; the sensor path's ends use cx for both
+//coordinates, which only matters when it is exactly vertical (no
+//intersection, maxE).
+//
+//Build:
+//  g++ -O2 -std=gnu++11 -shared -fPIC simulation/simcore.cpp -o simulation/libsimcore.so
+
+#include <math.h>
+#include <stdint.h>
+
+extern "C" {
+
+struct SimParams{
+    double L; //length of sensor array
+    double W; //width of the car
+    double VB; //speed distance/cycle
+    double KP, KI, KD;
+    double targetX, targetY; //destination position
+    double maxDist; //stop this close to the destination
+};
+
+//State carried from one run() call to the next, like the notebook's globals
+struct SimState{
+    double x, y; //car position
+    double heading;
+    double diff; //wheel speed difference
+    double prevE; //last error, for the derivative
+    double integral;
+};
+
+//rotate point (px, py) about (cx, cy)
+static inline void rotate(double px, double py, double cx, double cy, double heading, double &qx, double &qy){
+    double c = cos(heading), s = sin(heading);
+    qx = cx + c*(px - cx) - s*(py - cy);
+    qy = cy + s*(px - cx) + c*(py - cy);
+}
+
+//Error of the car at (cx, cy) facing heading against the n track points
+double simcore_err(const double *tx, const double *ty, int64_t n, double L, double cx, double cy, double heading){
+    double maxE = 0.5*L;
+    double phi = heading - 0.5*M_PI;
+    double ax = cx + 0.5*L*cos(phi);
+    double bx = cx - 0.5*L*cos(phi);
+
+    //the track point, within reach of the array, nearest it across
+    bool any = false;
+    double best = INFINITY, p1x = 0;
+    for (int64_t i=0; i<n; i++){
+        double dx = cx - tx[i], dy = cy - ty[i];
+        if (sqrt(dx*dx + dy*dy) >= 0.5*L) continue;
+        double qx, qy;
+        rotate(tx[i], ty[i], cx, cy, -phi, qx, qy);
+        double d = fabs(cy - qy);
+        //first of equals, as np.argmin
+        if (!any || d < best){
+            best = d;
+            p1x = qx;
+        }
+        any = true;
+    }
+    if (!any) return maxE;
+
+    //sensor path vertical as well, the paths are parallel
+    if (bx - ax == 0) return maxE;
+    return cx - p1x;
+}
+
+//Error for m poses at once
+void simcore_err_many(const double *tx, const double *ty, int64_t n, double L,
+                      const double *cx, const double *cy, const double *heading, int64_t m, double *out){
+    for (int64_t k=0; k<m; k++) out[k] = simcore_err(tx, ty, n, L, cx[k], cy[k], heading[k]);
+}
+
+//Run up to maxSteps PID steps from state, or until within maxDist of the
+//target. Writes the position before each step to posX/posY and the error
+//of each step to errs, updates state and returns the number of steps.
+int64_t simcore_run(const double *tx, const double *ty, int64_t n, const SimParams *p, SimState *state,
+                    int64_t maxSteps, double *posX, double *posY, double *errs){
+    SimState s = *state;
+    double dist = sqrt((p->targetX - s.x)*(p->targetX - s.x) + (p->targetY - s.y)*(p->targetY - s.y));
+    int64_t k = 0;
+    while (dist > p->maxDist && k < maxSteps){
+        posX[k] = s.x;
+        posY[k] = s.y;
+
+        //car position
+        s.heading += (2/p->W)*s.diff;
+        s.x += p->VB*cos(s.heading);
+        s.y += p->VB*sin(s.heading);
+
+        double e = simcore_err(tx, ty, n, p->L, s.x, s.y, s.heading);
+        errs[k] = e;
+
+        //wheel speed difference
+        s.diff = p->KP*e + p->KI*s.integral + p->KD*(e - s.prevE);
+        s.integral += e;
+        s.prevE = e;
+
+        dist = sqrt((p->targetX - s.x)*(p->targetX - s.x) + (p->targetY - s.y)*(p->targetY - s.y));
+        k++;
+    }
+    *state = s;
+    return k;
+}
+
+}
@@ -0,0 +1,79 @@
+#Python side of simcore.cpp, the pid.ipynb simulation in C++
+#
+#Build the library next to this file first:
+#  g++ -O2 -std=gnu++11 -shared -fPIC simulation/simcore.cpp -o simulation/libsimcore.so
+#
+#The output arrays are allocated here with NumPy and filled in place by the
+#library, run() returns views of them, nothing is copied.
+import ctypes
+import os
+import numpy as np
+
+_lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), "libsimcore.so"))
+
+_array = np.ctypeslib.ndpointer(dtype=np.float64, flags="C_CONTIGUOUS")
+
+class SimParams(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_double) for name in
+                ("L", "W", "VB", "KP", "KI", "KD", "targetX", "targetY", "maxDist")]
+
+class SimState(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_double) for name in
+                ("x", "y", "heading", "diff", "prevE", "integral")]
+
+_lib.simcore_err.restype = ctypes.c_double
+_lib.simcore_err.argtypes = [_array, _array, ctypes.c_int64, ctypes.c_double,
+                             ctypes.c_double, ctypes.c_double, ctypes.c_double]
+_lib.simcore_err_many.restype = None
+_lib.simcore_err_many.argtypes = [_array, _array, ctypes.c_int64, ctypes.c_double,
+                                  _array, _array, _array, ctypes.c_int64, _array]
+_lib.simcore_run.restype = ctypes.c_int64
+_lib.simcore_run.argtypes = [_array, _array, ctypes.c_int64, ctypes.POINTER(SimParams),
+                             ctypes.POINTER(SimState), ctypes.c_int64, _array, _array, _array]
+
+def _doubles(a):
+    return np.ascontiguousarray(a, dtype=np.float64)
+
+#Track points the library reads, converted once
+class Track:
+    def __init__(self, TX, TY):
+        self.x = _doubles(TX)
+        self.y = _doubles(TY)
+        self.n = len(self.x)
+
+#error function, as err(pos, heading) in the notebook
+def err(track, L, pos, heading):
+    return _lib.simcore_err(track.x, track.y, track.n, L, pos[0], pos[1], heading)
+
+#errors of many poses, one array per coordinate
+def errs(track, L, xs, ys, headings):
+    xs, ys, headings = _doubles(xs), _doubles(ys), _doubles(headings)
+    out = np.empty(len(xs))
+    _lib.simcore_err_many(track.x, track.y, track.n, L, xs, ys, headings, len(xs), out)
+    return out
+
+#The car's state between runs, the notebook's pos, heading, diff, prev_e
+#and integral
+class Car:
+    def __init__(self, pos, heading):
+        self.state = SimState(pos[0], pos[1], heading, 0, 0, 0)
+
+    @property
+    def pos(self):
+        return [self.state.x, self.state.y]
+
+    @property
+    def heading(self):
+        return self.state.heading
+
+#Run the PID loop until the car is within maxDist of target or maxSteps
+#steps have passed. Returns the position history and errors as NumPy arrays
+#(pos_x, pos_y, errs in the notebook), the car keeps its final state.
+def run(track, car, target, L, W, VB, KP, KI, KD, maxDist=1, maxSteps=100000):
+    params = SimParams(L, W, VB, KP, KI, KD, target[0], target[1], maxDist)
+    pos_x = np.empty(maxSteps)
+    pos_y = np.empty(maxSteps)
+    e = np.empty(maxSteps)
+    n = _lib.simcore_run(track.x, track.y, track.n, ctypes.byref(params), ctypes.byref(car.state),
+                         maxSteps, pos_x, pos_y, e)
+    return pos_x[:n], pos_y[:n], e[:n]